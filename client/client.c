@@ -13,12 +13,60 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <libgen.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include "../common/common.h"
 
 #define ROOT_DIRECTORY "./root/"
 
-int socket_desc;
-struct sockaddr_in server_addr;
+// Every thread has a connection of its own, a parallel GET or PUT opens more of them. What is agreed on is per connection
+__thread int socket_desc;
+__thread struct sockaddr_in server_addr;
+
+// largest data frame payload agreed on with the server for this connection
+__thread int chunk_size = SERVER_MESSAGE_SIZE;
+
+// whether the server agreed to checksum every transfer with CRC32C
+__thread bool isChecksummed = false;
+
+// whether the server agreed to compress data frames
+__thread bool isCompressed = false;
+
+// true on the extra connections of a parallel GET or PUT, losing one of them only ends its thread
+__thread bool isRangeWorker = false;
+
+// A range of a file fetched by one GET, and what came of it
+typedef struct s_range
+{
+  char *remote_file_path;
+  char *local_file_path;
+  int fd; // partial file, the range is written at its place in the file
+  long long offset;
+  long long length;    // 0 runs up to the end of the file
+  long long file_size; // size of the whole file, as the server told it for a range, -1 otherwise
+  bool isWholeChecked; // the server sent the CRC32C of the whole file
+  uint32_t whole_crc;
+  int status; // 0 once all of the range is written, 1 if the server can't serve it, -1 otherwise
+} t_range;
+
+// A GET or PUT spread over several connections, each taking the next piece of the file nobody took yet
+typedef struct s_parallelTransfer
+{
+  char *remote_file_path;
+  char *local_file_path;
+  const char *actual_path; // local file the pieces of a PUT are read from
+  const char *upload_id;   // upload the pieces of a PUT are ranges of, NULL for a GET
+  int fd;                  // file the pieces of a GET are written to, each at its place
+  long long file_size;
+  int piece_count;
+  int next_piece;
+  bool *isPieceDone;
+  bool isFailed;  // a piece couldn't be transferred, nobody takes new ones
+  bool isRefused; // the server turned a piece of a PUT down, sending it again won't help
+  bool isWholeChecked;
+  uint32_t whole_crc; // CRC32C of the whole file, sent with the last piece of a GET
+  pthread_mutex_t mutex;
+} t_parallelTransfer;
 
 /// @brief  Closes the open socket for the client.
 void client_closeClientSocket()
@@ -26,6 +74,9 @@ void client_closeClientSocket()
   // Close the socket:
   close(socket_desc);
   printf("EXIT: closing client socket\n");
+
+  if (isRangeWorker)
+    pthread_exit(NULL);
   exit(1);
 }
 
@@ -80,25 +131,112 @@ void client_sendMessageToServer(char client_message[CODE_SIZE + CODE_PADDING + C
   printf("SENDING TO SERVER: %s \n", client_message);
 
   // Send the message to server:
-  if (send(socket_desc, client_message, strlen(client_message), 0) < 0)
+  if (frame_send(socket_desc, FRAME_OP_STATUS, FRAME_FLAG_NONE, client_message, strlen(client_message)) < 0)
   {
     printf("ERROR: Unable to send message \n");
     client_closeClientSocket();
   }
 }
 
-/// @brief To receive a message from the server.
-/// @param server_message represents the received message.
-void client_recieveMessageFromServer(char *server_message)
+/// @brief To send a command to the server.
+/// @param client_command represents the command to be sent.
+void client_sendCommandToServer(char client_command[CODE_SIZE + CODE_PADDING + CLIENT_MESSAGE_SIZE])
+{
+  printf("SENDING TO SERVER: %s \n", client_command);
+
+  // Send the command to server:
+  if (frame_send(socket_desc, FRAME_OP_COMMAND, FRAME_FLAG_NONE, client_command, strlen(client_command)) < 0)
+  {
+    printf("ERROR: Unable to send command \n");
+    client_closeClientSocket();
+  }
+}
+
+/// @brief To send a block of file contents to the server.
+/// @param data represents the file contents, may contain any byte.
+/// @param length is the no. of bytes in data.
+/// @param flags represents FRAME_FLAG_* bits for the frame.
+void client_sendDataToServer(char *data, int length, uint16_t flags)
+{
+  if (frame_send(socket_desc, FRAME_OP_DATA, flags, data, length) < 0)
+  {
+    printf("ERROR: Unable to send data \n");
+    client_closeClientSocket();
+  }
+}
+
+/// @brief To receive a frame from the server.
+/// @param header is filled with the received frame header.
+/// @param server_message represents the received message or file contents.
+/// @param capacity is the size of server_message.
+void client_recieveFrameFromServer(t_frameHeader *header, char *server_message, int capacity)
 {
   // Receive the server's response:
-  if (recv(socket_desc, server_message, CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE, 0) < 0)
+  if (frame_recv(socket_desc, header, server_message, capacity) < 0)
   {
     printf("ERROR: Error while receiving server's message \n");
     client_closeClientSocket();
   }
 
-  printf("RECIEVED FROM SERVER: %s \n", server_message);
+  if (header->opcode != FRAME_OP_DATA)
+  {
+    printf("RECIEVED FROM SERVER: %s \n", server_message);
+  }
+}
+
+/// @brief To receive a message from the server.
+/// @param server_message represents the received message.
+void client_recieveMessageFromServer(char *server_message)
+{
+  t_frameHeader header;
+
+  client_recieveFrameFromServer(&header, server_message, CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE);
+}
+
+/// @brief Connects to the server and agrees on the chunk size for the connection, on checksumming transfers and on
+///        compressing them.
+void client_openSession()
+{
+  client_connect();
+
+  char client_message[CODE_SIZE + CODE_PADDING + CLIENT_MESSAGE_SIZE];
+  char server_response[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
+  memset(client_message, 0, sizeof(client_message));
+  memset(server_response, 0, sizeof(server_response));
+
+  sprintf(client_message, "C:006 %d%s%s", CLIENT_CHUNK_SIZE, CLIENT_CHECKSUMS ? " " CHECKSUM_FEATURE : "",
+          CLIENT_COMPRESSION ? " " COMPRESSION_FEATURE : "");
+
+  client_sendCommandToServer(client_message);
+
+  client_recieveMessageFromServer(server_response);
+
+  if (strncmp(server_response, "S:200", CODE_SIZE) == 0 && atoi(server_response + CODE_SIZE + CODE_PADDING) > 0)
+  {
+    chunk_size = atoi(server_response + CODE_SIZE + CODE_PADDING);
+
+    // the server only echoes the features it agreed on
+    isChecksummed = strstr(server_response, " " CHECKSUM_FEATURE " ") != NULL;
+    isCompressed = strstr(server_response, " " COMPRESSION_FEATURE " ") != NULL;
+  }
+
+  printf("SESSION: chunk size is %d bytes%s%s\n", chunk_size, isChecksummed ? ", transfers are checksummed" : "",
+         isCompressed ? ", data frames are compressed" : "");
+}
+
+/// @brief Says goodbye to the server, so it can release the connection right away.
+void client_closeSession()
+{
+  char client_message[CODE_SIZE + CODE_PADDING + CLIENT_MESSAGE_SIZE];
+  char server_response[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
+  memset(client_message, 0, sizeof(client_message));
+  memset(server_response, 0, sizeof(server_response));
+
+  strcat(client_message, "C:007");
+
+  client_sendCommandToServer(client_message);
+
+  client_recieveMessageFromServer(server_response);
 }
 
 #pragma endregion Communication
@@ -124,109 +262,694 @@ bool directory_isDirectoryExists(const char *path)
 #pragma endregion Directory Management
 
 #pragma region Commands
+/// @brief Computes the CRC32C of a whole local file.
+/// @param path is the file.
+/// @param crc is filled with the CRC32C.
+/// @return 0 if the file could be read, -1 otherwise.
+int client_checksumFile(const char *path, uint32_t *crc)
+{
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+    return -1;
 
-/// @brief To get a file data from server to the local client space.
-/// @param remote_file_path is the path of the remote file on server to be retrieved.
-/// @param local_file_path is the file path where the data needs ro be stored in client.
-void command_get(char *remote_file_path, char *local_file_path)
+  char buffer[64 * 1024];
+  size_t bytes_read;
+  *crc = 0;
+
+  while ((bytes_read = fread(buffer, sizeof(char), sizeof(buffer), file)) > 0)
+    *crc = checksum_crc32c(*crc, buffer, bytes_read);
+
+  int status = ferror(file) ? -1 : 0;
+  fclose(file);
+
+  return status;
+}
+
+/// @brief Fetches a range of a file from the server into its place in a partial file.
+/// @param range represents the range, its outcome is filled in.
+void client_receiveRange(t_range *range)
 {
-  printf("COMMAND: GET started\n");
+  bool isCorrupted = false;
+  bool isWriteFailed = false;
+  long long received = 0;
 
-  // Open local file for writing
-  FILE *local_file;
-  char actual_path[200];
-  strcpy(actual_path, ROOT_DIRECTORY);
-  strncat(actual_path, local_file_path, strlen(local_file_path));
-  printf("GET: actual path: %s \n", actual_path);
+  range->status = -1;
+  range->file_size = -1;
+  range->isWholeChecked = false;
 
-  local_file = fopen(actual_path, "w");
+  char client_message[CODE_SIZE + CODE_PADDING + CLIENT_MESSAGE_SIZE];
+  memset(client_message, 0, sizeof(client_message));
+  char server_response[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
+  memset(server_response, 0, sizeof(server_response));
 
-  if (local_file == NULL)
-  {
-    printf("GET ERROR: Local file could not be opened. Please check whether the location exists.\n");
-  }
-  else
-  {
-    // Connect to server socket:
-    client_connect();
+  // sending message to server
+  char code[CODE_SIZE + CODE_PADDING] = "C:001 ";
+  strncat(client_message, code, CODE_SIZE + CODE_PADDING);
 
-    char client_message[CODE_SIZE + CODE_PADDING + CLIENT_MESSAGE_SIZE];
-    memset(client_message, 0, sizeof(client_message));
-    char server_response[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
-    memset(server_response, 0, sizeof(server_response));
+  strncat(client_message, range->remote_file_path, strlen(range->remote_file_path));
+  strncat(client_message, " ", 1);
+  strncat(client_message, range->local_file_path, strlen(range->local_file_path));
+
+  if (range->offset > 0 || range->length > 0)
+    sprintf(client_message + strlen(client_message), " %lld %lld", range->offset, range->length);
 
-    // sending message to server
-    char code[CODE_SIZE + CODE_PADDING] = "C:001 ";
-    strncat(client_message, code, CODE_SIZE + CODE_PADDING);
+  client_sendCommandToServer(client_message);
 
-    strncat(client_message, remote_file_path, strlen(remote_file_path));
-    strncat(client_message, " ", 1);
-    strncat(client_message, local_file_path, strlen(local_file_path));
+  // Receive server response
+  client_recieveMessageFromServer(server_response);
+
+  // Check if the file exists on the server, a range is answered with the size of the whole file
+  if (strncmp(server_response, "S:200", CODE_SIZE) == 0 || strncmp(server_response, "S:206", CODE_SIZE) == 0)
+  {
+    if (strncmp(server_response, "S:206", CODE_SIZE) == 0)
+      range->file_size = atoll(server_response + CODE_SIZE + CODE_PADDING);
+
+    // Tell the server to start streaming, and how many blocks it may send before waiting for us
+    memset(client_message, 0, sizeof(client_message));
+    sprintf(client_message, "S:100 %d Success Continue", TRANSFER_WINDOW_SIZE);
 
     client_sendMessageToServer(client_message);
 
-    // Receive server response
-    client_recieveMessageFromServer(server_response);
+    // Receive file data from server and write it to local file, blocks can be as large as the chunk size
+    t_frameHeader header;
+    int blocks_since_grant = 0;
+    uint32_t file_crc = 0;
+
+    int block_capacity = chunk_size + CHECKSUM_SIZE + 1 > (int)sizeof(server_response)
+                             ? chunk_size + CHECKSUM_SIZE + 1
+                             : (int)sizeof(server_response);
+    char *block = malloc(block_capacity);
+    char *expanded = isCompressed ? malloc(chunk_size) : NULL;
+    if (block == NULL || (isCompressed && expanded == NULL))
+    {
+      printf("GET ERROR: Couldn't allocate memory for a block\n");
+      client_closeClientSocket();
+    }
 
-    // Check if the file exists on the server
-    if (strncmp(server_response, "S:200", CODE_SIZE) == 0)
+    // continue taking blocks from server until it is done
+    while (true)
     {
-      printf("GET: File Found - Server Response: %s \n", server_response);
+      client_recieveFrameFromServer(&header, block, block_capacity);
 
-      // Hint the server to send the file data requested
-      memset(client_message, 0, sizeof(client_message));
-      strcat(client_message, "S:100 ");
-      strcat(client_message, "Success Continue");
+      if (header.opcode == FRAME_OP_DATA)
+      {
+        char *data = block;
+        uint32_t length = header.length;
+        uint32_t crc = 0;
+        bool isBlockChecksummed = (header.flags & FRAME_FLAG_CHECKSUM) != 0;
 
-      client_sendMessageToServer(client_message);
+        if (isBlockChecksummed)
+        {
+          // the block ends with its CRC32C
+          if (length < CHECKSUM_SIZE)
+          {
+            isCorrupted = true;
+            isBlockChecksummed = false;
+            length = 0;
+          }
+          else
+          {
+            length -= CHECKSUM_SIZE;
+            memcpy(&crc, block + length, CHECKSUM_SIZE);
+          }
+        }
 
-      // Receive file data from server and write it to local file
-      // get first block from server
-      memset(server_response, 0, sizeof(server_response));
-      client_recieveMessageFromServer(server_response);
+        if ((header.flags & FRAME_FLAG_COMPRESSED) && length > 0)
+        {
+          int expanded_length = expanded != NULL ? compress_expand(block, length, expanded, chunk_size) : -1;
+          if (expanded_length < 0)
+          {
+            isCorrupted = true;
+            isBlockChecksummed = false;
+            expanded_length = 0;
+          }
 
-      // continue taking blocks from server until it is done
-      while (true)
-      {
-        if (strncmp(server_response, "S:206", CODE_SIZE) == 0)
+          data = expanded;
+          length = expanded_length;
+        }
+
+        if (isBlockChecksummed)
         {
-          char *file_contents;
-          file_contents = server_response + CODE_SIZE + CODE_PADDING;
+          if (ntohl(crc) != checksum_crc32c(0, data, length))
+            isCorrupted = true;
 
-          // printf("GET: Writing to file: %s\n", file_contents);
+          file_crc = checksum_crc32c(file_crc, data, length);
+        }
 
-          fwrite(file_contents, sizeof(char), strlen(file_contents), local_file);
+        // once a block is bad the rest of the range isn't worth keeping
+        if (!isCorrupted && !isWriteFailed &&
+            pwrite(range->fd, data, length, range->offset + received) != (ssize_t)length)
+        {
+          printf("GET ERROR: Local file could not be written\n");
+          isWriteFailed = true;
+        }
+        received += length;
 
+        // top the window back up once half of it is used, so the server never has to stop and wait
+        if (TRANSFER_WINDOW_SIZE > 0 && ++blocks_since_grant == (TRANSFER_WINDOW_SIZE + 1) / 2)
+        {
           memset(client_message, 0, sizeof(client_message));
-          strcat(client_message, "S:100 ");
-          strcat(client_message, "Success Continue");
+          sprintf(client_message, "S:100 %d Success Continue", blocks_since_grant);
 
           client_sendMessageToServer(client_message);
-
-          // get next block from server
-          memset(server_response, 0, sizeof(server_response));
-          client_recieveMessageFromServer(server_response);
+          blocks_since_grant = 0;
         }
-        else if (strncmp(server_response, "E:500", CODE_SIZE) == 0)
-        {
-          printf("GET ERROR: File could not be recieved\n");
+      }
+      else if (strncmp(block, "E:500", CODE_SIZE) == 0)
+      {
+        printf("GET ERROR: File could not be recieved\n");
 
-          break;
+        break;
+      }
+      else if (strncmp(block, "S:200", CODE_SIZE) == 0)
+      {
+        uint32_t server_crc;
+        if (isCorrupted || (checksum_parse(block, &server_crc) && server_crc != file_crc))
+        {
+          printf("GET ERROR: File was corrupted on its way from the server\n");
         }
-        else if (strncmp(server_response, "S:200", CODE_SIZE) == 0)
+        else if (!isWriteFailed)
         {
           printf("GET: File received successfully\n");
-
-          break;
+          range->status = 0;
         }
+
+        range->isWholeChecked = checksum_parseField(block, CHECKSUM_WHOLE_FIELD, &range->whole_crc);
+
+        // acknowledge the whole file
+        memset(client_message, 0, sizeof(client_message));
+        strcat(client_message, "S:200 ");
+        strcat(client_message, "File received successfully");
+
+        client_sendMessageToServer(client_message);
+
+        break;
+      }
+    }
+
+    free(block);
+    free(expanded);
+  }
+  else if (strncmp(server_response, ERROR_RANGE_NOT_SATISFIABLE, CODE_SIZE) == 0)
+  {
+    range->status = 1;
+  }
+  else
+  {
+    printf("GET: File Not Found - Server Response: %s \n", server_response);
+  }
+}
+
+/// @brief Sends file contents to the server once it answered a PUT with S:100, ends them with S:200 and waits for the
+///        server to take them.
+/// @param local_file is the file, positioned at the first byte to send.
+/// @param length is the no. of bytes to send, -1 for the rest of the file.
+/// @param credits is the no. of blocks the server lets us have in flight, 0 for no limit.
+/// @param file_crc is the CRC32C of what the server already has of the upload, 0 if it has nothing.
+/// @return 0 if the server took the contents, -1 otherwise.
+int client_sendFileData(FILE *local_file, long long length, int credits, uint32_t file_crc)
+{
+  char client_message[CODE_SIZE + CODE_PADDING + CLIENT_MESSAGE_SIZE];
+  char server_response[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
+  memset(server_response, 0, sizeof(server_response));
+
+  // room for the CRC32C after each block, and for the block compressed
+  char *buffer = malloc(chunk_size + CHECKSUM_SIZE);
+  char *packed = isCompressed ? malloc(chunk_size + CHECKSUM_SIZE) : NULL;
+  if (buffer == NULL || (isCompressed && packed == NULL))
+  {
+    printf("PUT ERROR: Couldn't allocate memory for a block\n");
+    client_closeClientSocket();
+  }
+  bool isWindowed = credits > 0;
+  long long remaining = length;
+  int status = -1;
+
+  while (true)
+  {
+    if (isWindowed && credits == 0)
+    {
+      // wait for the server to acknowledge the blocks in flight
+      memset(server_response, '\0', CODE_SIZE);
+      client_recieveMessageFromServer(server_response);
+
+      if (strncmp(server_response, "S:100", CODE_SIZE) != 0)
+      {
+        printf("PUT ERROR: stopped abruptly because server is not accepting data anymore\n");
+        break;
+      }
+
+      credits += atoi(server_response + CODE_SIZE + CODE_PADDING);
+      continue;
+    }
+
+    int bytes_read = 0;
+    if (remaining != 0)
+      bytes_read = fread(buffer, sizeof(char), remaining > 0 && remaining < chunk_size ? remaining : chunk_size,
+                         local_file);
+
+    if (bytes_read > 0)
+    {
+      char *payload = buffer;
+      int frame_length = bytes_read;
+      uint16_t flags = FRAME_FLAG_NONE;
+
+      // a block that doesn't get smaller goes out as it is
+      int packed_length = isCompressed ? compress_block(buffer, bytes_read, packed, bytes_read - 1) : -1;
+      if (packed_length > 0)
+      {
+        payload = packed;
+        frame_length = packed_length;
+        flags |= FRAME_FLAG_COMPRESSED;
       }
 
-      fclose(local_file);
+      if (isChecksummed)
+      {
+        // the CRC32C is of the block as read, before compression
+        uint32_t crc = htonl(checksum_crc32c(0, buffer, bytes_read));
+        memcpy(payload + frame_length, &crc, CHECKSUM_SIZE);
+        file_crc = checksum_crc32c(file_crc, buffer, bytes_read);
+
+        frame_length += CHECKSUM_SIZE;
+        flags |= FRAME_FLAG_CHECKSUM;
+      }
+
+      client_sendDataToServer(payload, frame_length, flags);
+
+      credits--;
+      if (remaining > 0)
+        remaining -= bytes_read;
+    }
+    else if (remaining > 0)
+    {
+      printf("PUT ERROR: File got shorter while it was sent\n");
+
+      memset(client_message, 0, sizeof(client_message));
+      strcat(client_message, "E:500 File got shorter while it was sent");
+
+      client_sendMessageToServer(client_message);
+      break;
+    }
+    else
+    {
+      printf("PUT: reached end of file\n");
+
+      memset(client_message, 0, sizeof(client_message));
+
+      if (isChecksummed)
+        sprintf(client_message, "S:200 %s=%08x File sent successfully", CHECKSUM_FEATURE, file_crc);
+      else
+        strcat(client_message, "S:200 File sent successfully");
+
+      client_sendMessageToServer(client_message);
+
+      // wait for the server to commit the file, skipping acknowledgements for blocks still in flight
+      do
+      {
+        memset(server_response, '\0', sizeof(server_response));
+
+        client_recieveMessageFromServer(server_response);
+      } while (strncmp(server_response, "S:100", CODE_SIZE) == 0);
+
+      if (strncmp(server_response, "S:200", CODE_SIZE) == 0)
+      {
+        printf("PUT: Server received file successfully\n");
+        status = 0;
+      }
+      else
+      {
+        printf("PUT ERROR: Server did not recieve file successfully\n");
+      }
+      break;
+    }
+  }
+
+  free(buffer);
+  free(packed);
+
+  return status;
+}
+
+/// @brief Uploads a range of a file as a PUT of its own, or the part of it the server doesn't have yet from an
+///        earlier PUT of the range.
+/// @param range represents the range, its outcome is filled in.
+/// @param actual_path is the local file.
+/// @param upload_id names the upload the range belongs to.
+void client_sendRange(t_range *range, const char *actual_path, const char *upload_id)
+{
+  range->status = -1;
+
+  // every connection reads the file on its own
+  FILE *local_file = fopen(actual_path, "r");
+  if (local_file == NULL)
+  {
+    printf("PUT ERROR: File not found on client\n");
+    return;
+  }
+
+  char client_message[CODE_SIZE + CODE_PADDING + CLIENT_MESSAGE_SIZE];
+  memset(client_message, 0, sizeof(client_message));
+  char server_response[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
+  memset(server_response, 0, sizeof(server_response));
+
+  snprintf(client_message, sizeof(client_message), "C:003 %s %s %d %s %lld", range->local_file_path,
+           range->remote_file_path, TRANSFER_WINDOW_SIZE, upload_id, range->offset);
+
+  client_sendCommandToServer(client_message);
+
+  client_recieveMessageFromServer(server_response);
+
+  // the server tells the window it settled on, and how much from the start of the range on it already has
+  int credits;
+  long long uploaded;
+  if (strncmp(server_response, "S:100", CODE_SIZE) != 0 ||
+      sscanf(server_response + CODE_SIZE + CODE_PADDING, "%d %lld", &credits, &uploaded) != 2)
+  {
+    printf("PUT ERROR: The server did not agree to receive the range.\n");
+  }
+  else
+  {
+    if (uploaded > range->length)
+      uploaded = range->length;
+
+    if (fseeko(local_file, range->offset + uploaded, SEEK_SET) != 0)
+    {
+      printf("PUT ERROR: Range could not be read from the file\n");
+
+      memset(client_message, 0, sizeof(client_message));
+      strcat(client_message, "E:500 Range could not be read");
+
+      client_sendMessageToServer(client_message);
+    }
+    else
+    {
+      range->status = client_sendFileData(local_file, range->length - uploaded, credits, 0);
+    }
+  }
+
+  fclose(local_file);
+}
+
+/// @brief Downloads a file from the server into a partial file, or the rest of it if an earlier download stopped.
+/// @param remote_file_path is the path of the remote file on server to be retrieved.
+/// @param local_file_path is the file path where the data needs ro be stored in client.
+/// @param partial_path is the partial file the data is written to.
+/// @param offset is the no. of bytes already in the partial file, the download resumes from there.
+/// @return 0 if the whole file is in the partial file, 1 if the server can't resume from offset, -1 otherwise.
+int client_receiveFile(char *remote_file_path, char *local_file_path, const char *partial_path, long long offset)
+{
+  // Open local file for writing, a resumed download goes on at its end
+  t_range range = {remote_file_path, local_file_path, -1, offset, 0, -1, false, 0, -1};
+  range.fd = open(partial_path, O_WRONLY | O_CREAT | (offset > 0 ? 0 : O_TRUNC), 0666);
+
+  if (range.fd < 0)
+  {
+    printf("GET ERROR: Local file could not be opened. Please check whether the location exists.\n");
+    return -1;
+  }
+
+  client_receiveRange(&range);
+  close(range.fd);
+
+  // a resumed download is checked as a whole, the file may have changed on the server in between
+  uint32_t local_crc;
+  bool isStale = false;
+  if (range.status == 0 && offset > 0 && range.isWholeChecked &&
+      (client_checksumFile(partial_path, &local_crc) != 0 || local_crc != range.whole_crc))
+  {
+    printf("GET ERROR: File changed on the server since the download started, get it again\n");
+    range.status = -1;
+    isStale = true;
+  }
+
+  // a partial file that is stale or empty is of no use to the next attempt
+  struct stat partial_stat;
+  if (range.status < 0 && (isStale || (stat(partial_path, &partial_stat) == 0 && partial_stat.st_size == 0)))
+    remove(partial_path);
+
+  return range.status;
+}
+
+/// @brief Transfers the pieces of a parallel GET or PUT nobody took yet, one after the other, over the connection of
+///        the calling thread.
+/// @param transfer represents the parallel GET or PUT.
+void client_transferPieces(t_parallelTransfer *transfer)
+{
+  while (true)
+  {
+    pthread_mutex_lock(&transfer->mutex);
+    int piece = transfer->isFailed ? transfer->piece_count : transfer->next_piece++;
+    pthread_mutex_unlock(&transfer->mutex);
+
+    if (piece >= transfer->piece_count)
+      break;
+
+    t_range range = {transfer->remote_file_path, transfer->local_file_path, transfer->fd,
+                     (long long)piece * CLIENT_PARALLEL_PIECE_SIZE, CLIENT_PARALLEL_PIECE_SIZE, -1, false, 0, -1};
+    if (transfer->upload_id != NULL)
+    {
+      // the last piece of a PUT runs up to the end of the file
+      if (range.offset + range.length > transfer->file_size)
+        range.length = transfer->file_size - range.offset;
+
+      client_sendRange(&range, transfer->actual_path, transfer->upload_id);
+    }
+    else
+    {
+      client_receiveRange(&range);
+    }
+
+    pthread_mutex_lock(&transfer->mutex);
+    if (range.status == 0)
+    {
+      transfer->isPieceDone[piece] = true;
+      if (range.isWholeChecked)
+      {
+        transfer->isWholeChecked = true;
+        transfer->whole_crc = range.whole_crc;
+      }
     }
     else
     {
-      printf("GET: File Not Found - Server Response: %s \n", server_response);
+      // a connection that breaks ends its thread before this, so a PUT of a range that failed was answered
+      transfer->isFailed = true;
+      transfer->isRefused = transfer->isRefused || transfer->upload_id != NULL;
     }
+    pthread_mutex_unlock(&transfer->mutex);
+  }
+}
+
+/// @brief Body of every extra connection of a parallel GET or PUT. A connection that breaks ends only its own
+///        thread, the piece it was transferring is then missing when the transfer is put together.
+/// @param arg is the parallel GET or PUT.
+/// @return NULL.
+void *client_runRangeWorker(void *arg)
+{
+  t_parallelTransfer *transfer = arg;
+
+  isRangeWorker = true;
+  init_initClient();
+  client_openSession();
+
+  client_transferPieces(transfer);
+
+  client_closeSession();
+  close(socket_desc);
+
+  return NULL;
+}
+
+/// @brief Downloads a file in pieces, over the command's own connection and up to CLIENT_PARALLEL_CONNECTIONS - 1
+///        more, each writing its pieces in place. The first piece tells how large the file is. The pieces are written
+///        to a file of their own, as one with holes in it can't be resumed, and it only becomes the partial file once
+///        whole. If a piece can't be fetched, the pieces in front of it are kept as the partial file, to be resumed.
+/// @param remote_file_path is the path of the remote file on server to be retrieved.
+/// @param local_file_path is the file path where the data needs ro be stored in client.
+/// @param actual_path is where the file goes locally.
+/// @param partial_path is the partial file the whole file ends up in.
+/// @return 0 if the whole file is in the partial file, -1 otherwise.
+int client_receiveFileInPieces(char *remote_file_path, char *local_file_path, const char *actual_path,
+                               const char *partial_path)
+{
+  char pieces_path[CLIENT_COMMAND_SIZE];
+  snprintf(pieces_path, sizeof(pieces_path), "%s%s", actual_path, CLIENT_PIECES_SUFFIX);
+
+  t_parallelTransfer get = {remote_file_path, local_file_path, NULL, NULL, -1, 0, 0, 1, NULL, false, false, false, 0,
+                            PTHREAD_MUTEX_INITIALIZER};
+  get.fd = open(pieces_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+
+  if (get.fd < 0)
+  {
+    printf("GET ERROR: Local file could not be opened. Please check whether the location exists.\n");
+    return -1;
+  }
+
+  t_range first = {remote_file_path, local_file_path, get.fd, 0, CLIENT_PARALLEL_PIECE_SIZE, -1, false, 0, -1};
+  client_receiveRange(&first);
+
+  if (first.status != 0 || first.file_size < 0)
+  {
+    close(get.fd);
+    remove(pieces_path);
+    return -1;
+  }
+
+  get.file_size = first.file_size;
+  get.piece_count = get.file_size > 0 ? (get.file_size + CLIENT_PARALLEL_PIECE_SIZE - 1) / CLIENT_PARALLEL_PIECE_SIZE : 1;
+  get.isPieceDone = calloc(get.piece_count, sizeof(bool));
+  get.isWholeChecked = first.isWholeChecked;
+  get.whole_crc = first.whole_crc;
+
+  if (get.isPieceDone == NULL)
+  {
+    printf("GET ERROR: Couldn't allocate memory for the pieces\n");
+    close(get.fd);
+    remove(pieces_path);
+    return -1;
+  }
+  get.isPieceDone[0] = true;
+
+  // the other connections join in only if there is more than one piece left to share
+  pthread_t workers[CLIENT_PARALLEL_CONNECTIONS];
+  int worker_count = 0;
+  for (int i = 1; i < CLIENT_PARALLEL_CONNECTIONS && i < get.piece_count - 1; i++)
+  {
+    if (pthread_create(&workers[worker_count], NULL, client_runRangeWorker, &get) == 0)
+      worker_count++;
+  }
+
+  if (get.piece_count > 1)
+    printf("GET: fetching %lld bytes in %d pieces over %d connections\n", get.file_size, get.piece_count,
+           worker_count + 1);
+
+  client_transferPieces(&get);
+
+  for (int i = 0; i < worker_count; i++)
+    pthread_join(workers[i], NULL);
+
+  // the pieces in front of the first missing one are a partial file like any other
+  int pieces_done = 0;
+  while (pieces_done < get.piece_count && get.isPieceDone[pieces_done])
+    pieces_done++;
+
+  long long kept = (long long)pieces_done * CLIENT_PARALLEL_PIECE_SIZE;
+  if (kept > get.file_size)
+    kept = get.file_size;
+
+  int status = pieces_done == get.piece_count ? 0 : -1;
+  if (status != 0)
+  {
+    printf("GET ERROR: Only the first %lld bytes could be fetched, get the file again to resume\n", kept);
+    if (ftruncate(get.fd, kept) != 0)
+      kept = 0;
+  }
+
+  close(get.fd);
+  free(get.isPieceDone);
+
+  // the pieces came over different connections, the file is checked as a whole
+  uint32_t local_crc;
+  if (status == 0 && get.isWholeChecked &&
+      (client_checksumFile(pieces_path, &local_crc) != 0 || local_crc != get.whole_crc))
+  {
+    printf("GET ERROR: File changed on the server while it was fetched, get it again\n");
+    status = -1;
+    kept = 0;
+  }
+
+  if ((status == 0 || kept > 0) && rename(pieces_path, partial_path) == 0)
+    return status;
+
+  remove(pieces_path);
+  return -1;
+}
+
+/// @brief To get a file data from server to the local client space. The file is downloaded next to where it goes
+///        and only moved into place once complete, so a download that was cut off resumes where it stopped. A new
+///        download is fetched in pieces over several connections.
+/// @param remote_file_path is the path of the remote file on server to be retrieved.
+/// @param local_file_path is the file path where the data needs ro be stored in client.
+void command_get(char *remote_file_path, char *local_file_path)
+{
+  printf("COMMAND: GET started\n");
+
+  char actual_path[200];
+  strcpy(actual_path, ROOT_DIRECTORY);
+  strncat(actual_path, local_file_path, strlen(local_file_path));
+  printf("GET: actual path: %s \n", actual_path);
+
+  char partial_path[sizeof(actual_path) + sizeof(CLIENT_PARTIAL_SUFFIX)];
+  sprintf(partial_path, "%s%s", actual_path, CLIENT_PARTIAL_SUFFIX);
+
+  // pick up an earlier download that was cut off
+  struct stat partial_stat;
+  long long offset = 0;
+  if (stat(partial_path, &partial_stat) == 0 && S_ISREG(partial_stat.st_mode))
+  {
+    offset = partial_stat.st_size;
+    if (offset > 0)
+      printf("GET: resuming an earlier download from byte %lld\n", offset);
+  }
+
+  int status;
+  if (offset == 0 && CLIENT_PARALLEL_CONNECTIONS > 1)
+    status = client_receiveFileInPieces(remote_file_path, local_file_path, actual_path, partial_path);
+  else
+    status = client_receiveFile(remote_file_path, local_file_path, partial_path, offset);
+
+  if (status == 1)
+  {
+    // the file on the server is shorter than what we already have, so it isn't the same file anymore
+    printf("GET: the earlier download doesn't match the file on the server, starting over\n");
+    remove(partial_path);
+
+    status = client_receiveFile(remote_file_path, local_file_path, partial_path, 0);
+  }
+
+  if (status == 0 && rename(partial_path, actual_path) != 0)
+  {
+    printf("GET ERROR: Downloaded file could not be moved to %s\n", actual_path);
+  }
+
+  printf("COMMAND: GET complete\n\n");
+}
+
+/// @brief Gets a range of a file from the server into its place in a local file, so ranges fetched one after the
+///        other build up the file. Nothing else of the local file is touched.
+/// @param remote_file_path is the path of the remote file on server to be retrieved.
+/// @param local_file_path is the file path where the data needs ro be stored in client.
+/// @param offset is where the range starts in the file.
+/// @param length is the no. of bytes in the range, 0 for the rest of the file.
+void command_getRange(char *remote_file_path, char *local_file_path, long long offset, long long length)
+{
+  printf("COMMAND: GET started\n");
+
+  char actual_path[200];
+  strcpy(actual_path, ROOT_DIRECTORY);
+  strncat(actual_path, local_file_path, strlen(local_file_path));
+  printf("GET: actual path: %s \n", actual_path);
+
+  t_range range = {remote_file_path, local_file_path, -1, offset, length, -1, false, 0, -1};
+  range.fd = open(actual_path, O_WRONLY | O_CREAT, 0666);
+
+  if (range.fd < 0)
+  {
+    printf("GET ERROR: Local file could not be opened. Please check whether the location exists.\n");
+    printf("COMMAND: GET complete\n\n");
+    return;
+  }
+
+  client_receiveRange(&range);
+  close(range.fd);
+
+  if (range.status == 1)
+  {
+    printf("GET ERROR: %s The range starts past the end of the file on the server\n", ERROR_RANGE_NOT_SATISFIABLE);
+  }
+  else if (range.status == 0 && range.file_size >= 0)
+  {
+    printf("GET: bytes %lld to %lld of %lld written\n", offset,
+           length > 0 && offset + length < range.file_size ? offset + length : range.file_size, range.file_size);
   }
 
   printf("COMMAND: GET complete\n\n");
@@ -250,11 +973,8 @@ void command_info(char *remote_file_path)
   strncat(client_message, code, CODE_SIZE + CODE_PADDING);
   strncat(client_message, remote_file_path, strlen(remote_file_path));
 
-  // Connect to server socket:
-  client_connect();
-
   // send command to server
-  client_sendMessageToServer(client_message);
+  client_sendCommandToServer(client_message);
 
   // get response from server
   client_recieveMessageFromServer(server_message);
@@ -264,113 +984,248 @@ void command_info(char *remote_file_path)
   printf("COMMAND: INFO complete\n\n");
 }
 
-/// @brief To create and store a replica of a local client file to server space.
+/// @brief Names the upload of a file, so that a PUT of the same file to the same place resumes one that got cut off.
+/// @param local_file_path is the path of the local file.
+/// @param remote_file_path is the path in server where the file goes.
+/// @param local_stat is the state of the local file, a file that changed is a different upload.
+/// @param upload_id is filled with the name, UPLOAD_ID_SIZE hex digits.
+void client_nameUpload(const char *local_file_path, const char *remote_file_path, const struct stat *local_stat,
+                       char *upload_id)
+{
+  char key[2 * CLIENT_COMMAND_SIZE];
+  int length = snprintf(key, sizeof(key), "%s %s %lld %lld", local_file_path, remote_file_path,
+                        (long long)local_stat->st_size, (long long)local_stat->st_mtime);
+  if (length >= (int)sizeof(key))
+    length = sizeof(key) - 1;
+
+  uint32_t high = checksum_crc32c(0, key, length);
+  uint32_t low = checksum_crc32c(high, key, length);
+  sprintf(upload_id, "%08x%08x", high, low);
+}
+
+/// @brief Moves past the part of a file the server already has from an earlier PUT of it, adding it to the CRC32C of
+///        the file.
+/// @param local_file is the file being uploaded.
+/// @param offset is the no. of bytes the server has.
+/// @param file_crc is the CRC32C of the file so far.
+/// @return 0 if the file holds that many bytes, -1 otherwise.
+int client_skipUploaded(FILE *local_file, long long offset, uint32_t *file_crc)
+{
+  char buffer[64 * 1024];
+
+  while (offset > 0)
+  {
+    size_t bytes_read = fread(buffer, sizeof(char), offset < (long long)sizeof(buffer) ? offset : sizeof(buffer),
+                              local_file);
+    if (bytes_read == 0)
+      return -1;
+
+    *file_crc = checksum_crc32c(*file_crc, buffer, bytes_read);
+    offset -= bytes_read;
+  }
+
+  return 0;
+}
+
+/// @brief Uploads a file over the command's own connection, from where an earlier PUT of the upload left off if it
+///        got cut off.
+/// @param local_file is the file, opened at its start.
 /// @param local_file_path is the path of the local file.
 /// @param remote_file_path is the path in server where the replica needs to be saved.
-void command_put(char *local_file_path, char *remote_file_path)
+/// @param upload_id names the upload, "" if the file isn't large enough to be resumed.
+void client_sendFile(FILE *local_file, char *local_file_path, char *remote_file_path, const char *upload_id)
 {
-  printf("COMMAND: PUT started\n");
+  char client_message[CODE_SIZE + CODE_PADDING + CLIENT_MESSAGE_SIZE];
+  memset(client_message, 0, sizeof(client_message));
+  char server_response[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
+  memset(server_response, 0, sizeof(server_response));
 
-  char actual_path[200];
-  strcpy(actual_path, ROOT_DIRECTORY);
-  strncat(actual_path, local_file_path, strlen(local_file_path));
+  // sending message to server
+  char code[CODE_SIZE + CODE_PADDING] = "C:003 ";
+  strncat(client_message, code, CODE_SIZE + CODE_PADDING);
 
-  FILE *local_file;
+  strncat(client_message, local_file_path, strlen(local_file_path));
+  strncat(client_message, " ", 1);
+  strncat(client_message, remote_file_path, strlen(remote_file_path));
 
-  local_file = fopen(actual_path, "r");
-  printf("PUT: Looking for file: %s\n", actual_path);
+  // propose how many blocks we would like to have in flight
+  sprintf(client_message + strlen(client_message), " %d", TRANSFER_WINDOW_SIZE);
 
-  if (local_file == NULL)
+  // and name the upload of a large file, so it can be resumed
+  if (upload_id[0] != '\0')
+    sprintf(client_message + strlen(client_message), " %s", upload_id);
+
+  client_sendCommandToServer(client_message);
+
+  // Receive server response
+  client_recieveMessageFromServer(server_response);
+
+  if (strncmp(server_response, "S:100", CODE_SIZE) != 0)
   {
-    // file doesn't exist on client
-    printf("PUT ERROR: File not found on client\n");
+    printf("PUT ERROR: The server did not agree to receive the file contents.\n");
+    return;
   }
-  else
+
+  // Server is ready to recieve file contents, and told us the window it settled on. Start sending file
+  printf("PUT: Server hinted at accepting file contents.\n");
+  int credits = atoi(server_response + CODE_SIZE + CODE_PADDING);
+
+  // the server may already have the start of the upload, the CRC32C of the file still covers all of it
+  long long resume_offset = 0;
+  uint32_t file_crc = 0;
+  if (upload_id[0] != '\0' &&
+      sscanf(server_response + CODE_SIZE + CODE_PADDING, "%*d %lld", &resume_offset) == 1 && resume_offset > 0)
   {
-    printf("PUT: File Found on client\n");
+    if (client_skipUploaded(local_file, resume_offset, &file_crc) != 0)
+    {
+      printf("PUT ERROR: The server has more of the upload than the file holds, giving up on it\n");
 
-    // Connect to server socket:
-    client_connect();
+      memset(client_message, 0, sizeof(client_message));
+      strcat(client_message, "E:500 Upload doesn't match the file");
 
-    char client_message[CODE_SIZE + CODE_PADDING + CLIENT_MESSAGE_SIZE];
-    memset(client_message, 0, sizeof(client_message));
-    char server_response[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
-    memset(server_response, 0, sizeof(server_response));
+      client_sendMessageToServer(client_message);
+      return;
+    }
 
-    // sending message to server
-    char code[CODE_SIZE + CODE_PADDING] = "C:003 ";
-    strncat(client_message, code, CODE_SIZE + CODE_PADDING);
+    printf("PUT: resuming an earlier upload from byte %lld\n", resume_offset);
+  }
 
-    strncat(client_message, local_file_path, strlen(local_file_path));
-    strncat(client_message, " ", 1);
-    strncat(client_message, remote_file_path, strlen(remote_file_path));
+  client_sendFileData(local_file, -1, credits, file_crc);
+}
 
-    client_sendMessageToServer(client_message);
+/// @brief Uploads a file in pieces, over the command's own connection and up to CLIENT_PARALLEL_CONNECTIONS - 1 more,
+///        each piece a range of the upload. Once every piece is on the server, the upload is committed as a whole.
+///        If a piece can't be sent, the server keeps the others, and a PUT of the same file resumes the upload.
+/// @param local_file_path is the path of the local file.
+/// @param remote_file_path is the path in server where the replica needs to be saved.
+/// @param actual_path is where the file is locally.
+/// @param upload_id names the upload.
+/// @param file_size is the size of the file.
+/// @return 0 if the server has the file, 1 if it turned the pieces or the upload down, -1 otherwise.
+int client_sendFileInPieces(char *local_file_path, char *remote_file_path, const char *actual_path,
+                             const char *upload_id, long long file_size)
+{
+  t_parallelTransfer put = {remote_file_path, local_file_path, actual_path, upload_id, -1, file_size, 0, 0, NULL, false,
+                            false, false, 0, PTHREAD_MUTEX_INITIALIZER};
+  put.piece_count = (file_size + CLIENT_PARALLEL_PIECE_SIZE - 1) / CLIENT_PARALLEL_PIECE_SIZE;
+  put.isPieceDone = calloc(put.piece_count, sizeof(bool));
 
-    // Receive server response
-    client_recieveMessageFromServer(server_response);
+  if (put.isPieceDone == NULL)
+  {
+    printf("PUT ERROR: Couldn't allocate memory for the pieces\n");
+    return -1;
+  }
 
-    if (strncmp(server_response, "S:100", CODE_SIZE) == 0)
-    {
-      // Server is ready to recieve file contents. Start sending file
-      printf("PUT: Server hinted at accepting file contents.\n");
-      char buffer[CODE_SIZE + CODE_PADDING + CLIENT_MESSAGE_SIZE - 1];
-      int bytes_read;
+  pthread_t workers[CLIENT_PARALLEL_CONNECTIONS];
+  int worker_count = 0;
+  for (int i = 1; i < CLIENT_PARALLEL_CONNECTIONS && i < put.piece_count; i++)
+  {
+    if (pthread_create(&workers[worker_count], NULL, client_runRangeWorker, &put) == 0)
+      worker_count++;
+  }
 
-      while (true)
-      {
-        if (strncmp(server_response, "S:100", CODE_SIZE) != 0)
-        {
-          printf("GET ERROR: stopped abruptly because server is not accepting data anymore\n");
-          break;
-        }
+  printf("PUT: sending %lld bytes in %d pieces over %d connections\n", file_size, put.piece_count, worker_count + 1);
 
-        if ((bytes_read = fread(buffer, sizeof(char), CLIENT_MESSAGE_SIZE - 1, local_file)) > 0)
-        {
-          printf("BUFFER: %s \n", buffer);
+  client_transferPieces(&put);
 
-          memset(client_message, 0, sizeof(client_message));
+  for (int i = 0; i < worker_count; i++)
+    pthread_join(workers[i], NULL);
 
-          strcat(client_message, "S:206 ");
-          strncat(client_message, buffer, bytes_read);
+  bool isComplete = true;
+  for (int i = 0; i < put.piece_count; i++)
+    isComplete = isComplete && put.isPieceDone[i];
 
-          client_sendMessageToServer(client_message);
+  free(put.isPieceDone);
 
-          memset(server_response, '\0', sizeof(server_response));
-          client_recieveMessageFromServer(server_response);
-        }
-        else
-        {
-          printf("PUT: reached end of file\n");
+  if (!isComplete && put.isRefused)
+  {
+    printf("PUT ERROR: The server turned a piece down\n");
+    return 1;
+  }
+  if (!isComplete)
+  {
+    printf("PUT ERROR: Not every piece could be sent, put the file again to resume\n");
+    return -1;
+  }
 
-          memset(client_message, 0, sizeof(client_message));
+  // the pieces went over different connections, the server checks the file as a whole before it commits it
+  char client_message[CODE_SIZE + CODE_PADDING + CLIENT_MESSAGE_SIZE];
+  memset(client_message, 0, sizeof(client_message));
+  char server_response[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
+  memset(server_response, 0, sizeof(server_response));
 
-          strcat(client_message, "S:200 ");
-          strcat(client_message, "File sent successfully");
+  snprintf(client_message, sizeof(client_message), "C:008 %s %s %lld", remote_file_path, upload_id, file_size);
 
-          client_sendMessageToServer(client_message);
+  uint32_t file_crc;
+  if (isChecksummed && client_checksumFile(actual_path, &file_crc) == 0)
+    sprintf(client_message + strlen(client_message), " %s=%08x", CHECKSUM_FEATURE, file_crc);
 
-          memset(server_response, '\0', sizeof(server_response));
+  client_sendCommandToServer(client_message);
 
-          client_recieveMessageFromServer(server_response);
+  client_recieveMessageFromServer(server_response);
 
-          if (strncmp(server_response, "S:200", CODE_SIZE) == 0)
-          {
-            printf("PUT: Server received file successfully\n");
-          }
-          else
-          {
-            printf("PUT ERROR: Server did not recieve file successfully\n");
-          }
-          break;
-        }
-      }
+  if (strncmp(server_response, "S:200", CODE_SIZE) == 0)
+  {
+    printf("PUT: Server received file successfully\n");
+    return 0;
+  }
+
+  printf("PUT ERROR: Server did not put the pieces together\n");
+  return 1;
+}
+
+/// @brief To create and store a replica of a local client file to server space. Large files are uploaded under a
+///        name, so a PUT of them that gets cut off is resumed by the next one, and in pieces over several
+///        connections.
+/// @param local_file_path is the path of the local file.
+/// @param remote_file_path is the path in server where the replica needs to be saved.
+void command_put(char *local_file_path, char *remote_file_path)
+{
+  printf("COMMAND: PUT started\n");
+
+  char actual_path[200];
+  strcpy(actual_path, ROOT_DIRECTORY);
+  strncat(actual_path, local_file_path, strlen(local_file_path));
+
+  FILE *local_file;
+
+  local_file = fopen(actual_path, "r");
+  printf("PUT: Looking for file: %s\n", actual_path);
+
+  if (local_file == NULL)
+  {
+    // file doesn't exist on client
+    printf("PUT ERROR: File not found on client\n");
+  }
+  else
+  {
+    printf("PUT: File Found on client\n");
+
+    // name the upload of a large file, so it can be resumed
+    char upload_id[UPLOAD_ID_SIZE + 1] = "";
+    struct stat local_stat;
+    if (fstat(fileno(local_file), &local_stat) == 0 && local_stat.st_size >= CLIENT_RESUMABLE_PUT_SIZE)
+    {
+      client_nameUpload(local_file_path, remote_file_path, &local_stat, upload_id);
     }
-    else
+
+    int status = 1;
+    if (upload_id[0] != '\0' && CLIENT_PARALLEL_CONNECTIONS > 1 && local_stat.st_size > CLIENT_PARALLEL_PIECE_SIZE)
     {
+      status = client_sendFileInPieces(local_file_path, remote_file_path, actual_path, upload_id, local_stat.st_size);
 
-      printf("PUT ERROR: The server did not agree to receive the file contents.\n");
+      // eg. a server that can't record which ranges it has, sending the pieces again would fail the same way
+      if (status == 1)
+      {
+        printf("PUT: sending the file in one piece instead\n");
+        upload_id[0] = '\0';
+      }
     }
+
+    if (status == 1)
+      client_sendFile(local_file, local_file_path, remote_file_path, upload_id);
+
+    fclose(local_file);
   }
 
   printf("COMMAND: PUT complete\n\n");
@@ -394,11 +1249,8 @@ void command_makeDirectory(char *folder_path)
   strncat(client_message, code, CODE_SIZE + CODE_PADDING);
   strncat(client_message, folder_path, strlen(folder_path));
 
-  // Connect to server socket:
-  client_connect();
-
   // send command to server
-  client_sendMessageToServer(client_message);
+  client_sendCommandToServer(client_message);
 
   // get response from server
   client_recieveMessageFromServer(server_message);
@@ -426,11 +1278,8 @@ void command_remove(char *path)
   strncat(client_message, code, CODE_SIZE + CODE_PADDING);
   strncat(client_message, path, strlen(path));
 
-  // Connect to server socket:
-  client_connect();
-
   // send command to server
-  client_sendMessageToServer(client_message);
+  client_sendCommandToServer(client_message);
 
   // get response from server
   client_recieveMessageFromServer(server_message);
@@ -459,6 +1308,10 @@ void client_parseCommand(int argsCount, char **argv)
     {
       command_get(argv[2], argv[3]);
     }
+    else if ((argsCount == 5 || argsCount == 6) && atoll(argv[4]) >= 0 && (argsCount == 5 || atoll(argv[5]) >= 0))
+    {
+      command_getRange(argv[2], argv[3], atoll(argv[4]), argsCount == 6 ? atoll(argv[5]) : 0);
+    }
     else
     {
       printf("ERROR: Invalid number of arguements provided\n");
@@ -526,18 +1379,66 @@ void client_parseCommand(int argsCount, char **argv)
   }
 }
 
-/// @brief Gateway for client to make a request to server by passing some arguments. 
+/// @brief Runs commands read from standard input, one per line (eg. "GET h5.txt f1/h2.txt"), all over the
+///         connection that is already open. Stops at the end of input.
+void client_runSession()
+{
+  char line[CLIENT_COMMAND_SIZE];
+
+  while (fgets(line, sizeof(line), stdin) != NULL)
+  {
+    // split the line into arguments, the same way the shell would for a single command
+    char *argv[6];
+    int argsCount = 1;
+    argv[0] = "fget";
+
+    char *pch = strtok(line, " \t\r\n");
+    while (pch != NULL && argsCount < 6)
+    {
+      argv[argsCount++] = pch;
+      pch = strtok(NULL, " \t\r\n");
+    }
+
+    if (argsCount < 2)
+    {
+      continue;
+    }
+    if (pch != NULL)
+    {
+      printf("ERROR: Invalid number of arguements provided\n");
+      continue;
+    }
+
+    client_parseCommand(argsCount, argv);
+  }
+}
+
+/// @brief Gateway for client to make a request to server by passing some arguments.
+///        "fget SESSION" instead runs every command from standard input over a single connection.
 /// @param argc represents no of arguments passes.
 /// @param argv represents the arguments passes.
 /// @return 0 when the client terminates.
 int main(int argc, char **argv)
 {
-  if (argc > 4)
+  if (argc < 2 || argc > 6)
   {
     printf("Incorrect number of arguements supplied\n");
     return 0;
   }
 
+  if (strcmp(argv[1], "SESSION") == 0)
+  {
+    init_initClient();
+    client_openSession();
+
+    client_runSession();
+
+    client_closeSession();
+    client_closeClientSocket();
+
+    return 0;
+  }
+
   if (strcmp(argv[1], "GET") != 0 &&
       strcmp(argv[1], "INFO") != 0 &&
       strcmp(argv[1], "PUT") != 0 &&
@@ -548,14 +1449,16 @@ int main(int argc, char **argv)
     return 0;
   }
 
-  // Initialize client socket:
+  // Initialize client socket and connect to the server:
   init_initClient();
+  client_openSession();
 
   // Get text message to send to server:
   client_parseCommand(argc, argv);
 
   // Closing client socket:
+  client_closeSession();
   client_closeClientSocket();
 
   return 0;
-}
\ No newline at end of file
+}
@@ -14,13 +14,14 @@
 #include <time.h>
 #include <pthread.h>
 #include "../common/common.h"
+#include "../server/configserver.h"
 
 #define __USE_XOPEN_EXTENDED
 
-void printCommandOutput(char command[200])
+void printCommandOutput(char command[1000])
 {
 
-    char result[10000];
+    char result[10000] = "";
     FILE *fp;
 
     /* run command and capture output */
@@ -59,9 +60,91 @@ void displayLine()
     printf("-----------------------------\n\n");
 }
 
+/* sends one frame to the server, the header in network byte order like the client does */
+int sendFrame(int sock, uint16_t opcode, uint16_t flags, const char *payload, uint32_t length)
+{
+    uint16_t header[4];
+    header[0] = htons(opcode);
+    header[1] = htons(flags);
+    uint32_t net_length = htonl(length);
+    memcpy(&header[2], &net_length, sizeof(net_length));
+
+    if (send(sock, header, 8, 0) != 8 || (length > 0 && send(sock, payload, length, 0) != (ssize_t)length))
+        return -1;
+    return 0;
+}
+
+/* receives the payload of one frame from the server as a string */
+int recvFrame(int sock, char *payload, uint32_t capacity)
+{
+    uint16_t header[4];
+    if (recv(sock, header, 8, MSG_WAITALL) != 8)
+        return -1;
+
+    uint32_t length;
+    memcpy(&length, &header[2], sizeof(length));
+    length = ntohl(length);
+    if (length >= capacity || (length > 0 && recv(sock, payload, length, MSG_WAITALL) != (ssize_t)length))
+        return -1;
+
+    payload[length] = '\0';
+    return 0;
+}
+
+/* PUTs a file whose only data frame claims to be compressed, on a connection that agreed on `features`, and
+   prints how the server answered */
+void sendCompressedFrame(const char *features, const char *block, uint32_t length)
+{
+    char message[SERVER_MESSAGE_SIZE];
+    struct sockaddr_in server_addr;
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(SERVER_PORT);
+    server_addr.sin_addr.s_addr = inet_addr(SERVER_IP);
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+    {
+        printf("Output: Couldn't connect to the server\n\n");
+        if (sock >= 0)
+            close(sock);
+        return;
+    }
+
+    sprintf(message, "C:006 %d %s", SERVER_MESSAGE_SIZE, features);
+    sendFrame(sock, FRAME_OP_COMMAND, FRAME_FLAG_NONE, message, strlen(message));
+    recvFrame(sock, message, sizeof(message));
+
+    sprintf(message, "C:003 bad.dat malformed.dat %d", TRANSFER_WINDOW_SIZE);
+    sendFrame(sock, FRAME_OP_COMMAND, FRAME_FLAG_NONE, message, strlen(message));
+    recvFrame(sock, message, sizeof(message));
+
+    sendFrame(sock, FRAME_OP_DATA, FRAME_FLAG_COMPRESSED, block, length);
+    sprintf(message, "S:200 File sent successfully");
+    sendFrame(sock, FRAME_OP_STATUS, FRAME_FLAG_NONE, message, strlen(message));
+
+    // skip the acknowledgements of the window
+    int status;
+    do
+    {
+        status = recvFrame(sock, message, sizeof(message));
+    } while (status == 0 && strncmp(message, "S:100", CODE_SIZE) == 0);
+
+    printf("Output: %s\n\n", status == 0 ? message : "connection closed by the server");
+    close(sock);
+}
+
+/* the path of a file in a replica root of the server, roots in configserver.h are relative to the server folder */
+void replicaPath(char path[200], const char *root, const char *file)
+{
+    if (root[0] == '/')
+        sprintf(path, "%s%s", root, file);
+    else
+        sprintf(path, "../server/%s%s", root, file);
+}
+
 int main()
 {
-    char command[200];
+    char command[1000];
     printf("----------Starting Testing-----------\n\n");
 
     // GET : basic file
@@ -205,7 +288,128 @@ int main()
         // printCommandOutput(command);
     }
 
-    printf("Distributed reads with multiprocessing tests done.");
+    printf("Distributed reads with multiprocessing tests done.\n");
+    displayLine();
+
+    // Several commands over one connection
+    printf("Test 10: Running multiple commands over a single connection:\n");
+    printf("Note the client connecting to the server only once.\n");
+    displayLine();
+
+    sprintf(command, "printf \"GET h5.txt f1/h2.txt\\nINFO h3.txt\\nMD sessionFolder\\nRM sessionFolder\\n\" | ./fget SESSION");
+    printCommandOutput(command);
+
+    printf("Operation SESSION Successful!!\n");
+    displayLine();
+
+    // GET: two ranges of a file, one after the other, put the whole file together
+    printf("Test 11: Testing GET operation of a range of a file:\n");
+    printf("Note the server answering with the size of the whole file.\n");
+    displayLine();
+
+    sprintf(command, "rm -f root/range.txt; ./fget GET lorem/lorem2000.txt range.txt 0 1200 > /dev/null; "
+                     "./fget GET lorem/lorem2000.txt range.txt 1200 | grep -e S:206 -e written; "
+                     "cmp -s root/range.txt ../server/root/lorem/lorem2000.txt && echo \"Ranges match the file\" || "
+                     "echo \"Ranges don't match the file\"");
+    printCommandOutput(command);
+
+    printf("Operation GET of a range Successful!!\n");
+    displayLine();
+
+    // GET: resume a download that was cut off, from what is left in its partial file
+    printf("Test 12: Testing GET operation resuming a download that was cut off:\n");
+    printf("Note the client resuming from byte 3000.\n");
+    displayLine();
+
+    sprintf(command, "./fget GET lorem/loremContent.txt resumed.txt > /dev/null; "
+                     "head -c 3000 root/resumed.txt > root/resumed.txt%s; rm root/resumed.txt; "
+                     "./fget GET lorem/loremContent.txt resumed.txt | grep resuming; "
+                     "cmp -s root/resumed.txt ../server/root/lorem/loremContent.txt && "
+                     "echo \"Resumed file matches\" || echo \"Resumed file doesn't match\"",
+            CLIENT_PARTIAL_SUFFIX);
+    printCommandOutput(command);
+
+    printf("Operation resumed GET Successful!!\n");
+    displayLine();
+
+    // PUT: a file larger than a piece, sent in pieces over several connections, has to end up whole on every replica
+    printf("Test 13: Testing PUT operation of a file sent in pieces:\n");
+    printf("Note the client sending the pieces over several connections.\n");
+    displayLine();
+
+    char replica_paths[2][200];
+    replicaPath(replica_paths[0], ROOT_DIRECTORY_1, "pieces.dat");
+    replicaPath(replica_paths[1], ROOT_DIRECTORY_2, "pieces.dat");
+
+    sprintf(command, "head -c %lld /dev/urandom > root/pieces.dat; "
+                     "./fget PUT pieces.dat pieces.dat | grep \"PUT: sending\"; "
+                     "cmp -s root/pieces.dat %s && cmp -s root/pieces.dat %s && echo \"Both replicas match\" || "
+                     "echo \"Replicas don't match\"",
+            (long long)CLIENT_PARALLEL_PIECE_SIZE * 2 + 12345, replica_paths[0], replica_paths[1]);
+    printCommandOutput(command);
+
+    sprintf(command, "./fget RM pieces.dat > /dev/null; rm -f root/pieces.dat");
+    system(command);
+
+    printf("Operation PUT in pieces Successful!!\n");
+    displayLine();
+
+    // GET: a range past the end of the file is refused
+    printf("Test 14: Testing GET operation of a range past the end of the file:\n");
+    printf("Note the server refusing it with %s.\n", ERROR_RANGE_NOT_SATISFIABLE);
+    displayLine();
+
+    sprintf(command, "./fget GET lorem/lorem2000.txt past.txt 5000 100 | grep ERROR");
+    printCommandOutput(command);
+
+    printf("Operation GET out of range Successful!!\n");
+    displayLine();
+
+    // PUT/GET: a file that compresses well and one that doesn't, both have to come back as they were sent
+    printf("Test 15: Testing PUT and GET operations with compressed data frames:\n");
+    if (!CLIENT_COMPRESSION)
+        printf("Note CLIENT_COMPRESSION is off in common.h, the files go uncompressed.\n");
+    displayLine();
+
+    sprintf(command, "yes \"All work and no play makes Jack a dull boy.\" | head -c 3000000 > root/text.dat; "
+                     "head -c 3000000 /dev/urandom > root/noise.dat; "
+                     "./fget PUT text.dat text.dat | grep SESSION; ./fget PUT noise.dat noise.dat > /dev/null; "
+                     "./fget GET text.dat text2.dat > /dev/null; ./fget GET noise.dat noise2.dat > /dev/null; "
+                     "cmp -s root/text.dat root/text2.dat && cmp -s root/noise.dat root/noise2.dat && "
+                     "cmp -s root/text.dat ../server/root/text.dat && "
+                     "cmp -s root/noise.dat ../server/root/noise.dat && "
+                     "echo \"Both files made the round trip\" || echo \"Round trip failed\"");
+    printCommandOutput(command);
+
+    sprintf(command, "./fget RM text.dat > /dev/null; ./fget RM noise.dat > /dev/null; "
+                     "rm -f root/text.dat root/text2.dat root/noise.dat root/noise2.dat");
+    system(command);
+
+    printf("Operation compressed PUT and GET Successful!!\n");
+    displayLine();
+
+    // PUT: compressed blocks the server can't expand are refused, and the server keeps running
+    printf("Test 16: Testing PUT operation with malformed compressed data frames:\n");
+    printf("Note the server refusing the blocks it can't expand with E:500, and closing the connection that sent a\n");
+    printf("block compressed without agreeing to it.\n");
+    displayLine();
+
+    // one literal, then a match 16 bytes back when only 1 byte was produced
+    char malformed[] = {0x10, 'A', 0x10, 0x00};
+    sendCompressedFrame(COMPRESSION_FEATURE, malformed, sizeof(malformed));
+
+    // a literal run longer than the block
+    char truncated[] = {(char)0xF0, (char)0xFF, 'A', 'B'};
+    sendCompressedFrame(COMPRESSION_FEATURE, truncated, sizeof(truncated));
+
+    // compressed although the connection didn't agree to it
+    sendCompressedFrame(CHECKSUM_FEATURE, malformed, sizeof(malformed));
+
+    sprintf(command, "./fget INFO h3.txt | grep \"File size\" || echo \"Server is down\"");
+    printCommandOutput(command);
+
+    printf("Operation malformed compressed PUT Successful!!\n");
+    displayLine();
 
     return 0;
 }
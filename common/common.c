@@ -0,0 +1,508 @@
+/*
+ * common.c -- Wire framing, checksums and compression shared by the server and the client
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <arpa/inet.h>
+#include "common.h"
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#ifndef MSG_MORE
+#define MSG_MORE 0
+#endif
+
+#pragma region Framing
+
+/// @brief Reads exactly `length` bytes from the socket.
+/// @return 0 if all bytes were read, -1 on error or if the peer closed the connection.
+static int frame_recvExact(int sock, void *buffer, size_t length)
+{
+  char *cursor = buffer;
+
+  while (length > 0)
+  {
+    ssize_t received = recv(sock, cursor, length, 0);
+    if (received < 0 && errno == EINTR)
+      continue;
+    if (received <= 0)
+      return -1;
+
+    cursor += received;
+    length -= received;
+  }
+
+  return 0;
+}
+
+/// @brief Sends a frame, header and payload together, in as few syscalls as the socket allows.
+/// @param sock is the socket the frame is sent on.
+/// @param opcode represents the kind of frame, one of FRAME_OP_*.
+/// @param flags represents FRAME_FLAG_* bits for the frame.
+/// @param payload is the payload of the frame, may be NULL if length is 0.
+/// @param length is the no. of payload bytes.
+/// @return 0 if the whole frame was sent, -1 otherwise.
+int frame_send(int sock, uint16_t opcode, uint16_t flags, const void *payload, uint32_t length)
+{
+  t_frameHeader header;
+  header.opcode = htons(opcode);
+  header.flags = htons(flags);
+  header.length = htonl(length);
+
+  struct iovec iov[2];
+  iov[0].iov_base = &header;
+  iov[0].iov_len = FRAME_HEADER_SIZE;
+  iov[1].iov_base = (void *)payload;
+  iov[1].iov_len = length;
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = length > 0 ? 2 : 1;
+
+  while (msg.msg_iovlen > 0)
+  {
+    ssize_t sent = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR)
+      continue;
+    if (sent < 0)
+      return -1;
+
+    // skip over whatever the kernel accepted and retry with the rest
+    while (msg.msg_iovlen > 0 && (size_t)sent >= msg.msg_iov[0].iov_len)
+    {
+      sent -= msg.msg_iov[0].iov_len;
+      msg.msg_iov++;
+      msg.msg_iovlen--;
+    }
+    if (msg.msg_iovlen > 0)
+    {
+      msg.msg_iov[0].iov_base = (char *)msg.msg_iov[0].iov_base + sent;
+      msg.msg_iov[0].iov_len -= sent;
+    }
+  }
+
+  return 0;
+}
+
+/// @brief Sends only the header of a frame, for senders that push the payload themselves (eg. with sendfile).
+///        The socket is told more data follows, so the header and payload can still leave in one segment.
+/// @param sock is the socket the header is sent on.
+/// @param opcode represents the kind of frame, one of FRAME_OP_*.
+/// @param flags represents FRAME_FLAG_* bits for the frame.
+/// @param length is the no. of payload bytes the caller will send right after.
+/// @return 0 if the header was sent, -1 otherwise.
+int frame_sendHeader(int sock, uint16_t opcode, uint16_t flags, uint32_t length)
+{
+  t_frameHeader header;
+  header.opcode = htons(opcode);
+  header.flags = htons(flags);
+  header.length = htonl(length);
+
+  char *cursor = (char *)&header;
+  size_t remaining = FRAME_HEADER_SIZE;
+
+  while (remaining > 0)
+  {
+    ssize_t sent = send(sock, cursor, remaining, MSG_NOSIGNAL | MSG_MORE);
+    if (sent < 0 && errno == EINTR)
+      continue;
+    if (sent < 0)
+      return -1;
+
+    cursor += sent;
+    remaining -= sent;
+  }
+
+  return 0;
+}
+
+/// @brief Converts a header read off the wire, in place, to host byte order.
+/// @param header is the header as it was received.
+void frame_decodeHeader(t_frameHeader *header)
+{
+  header->opcode = ntohs(header->opcode);
+  header->flags = ntohs(header->flags);
+  header->length = ntohl(header->length);
+}
+
+/// @brief Receives the header of one frame, for receivers that consume the payload themselves (eg. with splice).
+/// @param sock is the socket the frame is received from.
+/// @param header is filled with the frame header, in host byte order.
+/// @return 0 if a whole header was received, -1 on error or on disconnect.
+int frame_recvHeader(int sock, t_frameHeader *header)
+{
+  if (frame_recvExact(sock, header, FRAME_HEADER_SIZE) != 0)
+    return -1;
+
+  frame_decodeHeader(header);
+
+  return 0;
+}
+
+/// @brief Receives the payload of a frame whose header was already received.
+///        The payload is always NUL terminated so text payloads can be used as strings.
+/// @param sock is the socket the frame is received from.
+/// @param header is the header of the frame, in host byte order.
+/// @param payload is the buffer the payload is copied into.
+/// @param capacity is the size of the payload buffer, must be at least length + 1.
+/// @return 0 if the whole payload was received, -1 on error, on disconnect or if the payload does not fit.
+int frame_recvPayload(int sock, const t_frameHeader *header, void *payload, uint32_t capacity)
+{
+  if (header->length >= capacity)
+    return -1;
+
+  if (frame_recvExact(sock, payload, header->length) != 0)
+    return -1;
+
+  ((char *)payload)[header->length] = '\0';
+
+  return 0;
+}
+
+/// @brief Receives one frame. The payload is always NUL terminated so text payloads can be used as strings.
+/// @param sock is the socket the frame is received from.
+/// @param header is filled with the frame header, in host byte order.
+/// @param payload is the buffer the payload is copied into.
+/// @param capacity is the size of the payload buffer, must be at least length + 1.
+/// @return 0 if a whole frame was received, -1 on error, on disconnect or if the payload does not fit.
+int frame_recv(int sock, t_frameHeader *header, void *payload, uint32_t capacity)
+{
+  if (frame_recvHeader(sock, header) != 0)
+    return -1;
+
+  return frame_recvPayload(sock, header, payload, capacity);
+}
+
+#pragma endregion Framing
+
+#pragma region Checksums
+
+// CRC32C (Castagnoli) polynomial, bit reflected
+#define CHECKSUM_POLYNOMIAL 0x82F63B78
+
+/// @brief CRC32C a bit at a time, for CPUs without a CRC instruction.
+static uint32_t checksum_crc32cSoftware(uint32_t crc, const unsigned char *data, size_t length)
+{
+  while (length-- > 0)
+  {
+    crc ^= *data++;
+    for (int bit = 0; bit < 8; bit++)
+    {
+      crc = (crc >> 1) ^ (CHECKSUM_POLYNOMIAL & (0 - (crc & 1)));
+    }
+  }
+
+  return crc;
+}
+
+#if defined(__x86_64__)
+/// @brief CRC32C with the SSE4.2 crc32 instruction, 8 bytes per instruction.
+__attribute__((target("sse4.2"))) static uint32_t checksum_crc32cHardware(uint32_t crc, const unsigned char *data,
+                                                                          size_t length)
+{
+  uint64_t crc64 = crc;
+
+  while (length >= sizeof(uint64_t))
+  {
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    crc64 = _mm_crc32_u64(crc64, word);
+
+    data += sizeof(word);
+    length -= sizeof(word);
+  }
+
+  crc = (uint32_t)crc64;
+  while (length-- > 0)
+  {
+    crc = _mm_crc32_u8(crc, *data++);
+  }
+
+  return crc;
+}
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+/// @brief CRC32C with the ARMv8 crc32c instructions, 8 bytes per instruction.
+static uint32_t checksum_crc32cHardware(uint32_t crc, const unsigned char *data, size_t length)
+{
+  while (length >= sizeof(uint64_t))
+  {
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    crc = __crc32cd(crc, word);
+
+    data += sizeof(word);
+    length -= sizeof(word);
+  }
+
+  while (length-- > 0)
+  {
+    crc = __crc32cb(crc, *data++);
+  }
+
+  return crc;
+}
+#endif
+
+/// @brief Computes the CRC32C of a block, continuing from the CRC32C of what came before it, so a file can be
+///        checksummed block by block. Uses the CPU's CRC instruction where there is one.
+/// @param crc is the CRC32C of the data before the block, 0 for the first block.
+/// @param data is the block.
+/// @param length is the no. of bytes in the block.
+/// @return the CRC32C of everything up to and including the block.
+uint32_t checksum_crc32c(uint32_t crc, const void *data, size_t length)
+{
+  crc = ~crc;
+
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("sse4.2"))
+    return ~checksum_crc32cHardware(crc, data, length);
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+  return ~checksum_crc32cHardware(crc, data, length);
+#endif
+
+  return ~checksum_crc32cSoftware(crc, data, length);
+}
+
+/// @brief Finds a CRC32C field in a status message, eg. "whole=e3069283".
+/// @param message is the status message.
+/// @param field is the name of the field.
+/// @param crc is filled with the CRC32C, if the message has the field.
+/// @return true if the message carries the field.
+bool checksum_parseField(const char *message, const char *field, uint32_t *crc)
+{
+  size_t field_length = strlen(field);
+  unsigned int value;
+
+  // a field is a word of its own, "crc32c=" is not found in "xcrc32c="
+  for (const char *found = strstr(message, field); found != NULL; found = strstr(found + 1, field))
+  {
+    if ((found == message || found[-1] == ' ') && found[field_length] == '=' &&
+        sscanf(found + field_length + 1, "%8x", &value) == 1)
+    {
+      *crc = value;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/// @brief Finds the CRC32C of what was sent in the status ending a transfer, eg. "S:200 crc32c=e3069283 File sent".
+/// @param message is the status message.
+/// @param crc is filled with the CRC32C, if there is one.
+/// @return true if the message carries a CRC32C.
+bool checksum_parse(const char *message, uint32_t *crc)
+{
+  return checksum_parseField(message, CHECKSUM_FEATURE, crc);
+}
+
+#pragma endregion Checksums
+
+#pragma region Compression
+
+// A sequence is a token (no. of literals in the high 4 bits, match length - COMPRESS_MIN_MATCH in the low 4), the
+// rest of the literal count if it is 15 or more, the literals, a 2 byte little endian offset back to the match and the
+// rest of the match length. The last sequence is literals only.
+#define COMPRESS_HASH_BITS 13
+#define COMPRESS_MIN_MATCH 4
+#define COMPRESS_MAX_OFFSET 65535
+#define COMPRESS_LAST_LITERALS 5 // a block ends with at least this many literals, as LZ4 decoders expect
+#define COMPRESS_MATCH_LIMIT 12  // no match starts this close to the end of a block
+
+/// @brief Reads 4 bytes from anywhere in memory.
+static uint32_t compress_read32(const unsigned char *data)
+{
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+
+  return value;
+}
+
+/// @brief Writes the rest of a literal count or match length of 15 or more, after its token.
+/// @return where the next byte goes.
+static unsigned char *compress_writeLength(unsigned char *out, size_t length)
+{
+  for (; length >= 255; length -= 255)
+  {
+    *out++ = 255;
+  }
+  *out++ = (unsigned char)length;
+
+  return out;
+}
+
+/// @brief Reads the rest of a literal count or match length of 15 or more.
+/// @return 0 if successful, -1 if the block ends in the middle of it.
+static int compress_readLength(const unsigned char **in, const unsigned char *end, size_t *length)
+{
+  unsigned char byte;
+
+  do
+  {
+    if (*in == end)
+      return -1;
+
+    byte = *(*in)++;
+    *length += byte;
+  } while (byte == 255);
+
+  return 0;
+}
+
+/// @brief Compresses a block, looking for repeats through a small hash table of the 4 byte sequences seen last. Runs
+///        without matches are skipped through faster and faster, so incompressible data costs little time.
+/// @param source is the block.
+/// @param length is the no. of bytes in the block.
+/// @param destination is filled with the compressed block.
+/// @param capacity is the most bytes the compressed block may take, usually less than length.
+/// @return the no. of bytes of the compressed block, -1 if it doesn't fit in capacity.
+int compress_block(const char *source, int length, char *destination, int capacity)
+{
+  const unsigned char *in = (const unsigned char *)source;
+  const unsigned char *end = in + length;
+  const unsigned char *match_limit = length > COMPRESS_MATCH_LIMIT ? end - COMPRESS_MATCH_LIMIT : in;
+  const unsigned char *cursor = in;
+  const unsigned char *anchor = in; // first byte not written out yet
+  unsigned char *out = (unsigned char *)destination;
+  unsigned char *out_end = out + (capacity > 0 ? capacity : 0);
+
+  // position + 1 where each hash was seen last, 0 for never
+  uint32_t table[1 << COMPRESS_HASH_BITS];
+  memset(table, 0, sizeof(table));
+
+  while (cursor < match_limit)
+  {
+    uint32_t sequence = compress_read32(cursor);
+    uint32_t hash = (sequence * 2654435761U) >> (32 - COMPRESS_HASH_BITS);
+    uint32_t seen = table[hash];
+    table[hash] = cursor - in + 1;
+
+    if (seen == 0 || cursor - (in + seen - 1) > COMPRESS_MAX_OFFSET || compress_read32(in + seen - 1) != sequence)
+    {
+      cursor += 1 + ((cursor - anchor) >> 6);
+      continue;
+    }
+
+    const unsigned char *match = in + seen - 1;
+    size_t match_length = COMPRESS_MIN_MATCH;
+    while (cursor + match_length < end - COMPRESS_LAST_LITERALS && cursor[match_length] == match[match_length])
+    {
+      match_length++;
+    }
+
+    size_t literal_length = cursor - anchor;
+    size_t extra_length = match_length - COMPRESS_MIN_MATCH;
+    if ((size_t)(out_end - out) < 1 + literal_length / 255 + 1 + literal_length + 2 + extra_length / 255 + 1)
+      return -1;
+
+    unsigned char *token = out++;
+    *token = (literal_length >= 15 ? 15 : literal_length) << 4 | (extra_length >= 15 ? 15 : extra_length);
+
+    if (literal_length >= 15)
+      out = compress_writeLength(out, literal_length - 15);
+    memcpy(out, anchor, literal_length);
+    out += literal_length;
+
+    size_t offset = cursor - match;
+    *out++ = offset & 0xff;
+    *out++ = offset >> 8;
+
+    if (extra_length >= 15)
+      out = compress_writeLength(out, extra_length - 15);
+
+    cursor += match_length;
+    anchor = cursor;
+  }
+
+  size_t literal_length = end - anchor;
+  if ((size_t)(out_end - out) < 1 + literal_length / 255 + 1 + literal_length)
+    return -1;
+
+  *out++ = (literal_length >= 15 ? 15 : literal_length) << 4;
+  if (literal_length >= 15)
+    out = compress_writeLength(out, literal_length - 15);
+  memcpy(out, anchor, literal_length);
+  out += literal_length;
+
+  return out - (unsigned char *)destination;
+}
+
+/// @brief Expands a block compressed by compress_block. The block comes off the wire, so it is checked at every step
+///        and never read or written out of bounds, whatever it holds.
+/// @param source is the compressed block.
+/// @param length is the no. of bytes of the compressed block.
+/// @param destination is filled with the contents.
+/// @param capacity is the size of destination.
+/// @return the no. of bytes of the contents, -1 if the block is malformed or expands past capacity.
+int compress_expand(const char *source, int length, char *destination, int capacity)
+{
+  const unsigned char *in = (const unsigned char *)source;
+  const unsigned char *end = in + length;
+  unsigned char *out = (unsigned char *)destination;
+  unsigned char *out_end = out + capacity;
+
+  while (in < end)
+  {
+    unsigned char token = *in++;
+
+    size_t literal_length = token >> 4;
+    if (literal_length == 15 && compress_readLength(&in, end, &literal_length) != 0)
+      return -1;
+    if (literal_length > (size_t)(end - in) || literal_length > (size_t)(out_end - out))
+      return -1;
+
+    memcpy(out, in, literal_length);
+    in += literal_length;
+    out += literal_length;
+
+    // the last sequence has no match
+    if (in == end)
+      break;
+    if (end - in < 2)
+      return -1;
+
+    size_t offset = in[0] | in[1] << 8;
+    in += 2;
+    if (offset == 0 || offset > (size_t)(out - (unsigned char *)destination))
+      return -1;
+
+    size_t match_length = token & 15;
+    if (match_length == 15 && compress_readLength(&in, end, &match_length) != 0)
+      return -1;
+    match_length += COMPRESS_MIN_MATCH;
+    if (match_length > (size_t)(out_end - out))
+      return -1;
+
+    // a match may overlap the bytes it produces, eg. a run of one byte has an offset of 1
+    const unsigned char *match = out - offset;
+    if (offset >= match_length)
+    {
+      memcpy(out, match, match_length);
+    }
+    else
+    {
+      for (size_t i = 0; i < match_length; i++)
+      {
+        out[i] = match[i];
+      }
+    }
+    out += match_length;
+  }
+
+  return out - (unsigned char *)destination;
+}
+
+#pragma endregion Compression
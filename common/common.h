@@ -1,4 +1,8 @@
+#ifndef COMMON_H
+#define COMMON_H
+
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/time.h>
 
 #pragma region Error and Success Codes
@@ -9,6 +13,8 @@
 // Error codes
 #define ERROR_NOT_FOUND "E:404"
 #define ERROR_NOT_ACCEPTABLE "E:406"
+#define ERROR_RANGE_NOT_SATISFIABLE "E:416"
+#define ERROR_SERVICE_UNAVAILABLE "E:503"
 
 // Success codes
 #define SUCCESS_OK "S:200"
@@ -20,6 +26,9 @@
 #define COMMAND_CODE_PUT "C:003"
 #define COMMAND_CODE_MD "C:004"
 #define COMMAND_CODE_RM "C:005"
+#define COMMAND_CODE_HELLO "C:006"
+#define COMMAND_CODE_BYE "C:007"
+#define COMMAND_CODE_FINISH "C:008"
 
 #pragma endregion Error and Success Codes
 
@@ -34,12 +43,124 @@
 #define CLIENT_MESSAGE_SIZE 2000
 #define CLIENT_COMMAND_SIZE 1000
 
+// chunk size the client asks for when it connects, the largest data frame either side sends.
+// The server may settle on a smaller one.
+#define CLIENT_CHUNK_SIZE (4 * 1024 * 1024)
+
+// a download is written next to its destination under this suffix, and resumed from there if it gets cut off
+#define CLIENT_PARTIAL_SUFFIX ".part"
+
+// a new download is fetched in pieces this large, spread over up to this many connections, 1 fetches it over the
+// connection of the command alone. The pieces are written to a file of their own under CLIENT_PIECES_SUFFIX
+#define CLIENT_PARALLEL_PIECE_SIZE (16 * 1024 * 1024)
+#define CLIENT_PARALLEL_CONNECTIONS 4
+#define CLIENT_PIECES_SUFFIX ".pieces"
+
+// files at least this large are uploaded so that a PUT that gets cut off can be resumed, see Uploads
+#define CLIENT_RESUMABLE_PUT_SIZE (16 * 1024 * 1024)
+
+// whether the client offers to checksum transfers when it connects, see Checksums. A checksummed transfer passes
+// through user space on the server, so it is not sent with sendfile(2) or received with splice(2). With this and
+// CLIENT_COMPRESSION off the data goes straight between the socket and the disk, checked only by TCP
+#define CLIENT_CHECKSUMS true
+
+// whether the client offers to compress data frames when it connects
+#define CLIENT_COMPRESSION true
+
+// Transfer config
+// no. of data frames a receiver lets the sender have in flight before it has to acknowledge them.
+// 0 streams the whole file and only acknowledges at the end.
+#define TRANSFER_WINDOW_SIZE 64
+
 #pragma endregion Config
 
+#pragma region Framing
+
+// Every message on the wire is a fixed size binary header followed by exactly `length` bytes of payload.
+// All header fields are sent in network byte order.
+
+// Frame opcodes
+#define FRAME_OP_COMMAND 1 // payload is a command, eg. "C:001 h3.txt f1/h2.txt"
+#define FRAME_OP_STATUS 2  // payload is a status/error code and a message, eg. "S:200 File found on server"
+#define FRAME_OP_DATA 3    // payload is raw file contents, binary safe (replaces "S:206 " + text)
+
+// Frame flags
+#define FRAME_FLAG_NONE 0x0000
+#define FRAME_FLAG_CHECKSUM 0x0001   // data frame ends with the CRC32C of the rest of its payload, see Checksums
+#define FRAME_FLAG_COMPRESSED 0x0002 // data frame payload is compressed, see Compression
+
+typedef struct __attribute__((packed)) s_frameHeader
+{
+    uint16_t opcode;
+    uint16_t flags;
+    uint32_t length;
+} t_frameHeader;
+
+#define FRAME_HEADER_SIZE ((int)sizeof(t_frameHeader))
+
+int frame_send(int sock, uint16_t opcode, uint16_t flags, const void *payload, uint32_t length);
+int frame_sendHeader(int sock, uint16_t opcode, uint16_t flags, uint32_t length);
+void frame_decodeHeader(t_frameHeader *header);
+int frame_recvHeader(int sock, t_frameHeader *header);
+int frame_recvPayload(int sock, const t_frameHeader *header, void *payload, uint32_t capacity);
+int frame_recv(int sock, t_frameHeader *header, void *payload, uint32_t capacity);
+
+#pragma endregion Framing
+
+#pragma region Checksums
+
+// A client that wants its transfers checked offers it when it connects, eg. "C:006 4194304 crc32c", and the server
+// echoes it if it agrees. From then on every data frame of GET/PUT carries FRAME_FLAG_CHECKSUM: the last
+// CHECKSUM_SIZE bytes of the payload are the CRC32C of the rest, in network byte order. The S:200 ending a transfer
+// carries the CRC32C of the whole file, eg. "S:200 crc32c=e3069283 File sent successfully". A GET of a range
+// carries the CRC32C of the range, and when the range runs to the end of the file, that of the whole file as well, eg.
+// "S:200 crc32c=5bd3a2c0 whole=e3069283 File sent successfully".
+#define CHECKSUM_FEATURE "crc32c"
+#define CHECKSUM_WHOLE_FIELD "whole"
+#define CHECKSUM_SIZE 4
+
+uint32_t checksum_crc32c(uint32_t crc, const void *data, size_t length);
+bool checksum_parseField(const char *message, const char *field, uint32_t *crc);
+bool checksum_parse(const char *message, uint32_t *crc);
+
+#pragma endregion Checksums
+
+#pragma region Compression
+
+// A client that wants data frames compressed offers it when it connects, eg. "C:006 4194304 crc32c lz", and the
+// server echoes it if it agrees. From then on either side compresses every data frame of GET/PUT it sends (LZ77, in
+// the LZ4 block format) and sets FRAME_FLAG_COMPRESSED. A frame that doesn't get smaller is sent raw, without the
+// flag. The CRC32C of a checksummed frame is that of its contents before compression.
+#define COMPRESSION_FEATURE "lz"
+
+int compress_block(const char *source, int length, char *destination, int capacity);
+int compress_expand(const char *source, int length, char *destination, int capacity);
+
+#pragma endregion Compression
+
+#pragma region Uploads
+
+// A PUT can name an upload after its window, eg. "C:003 big.dat big.dat 64 9f0c6e1a22b84d07". If the PUT gets cut off,
+// the server keeps what it received of the upload, and a later PUT naming the same upload is told in the S:100 reply
+// how many bytes the server already has, eg. "S:100 64 1048576 Ready to write file on server". The client sends the
+// file from there on. A client that gives up on an upload for good sends E:500 instead of the S:200 ending the file.
+//
+// A large file can be uploaded in ranges, over several connections at once. Each range is a PUT of the upload with the
+// offset it starts at, eg. "C:003 big.dat big.dat 64 9f0c6e1a22b84d07 16777216". Its S:100 tells how many bytes from
+// the offset on the server already has, eg. "S:100 64 0 Ready to write range on server", and its S:200 carries the
+// CRC32C of what was sent of the range. Once every range is acknowledged, FINISH, eg. "C:008 big.dat
+// 9f0c6e1a22b84d07 <size> crc32c=e3069283", puts the file in place, checked against the CRC32C of the whole file. A
+// range cut off on its way is resumed like a whole upload.
+#define UPLOAD_ID_SIZE 16 // hex digits
+
+#pragma endregion Uploads
+
 typedef struct s_fileInfo
 {
     char *name;
     int size;
     int permission;
     struct timeval lastAccessed;
-} t_fileInfo;
\ No newline at end of file
+} t_fileInfo;
+
+#endif /* COMMON_H */
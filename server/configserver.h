@@ -3,9 +3,139 @@
 
 // Server configuration values
 
+// file listing the replica root directories, read at startup. Without it, the two roots below are used.
+// One setting per line, lines starting with # are comments:
+//   replica <root directory>   a replica, numbered from 1 in the order listed
+//   primary <no.>              the replica written first in asynchronous mode
+#define SERVER_CONFIG_FILE "./replicas.conf"
+
+// most replicas the config file can list
+#define SERVER_MAX_REPLICAS 8
+
 // path of the root directory on server USB drive
 // #define ROOT_DIRECTORY_1 "/media/ujwal/UJWAL/root/"
 #define ROOT_DIRECTORY_1 "/Volumes/Omkar_PD/root/"
 #define ROOT_DIRECTORY_2 "./root/"
 
+// largest no. of PUT blocks the server lets a client keep in flight before acknowledging them
+#define SERVER_MAX_TRANSFER_WINDOW 256
+
+// largest data frame payload a client can negotiate, in bytes
+#define SERVER_MAX_CHUNK_SIZE (8 * 1024 * 1024)
+
+// most arguements a command can carry, including the command code
+#define SERVER_MAX_COMMAND_ARGS 6
+
+// a connection that sends no command for this long is closed, and a client that sends or reads nothing for this
+// long in the middle of a command is given up on
+#define SERVER_IDLE_TIMEOUT_SECONDS 30
+
+// no. of connections the kernel queues while the server is busy accepting others (capped by net.core.somaxconn)
+#define SERVER_LISTEN_BACKLOG 4096
+
+// most socket events the event loop handles per wakeup
+#define SERVER_EVENTS_PER_WAIT 256
+
+// whether the server agrees to compress data frames for clients that offer it
+#define SERVER_COMPRESSION true
+
+// no. of worker threads running commands, 0 uses SERVER_WORKERS_PER_CORE per online CPU core. The event loop only
+// reads commands; a worker runs a GET or PUT from start to end, blocking on the client and the disks, so this is
+// also the most transfers the server runs at once and there are many more workers than cores. Commands beyond it
+// wait in the work queue, and a client that stalls holds its worker for at most SERVER_IDLE_TIMEOUT_SECONDS
+#define SERVER_WORKER_THREADS 0
+#define SERVER_WORKERS_PER_CORE 16
+
+// most commands waiting for a free worker, further ones are turned away with E:503
+#define SERVER_WORK_QUEUE_SIZE 1024
+
+// a PUT writes each replica file under this suffix and renames it over the destination once it is on disk
+#define SERVER_PUT_TEMP_SUFFIX ".put-partial"
+
+// extended attribute holding the CRC32C of every replica file written by a checksummed PUT
+#define SERVER_CHECKSUM_XATTR "user.crc32c"
+
+// a PUT that names an upload makes what it received durable every time this many more bytes arrived, and records how
+// much that is in SERVER_UPLOAD_XATTR of its partial files. Cut off, it resumes from the last record
+#define SERVER_UPLOAD_CHECKPOINT_BYTES (64 * 1024 * 1024)
+#define SERVER_UPLOAD_XATTR "user.upload"
+
+// a PUT of a range of an upload records the stretches of it that are durable in SERVER_UPLOAD_RANGES_XATTR of its
+// partial files, "start-end" pairs, at most SERVER_UPLOAD_MAX_RANGES of them. FINISH reads the upload back in
+// blocks of SERVER_UPLOAD_BLOCK_SIZE bytes to check it
+#define SERVER_UPLOAD_RANGES_XATTR "user.upload.ranges"
+#define SERVER_UPLOAD_MAX_RANGES 64
+#define SERVER_UPLOAD_BLOCK_SIZE (1024 * 1024)
+
+// longest path, relative to a root directory, the server locks
+#define SERVER_PATH_SIZE 200
+
+// deepest directory nesting the path locks track level by level
+#define SERVER_MAX_PATH_DEPTH 32
+
+// no. of hash buckets for path locks
+#define SERVER_PATH_LOCK_BUCKETS 256
+
+// most paths changed while a replica is offline that are replayed when it returns, past that it is cloned
+#define SERVER_JOURNAL_SIZE 1024
+
+// no. of threads copying a replica tree when one has to be rebuilt
+#define SERVER_REBUILD_THREADS 4
+
+// rounds of catching up on writes made during a rebuild before the replica is briefly held to finish it
+#define SERVER_REBUILD_CATCHUP_PASSES 3
+
+// Replication modes
+#define REPLICATION_SYNC 0  // a write is acknowledged once it is on every online replica
+#define REPLICATION_ASYNC 1 // a write is acknowledged once it is on the primary and in the intent log
+
+#define SERVER_REPLICATION_MODE REPLICATION_SYNC
+
+// replica written first in asynchronous mode, the others (eg. the USB drive) are caught up in the background.
+// The config file can name another one.
+#define SERVER_PRIMARY_DIRECTORY 2
+
+// changes acknowledged but not yet on the secondaries, survives restarts
+#define SERVER_INTENT_LOG "./replication.log"
+
+// most changes the secondaries may lag behind before writes go to them directly again
+#define SERVER_REPLICATION_QUEUE_SIZE 1024
+
+// how often the health monitor checks the replica roots, changes it is told about are picked up right away
+#define SERVER_HEALTH_PROBE_MS 500
+
+// Storage modes
+#define STORAGE_PLAIN 0 // every replica holds each file whole
+#define STORAGE_DEDUP 1 // files are cut into content-defined chunks, each distinct chunk is stored once per replica
+
+#define SERVER_STORAGE_MODE STORAGE_PLAIN
+
+// directory, in every root directory, holding the chunks of deduplicated files by SHA-256, clients can't use it
+#define SERVER_CHUNK_DIRECTORY ".chunks"
+
+// smallest and largest chunk a file is cut into, and the average in between as a power of 2 (16 is 64 KiB)
+#define SERVER_CHUNK_MIN_SIZE (16 * 1024)
+#define SERVER_CHUNK_AVERAGE_BITS 16
+#define SERVER_CHUNK_MAX_SIZE (256 * 1024)
+
+// new chunks a PUT writes before it flushes them to disk together
+#define SERVER_CHUNK_FLUSH_COUNT 64
+
+// how often the scrubber compares the replicas and repairs copies that went bad, 0 turns it off. Each pass also
+// removes the chunks no deduplicated file refers to anymore
+#define SERVER_SCRUB_INTERVAL_SECONDS 3600
+
+// most bytes the scrubber reads per second, so a pass doesn't starve clients of disk bandwidth
+#define SERVER_SCRUB_BYTES_PER_SECOND (16 * 1024 * 1024)
+
+// no. of bytes the scrubber reads at a time
+#define SERVER_SCRUB_BLOCK_SIZE (1024 * 1024)
+
+// how long the scrubber waits before looking again while clients are transferring files
+#define SERVER_SCRUB_BACKOFF_MS 50
+
+// partial files of a PUT that weren't written to for this long are removed by the scrubber, uploads that were never
+// resumed and leftovers of a crash alike
+#define SERVER_UPLOAD_EXPIRY_SECONDS (24 * 60 * 60)
+
 #endif /* CONFIGSERVER_H */
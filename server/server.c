@@ -5,6 +5,10 @@
  *   https://www.educative.io/answers/how-to-implement-tcp-sockets-in-c
  */
 #define _XOPEN_SOURCE 500
+#ifdef __linux__
+// splice(2) and tee(2)
+#define _GNU_SOURCE
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -16,6 +20,21 @@
 #include <sys/stat.h>
 #include <time.h>
 #include <pthread.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <stdatomic.h>
+#include <ctype.h>
+#include <sys/xattr.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#endif
 #include "../common/common.h"
 #include "configserver.h"
 
@@ -24,16 +43,333 @@
 int socket_desc;
 struct sockaddr_in server_addr;
 
-pthread_mutex_t root_directory_1_mutex;
-pthread_mutex_t root_directory_2_mutex;
+pthread_mutex_t replica_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t replica_changed = PTHREAD_COND_INITIALIZER; // signalled when a replica is freed or becomes available
+int read_turn = 0; // replica the next read tries first, so reads that tie take turns (guarded by replica_mutex)
 
-bool isDirectory1Available;
-bool isDirectory2Available;
+// State of one client connection
+typedef struct s_session
+{
+  int sock;       // socket of the client
+  int chunk_size;     // largest data frame payload agreed on for this connection
+  bool isChecksummed; // data frames and transfers carry CRC32C, agreed on in HELLO
+  bool isCompressed;  // data frames may be compressed, agreed on in HELLO
+  bool isClosed;      // set once the client said goodbye or the stream can't be trusted for another command
+} t_session;
+
+#ifdef __linux__
+// Where a connection is in reading its next command
+#define CONNECTION_READING_HEADER 0
+#define CONNECTION_READING_COMMAND 1
+#define CONNECTION_RUNNING 2 // a handler thread owns the connection until it hands it back
+
+// A client connection as the event loop sees it
+typedef struct s_connection
+{
+  t_session session;
+  int state;
+  t_frameHeader header; // header of the command being read, raw bytes until it is complete
+  int header_received;
+  char command[CLIENT_COMMAND_SIZE];
+  int command_received;
+  char *args[SERVER_MAX_COMMAND_ARGS];
+  int argc;
+  time_t last_active;
+  struct s_connection *prev; // every open connection, for idle checks
+  struct s_connection *next;
+  struct s_connection *next_returned; // connections handler threads handed back
+} t_connection;
+
+int epoll_desc;
+int eventloop_wakeup_desc; // eventfd the handler threads poke when they hand a connection back
+
+t_connection *open_connections;
+int open_connection_count;
+
+t_connection *returned_connections;
+pthread_mutex_t returned_connections_mutex;
+#endif
+
+// One request waiting for a worker thread
+typedef struct s_work
+{
+  void (*run)(void *arg);
+  void *arg;
+  struct timespec queued_at;
+} t_work;
+
+// Fixed set of worker threads fed by a bounded ring of requests
+typedef struct s_workerPool
+{
+  t_work queue[SERVER_WORK_QUEUE_SIZE];
+  int head;  // next request a worker takes
+  int count; // requests waiting
+  int worker_count;
+  int busy_workers;
+  long served;
+  double total_wait_ms; // time requests spent queued, for the average reported in the logs
+  double max_wait_ms;
+  pthread_mutex_t mutex;
+  pthread_cond_t isWorkAvailable;
+} t_workerPool;
+
+t_workerPool worker_pool;
+
+// One copy of a whole replica tree, shared by the threads doing it
+typedef struct s_rebuild
+{
+  const char *source_root;
+  const char *target_root;
+  char **queue; // directories, relative to the root directory, waiting for a thread to copy them
+  int queue_count;
+  int queue_capacity;
+  int active; // directories being copied, they may still queue more
+  long files_copied;
+  long long bytes_copied;
+  int errors;
+  time_t last_report;
+  pthread_mutex_t mutex;
+  pthread_cond_t changed;
+} t_rebuild;
+
+// Paths changed while a replica was offline, replayed into it when it comes back
+typedef struct s_journal
+{
+  char paths[SERVER_JOURNAL_SIZE][SERVER_PATH_SIZE];
+  int count;
+  bool isTracking;   // the replica went offline while the server was running, so the journal has all it missed
+  bool isOverflowed; // more changes than the journal holds, the replica has to be rebuilt
+  bool isRestoring;  // a restore thread is bringing the replica up to date
+  dev_t root_device; // identity of the root directory last seen online, a different one has to be rebuilt
+  ino_t root_inode;
+  pthread_mutex_t mutex;
+} t_journal;
+
+// One copy of the server file space
+typedef struct s_replica
+{
+  int id;                      // no. of the replica in the logs, from 1 in the order of the config file
+  char root[SERVER_PATH_SIZE]; // root directory, ends with a '/'
+  pthread_rwlock_t lock;       // commands hold it shared, cloning holds it exclusively, paths are up to the path locks
+  bool isAvailable;            // false while the replica is being cloned, guarded by replica_mutex
+  int reads;                   // no. of GET/INFO commands reading from it, guarded by replica_mutex
+  atomic_bool isInit;          // online, kept up to date by the health monitor and read on every command
+  t_journal journal;
+} t_replica;
+
+// replicas in the order of the config file
+t_replica replicas[SERVER_MAX_REPLICAS];
+int replica_count;
+t_replica *primary_replica; // written first in asynchronous mode, the others are caught up in the background
+
+// Replicas one write command changes, and where its path is on each of them
+typedef struct s_writeSet
+{
+  bool isUp[SERVER_MAX_REPLICAS]; // the command writes the replica
+  char actual_paths[SERVER_MAX_REPLICAS][2 * SERVER_PATH_SIZE];
+  int count;       // no. of replicas written
+  bool isDeferred; // the secondaries are left to the replicator
+  bool isStaged;   // the command only writes partial files, which the other replicas don't need to hear about
+} t_writeSet;
+
+// A change to a path waiting for the replicator to apply it to the secondary replica
+typedef struct s_replicationEntry
+{
+  char command[8];
+  char path[SERVER_PATH_SIZE];
+  struct timespec queued_at;
+} t_replicationEntry;
+
+// Changes acknowledged to clients but not yet on the secondary, logged to SERVER_INTENT_LOG until applied
+typedef struct s_replicator
+{
+  t_replicationEntry queue[SERVER_REPLICATION_QUEUE_SIZE];
+  int head;     // change being applied, or the next one
+  int count;    // changes queued, including the one being applied
+  int reserved; // slots promised to commands still writing the primary
+  int log_desc;
+  long applied;
+  pthread_mutex_t mutex;
+  pthread_cond_t isChangeQueued;
+} t_replicator;
+
+t_replicator replicator = {.log_desc = -1, .mutex = PTHREAD_MUTEX_INITIALIZER, .isChangeQueued = PTHREAD_COND_INITIALIZER};
+
+// Path lock modes. Intent modes are taken on every ancestor of the path that is actually locked.
+#define LOCK_MODE_INTENT_SHARED 0    // something below this directory is being read
+#define LOCK_MODE_INTENT_EXCLUSIVE 1 // something below this directory is being written
+#define LOCK_MODE_SHARED 2           // this path is being read, eg. GET/INFO
+#define LOCK_MODE_EXCLUSIVE 3        // this path, and everything below it, is being written, eg. PUT/RM/MD
+#define LOCK_MODE_COUNT 4
+
+// Lock state of one path, exists only while someone holds or waits for it
+typedef struct s_pathLock
+{
+  char path[SERVER_PATH_SIZE];
+  int holders[LOCK_MODE_COUNT];
+  int waiting_exclusive; // exclusive requests waiting, they keep new readers out so they don't starve
+  int references;        // holders and waiters, the entry is freed when it drops to 0
+  struct s_pathLock *next;
+} t_pathLock;
+
+// Locks one command holds on a path and all its ancestors
+typedef struct s_pathLockSet
+{
+  t_pathLock *locks[SERVER_MAX_PATH_DEPTH + 1];
+  int modes[SERVER_MAX_PATH_DEPTH + 1];
+  int count;
+} t_pathLockSet;
+
+t_pathLock *path_locks[SERVER_PATH_LOCK_BUCKETS];
+pthread_mutex_t path_locks_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t path_locks_released = PTHREAD_COND_INITIALIZER;
+
+// Stretch of an upload a partial file holds on disk, [start, end)
+typedef struct s_uploadRange
+{
+  off_t start;
+  off_t end;
+} t_uploadRange;
+
+// PUTs of ranges of the same upload record them in the same partial files, one at a time
+pthread_mutex_t upload_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Destination files of one PUT, one per replica, and the pipes used to mirror blocks into them
+typedef struct s_mirror
+{
+  int fds[SERVER_MAX_REPLICAS];       // file on each replica, -1 when that replica is not written
+  int source[2];                      // pipe blocks are spliced into straight from the client socket
+  int copies[SERVER_MAX_REPLICAS][2]; // pipe per replica, holding the tee'd copy of the source pipe
+  char *buffer;                       // blocks pass through here when they can't be spliced
+  int buffer_size;
+  char *expanded; // compressed blocks are expanded into here, NULL if the client doesn't compress
+  bool isSpliceAvailable;
+  bool isWriteFailed;
+  bool isChecksummed;    // every block so far came with a CRC32C, so crc is the CRC32C of the whole file
+  bool isChecksumFailed; // a block didn't match its CRC32C
+  uint32_t crc;
+  off_t size;            // no. of bytes written to every file so far
+  off_t range_start;     // where the files are written from when they take a range of an upload, -1 otherwise
+  struct s_dedup *dedup; // cuts blocks into chunks instead of writing them to the files, NULL for whole files
+} t_mirror;
+
+// One finished PUT waiting for its replica files to reach the disk and be renamed into place
+typedef struct s_commit
+{
+  int fds[SERVER_MAX_REPLICAS];                 // temporary file written on each replica, -1 if not written
+  const char *temp_paths[SERVER_MAX_REPLICAS];   // where each temporary file is
+  const char *actual_paths[SERVER_MAX_REPLICAS]; // where it is renamed to
+  bool isRenamed[SERVER_MAX_REPLICAS];          // the file is at its destination on the replica
+  int status; // 0 once the file is durable at its destination on a replica, -1 if it is on none of them
+  bool isDone;
+  struct s_commit *next;
+} t_commit;
+
+// PUTs queued for the committer thread, which makes every PUT that finished meanwhile durable in one round
+typedef struct s_committer
+{
+  t_commit *pending; // newest first
+  long rounds;
+  long committed;
+  pthread_mutex_t mutex;
+  pthread_cond_t isPending;
+  pthread_cond_t isCommitted;
+} t_committer;
+
+t_committer committer = {.mutex = PTHREAD_MUTEX_INITIALIZER,
+                         .isPending = PTHREAD_COND_INITIALIZER,
+                         .isCommitted = PTHREAD_COND_INITIALIZER};
+
+// A deduplicated file on a replica is a manifest, the list of its chunks:
+//   "FSDEDUP1 <file size> <no. of chunks>\n" followed by "<SHA-256 in hex> <length>\n" for each chunk in order.
+// Chunk contents are in <root>/SERVER_CHUNK_DIRECTORY/<first 2 hex digits>/<SHA-256 in hex>.
+#define MANIFEST_MAGIC "FSDEDUP1"
+#define SHA256_SIZE 32
+
+// One chunk of a deduplicated file
+typedef struct s_chunkRef
+{
+  unsigned char hash[SHA256_SIZE];
+  uint32_t length;
+  long long offset; // where the chunk starts in the file
+} t_chunkRef;
+
+// A deduplicated file as read back by GET
+typedef struct s_manifest
+{
+  long long size;
+  int count;
+  t_chunkRef *chunks;
+  char *chunk; // contents of the chunk last read
+  int loaded;  // no. of that chunk, -1 if none was read yet
+} t_manifest;
+
+// Cuts a PUT into chunks and stores the ones the replicas don't have yet
+typedef struct s_dedup
+{
+  bool isUp[SERVER_MAX_REPLICAS]; // replicas the PUT writes
+  int epoch;                      // chunk store epoch the PUT started in
+  char *chunk;                    // the chunk being cut
+  int chunk_length;
+  uint64_t fingerprint; // rolling hash over the chunk so far, a chunk ends where it hits the boundary pattern
+  char *manifest;       // chunk lines of the manifest so far
+  size_t manifest_length;
+  size_t manifest_capacity;
+  long long size;
+  int chunk_count;
+  long long bytes_stored; // bytes of chunks that were new to the replicas
+  t_commit pending[SERVER_CHUNK_FLUSH_COUNT]; // new chunks in temporary files, flushed and renamed together
+  unsigned char pending_hashes[SERVER_CHUNK_FLUSH_COUNT][SHA256_SIZE];
+  char pending_paths[SERVER_CHUNK_FLUSH_COUNT][SERVER_MAX_REPLICAS][2 * SERVER_PATH_SIZE];
+  char pending_temp_paths[SERVER_CHUNK_FLUSH_COUNT][SERVER_MAX_REPLICAS][2 * SERVER_PATH_SIZE + 40];
+  int pending_count;
+  bool isFailed;
+} t_dedup;
+
+// Lets the scrubber remove chunks no file refers to without taking them from under a write about to refer to them.
+// A collection flips the epoch and waits for the writes of the previous one to finish: chunks in use from then on
+// are either in a manifest it sees or were touched after it started.
+typedef struct s_chunkStore
+{
+  int epoch;
+  int writers[2]; // writes in progress that started in the current and the previous epoch
+  pthread_mutex_t mutex;
+  pthread_cond_t isDrained;
+  pthread_rwlock_t sweep_lock; // held shared to reuse a chunk, exclusively to remove one
+  atomic_long temp_files;      // names the temporary files of new chunks apart
+} t_chunkStore;
+
+t_chunkStore chunk_store = {.mutex = PTHREAD_MUTEX_INITIALIZER,
+                            .isDrained = PTHREAD_COND_INITIALIZER,
+                            .sweep_lock = PTHREAD_RWLOCK_INITIALIZER};
+
+// Chunks the files of a replica refer to, sorted to be searched when unused ones are removed
+typedef struct s_hashList
+{
+  unsigned char (*hashes)[SHA256_SIZE];
+  int count;
+  int capacity;
+} t_hashList;
 
-pthread_mutex_t root_directory_1_availability_mutex;
-pthread_mutex_t root_directory_2_availability_mutex;
+// random value per byte for the rolling hash that places chunk boundaries
+uint64_t chunk_gear[256];
 
-bool isRootDirectory1Init, isRootDirectory2Init;
+// GETs and PUTs moving file data right now, the scrubber stays out of their way while there are any
+atomic_int foreground_transfers;
+
+// one pass of the scrubber over a replica, compared with the reference replica
+typedef struct s_scrub
+{
+  t_replica *reference; // copy trusted unless its stored checksums say otherwise, the primary while it is online
+  t_replica *target;
+  char *buffer;
+  struct timespec started_at;
+  double next_read_ms; // when, since started_at, the next block may be read
+  long long bytes_read;
+  long files_checked;
+  int repaired;
+  int unresolved; // files no copy of which matches its stored checksum
+} t_scrub;
 
 /// @brief Closes the server socket.
 void server_closeServerSocket()
@@ -50,1375 +386,6620 @@ void server_closeClientSocket(int client_sock)
   close(client_sock);
 }
 
-#pragma region Directory Availability
+#pragma region Helpers
 
-/// @brief Chnages the availability of the Copy 1 of the server.
-/// @param availability represents the availability for the copy.
-void directory_changeDirectory1Availability(bool availability)
+/// @brief Checks the existence of a directory in the server space.
+/// @param path represents the directory path that needs to be examined for existence.
+/// @return true if the directory exists, false otherwise.
+bool directory_isDirectoryExists(const char *path)
 {
-  pthread_mutex_lock(&root_directory_1_availability_mutex);
+  struct stat stats;
 
-  isDirectory1Available = availability;
+  // Check for file existence
+  if (stat(path, &stats) == 0 && S_ISDIR(stats.st_mode))
+    return true;
 
-  pthread_mutex_unlock(&root_directory_1_availability_mutex);
+  return false;
 }
 
-/// @brief Chnages the availability of the Copy 1 of the server.
-/// @param availability represents the availability for the copy.
-void directory_changeDirectory2Availability(bool availability)
+/// @brief Checks the existence of a file.
+/// @param filename represents the file path that needs to be checked.
+/// @return true if the file exists, false otherwise.
+bool directory_isFileExists(const char *filename)
+{
+  FILE *fp = fopen(filename, "r");
+  bool is_exist = false;
+  if (fp != NULL)
+  {
+    is_exist = true;
+    fclose(fp); // close the file
+  }
+  return is_exist;
+}
+
+/// @brief Checks whether a directory has no entries.
+/// @param path represents the directory path.
+/// @return true if the directory is empty or can't be read.
+bool directory_isDirectoryEmpty(const char *path)
 {
-  pthread_mutex_lock(&root_directory_2_availability_mutex);
+  DIR *dir = opendir(path);
+  if (dir == NULL)
+    return true;
 
-  isDirectory2Available = availability;
+  bool isEmpty = true;
+  struct dirent *entry;
+
+  while (isEmpty && (entry = readdir(dir)) != NULL)
+  {
+    isEmpty = strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0;
+  }
 
-  pthread_mutex_unlock(&root_directory_2_availability_mutex);
+  closedir(dir);
+  return isEmpty;
 }
 
-/// @brief Acquires mutex/control on Copy 1 of the server.
-void directory_acquireDirectory1()
+/// @brief Unlinks and removes a file.
+/// @param fpath represents the path of file/directory.
+/// @param sb buffer for stat command inside nftw command.
+/// @param typeflag type for nftw command.
+/// @param ftwbuf buffer for nftw command.
+/// @return 0 if successful.
+int directory_unlinkFile(const char *fpath, const struct stat *sb, int typeflag, struct FTW *ftwbuf)
 {
-  pthread_mutex_lock(&root_directory_1_mutex);
+  int rv = remove(fpath);
+
+  if (rv)
+    perror(fpath);
 
-  directory_changeDirectory1Availability(false);
+  return rv;
 }
 
-/// @brief Releases mutex/control on Copy 1 of the server.
-void directory_releaseDirectory1()
+/// @brief Removes a directory recursively.
+/// @param path is the path of the directory to be removed.
+/// @return 0 if successful.
+int directory_removeDirectoryRecursively(char *path)
 {
-  directory_changeDirectory1Availability(true);
-
-  pthread_mutex_unlock(&root_directory_1_mutex);
+  return nftw(path, directory_unlinkFile, 64, FTW_DEPTH | FTW_PHYS);
 }
 
-/// @brief Acquires mutex/control on Copy 2 of the server.
-void directory_acquireDirectory2()
+/// @brief Tells whether a directory entry is the temporary file of a PUT still being written.
+/// @param name is the name of the entry.
+/// @return true if the name ends with SERVER_PUT_TEMP_SUFFIX.
+bool directory_isPutTempFile(const char *name)
 {
-  pthread_mutex_lock(&root_directory_2_mutex);
+  size_t length = strlen(name);
+  size_t suffix_length = strlen(SERVER_PUT_TEMP_SUFFIX);
 
-  directory_changeDirectory2Availability(false);
+  return length > suffix_length && strcmp(name + length - suffix_length, SERVER_PUT_TEMP_SUFFIX) == 0;
 }
 
-/// @brief Releases mutex/control on Copy 2 of the server.
-void directory_releaseDirectory2()
+/// @brief Milliseconds passed since a moment in the past.
+/// @param start is the moment, from the monotonic clock.
+/// @return the milliseconds passed.
+double server_millisecondsSince(const struct timespec *start)
 {
-  directory_changeDirectory2Availability(true);
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
 
-  pthread_mutex_unlock(&root_directory_2_mutex);
+  return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1000000.0;
 }
 
-#pragma endregion Directory Availability
+#pragma endregion Helpers
 
-#pragma region Directory Cloning
+#pragma region Stored Checksums
+
+/// @brief Stores the CRC32C of a replica file in its SERVER_CHECKSUM_XATTR extended attribute.
+/// @param fd is the replica file.
+/// @param crc is the CRC32C of its whole contents.
+/// @return 0 if stored, -1 otherwise (eg. the file system has no extended attributes).
+int checksum_store(int fd, uint32_t crc)
+{
+  char value[9];
+  snprintf(value, sizeof(value), "%08x", crc);
+
+#ifdef __APPLE__
+  return fsetxattr(fd, SERVER_CHECKSUM_XATTR, value, 8, 0, 0);
+#else
+  return fsetxattr(fd, SERVER_CHECKSUM_XATTR, value, 8, 0);
+#endif
+}
 
-/// @brief Clones Server Copy 2 to Server Copy 1.
-void directory_cloneDirectory2IntoDirectory1()
+/// @brief Reads the CRC32C stored with a replica file.
+/// @param fd is the replica file.
+/// @param crc is filled with the stored CRC32C.
+/// @return 0 if the file has one, -1 otherwise.
+int checksum_load(int fd, uint32_t *crc)
 {
-  char command[1000];
-  memset(command, 0, sizeof(command));
+  char value[9];
 
-  strcat(command, "cp -p -r ");
-  strcat(command, ROOT_DIRECTORY_2);
-  strcat(command, "*");
-  strcat(command, " ");
-  strcat(command, ROOT_DIRECTORY_1);
+#ifdef __APPLE__
+  ssize_t length = fgetxattr(fd, SERVER_CHECKSUM_XATTR, value, 8, 0, 0);
+#else
+  ssize_t length = fgetxattr(fd, SERVER_CHECKSUM_XATTR, value, 8);
+#endif
+  unsigned int stored;
 
-  directory_acquireDirectory1();
-  directory_acquireDirectory2();
+  if (length != 8)
+    return -1;
 
-  printf("DIRECTORY CLONING: command to be excuted for clone root directory 2 into root directory 1: %s \n", command);
-  printf("DIRECTORY CLONING: starting cloning root directory 2 into root directory 1\n");
-  system(command);
+  value[8] = '\0';
+  if (sscanf(value, "%8x", &stored) != 1)
+    return -1;
 
-  directory_releaseDirectory1();
-  directory_releaseDirectory2();
-  printf("DIRECTORY CLONING: cloning complete for root directory 2 into root directory 1\n");
+  *crc = stored;
+  return 0;
 }
 
-/// @brief Clones Server Copy 1 to Server Copy 2.
-void directory_cloneDirectory1IntoDirectory2()
+/// @brief Gives a copy of a replica file the stored CRC32C of the original, or drops the one it had if the original
+///        has none.
+/// @param source_fd is the original.
+/// @param target_fd is the copy.
+void checksum_copy(int source_fd, int target_fd)
 {
-  char command[1000];
-  memset(command, 0, sizeof(command));
+  uint32_t crc;
 
-  strcat(command, "cp -p -r ");
-  strcat(command, ROOT_DIRECTORY_1);
-  strcat(command, "*");
-  strcat(command, " ");
-  strcat(command, ROOT_DIRECTORY_2);
-
-  directory_acquireDirectory1();
-  directory_acquireDirectory2();
-
-  printf("DIRECTORY CLONING: command to be excuted for clone root directory 1 into root directory 2: %s \n", command);
-  printf("DIRECTORY CLONING: starting cloning root directory 1 into root directory 2\n");
-  system(command);
-
-  directory_releaseDirectory1();
-  directory_releaseDirectory2();
-  printf("DIRECTORY CLONING: cloning complete for root directory 1 into root directory 2\n");
+  if (checksum_load(source_fd, &crc) == 0)
+  {
+    checksum_store(target_fd, crc);
+  }
+  else
+  {
+#ifdef __APPLE__
+    fremovexattr(target_fd, SERVER_CHECKSUM_XATTR, 0);
+#else
+    fremovexattr(target_fd, SERVER_CHECKSUM_XATTR);
+#endif
+  }
 }
 
-#pragma endregion Directory Cloning
+#pragma endregion Stored Checksums
 
-#pragma region Init
+#pragma region Resumable Uploads
 
-/// @brief Initializes the socket when the server goes up.
-/// @return 0 if socket creation is successful, -1 otherwise.
-int init_createServerSocket()
+/// @brief Tells whether the client named an upload the way the protocol expects, UPLOAD_ID_SIZE hex digits.
+/// @param upload_id is the name.
+/// @return true if the name is valid.
+bool upload_isValidId(const char *upload_id)
 {
-  // Create socket:
-  socket_desc = socket(AF_INET, SOCK_STREAM, 0);
+  if (strlen(upload_id) != UPLOAD_ID_SIZE)
+    return false;
 
-  if (socket_desc < 0)
+  for (int i = 0; i < UPLOAD_ID_SIZE; i++)
   {
-    printf("ERROR: Error while creating socket\n");
-    server_closeServerSocket();
-    return -1;
+    if (!isxdigit((unsigned char)upload_id[i]))
+      return false;
   }
-  printf("INIT: Socket created successfully\n");
-  return 0;
+
+  return true;
 }
 
-/// @brief Binds the server socket to the port.
-/// @return 0 in case of successful binding. -1 otherwise.
-int init_bindServerSocket()
+/// @brief Records in a partial file of an upload how much of it is on disk, and the CRC32C of that much.
+/// @param fd is the partial file.
+/// @param size is the no. of bytes on disk.
+/// @param crc is the CRC32C of those bytes.
+/// @param isChecksummed is false if crc doesn't cover all of them, as some arrived without a checksum.
+/// @return 0 if the record was stored, -1 otherwise.
+int upload_storeProgress(int fd, off_t size, uint32_t crc, bool isChecksummed)
 {
-  // Set port and IP:
-  server_addr.sin_family = AF_INET;
-  server_addr.sin_port = htons(SERVER_PORT);
-  server_addr.sin_addr.s_addr = inet_addr(SERVER_IP);
+  char value[64];
+  int length = snprintf(value, sizeof(value), "%lld %08x %d", (long long)size, crc, isChecksummed ? 1 : 0);
+
+#ifdef __APPLE__
+  return fsetxattr(fd, SERVER_UPLOAD_XATTR, value, length, 0, 0);
+#else
+  return fsetxattr(fd, SERVER_UPLOAD_XATTR, value, length, 0);
+#endif
+}
 
-  // Bind to the set port and IP:S
-  if (bind(socket_desc, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
-  {
-    printf("ERROR: Couldn't bind to the port\n");
-    server_closeServerSocket();
+/// @brief Reads how much of an upload a partial file holds on disk.
+/// @param fd is the partial file.
+/// @param size is filled with the no. of bytes on disk.
+/// @param crc is filled with the CRC32C of those bytes.
+/// @param isChecksummed is filled with whether crc covers all of them.
+/// @return 0 if the file has a record, -1 otherwise.
+int upload_loadProgress(int fd, off_t *size, uint32_t *crc, bool *isChecksummed)
+{
+  char value[64];
+
+#ifdef __APPLE__
+  ssize_t length = fgetxattr(fd, SERVER_UPLOAD_XATTR, value, sizeof(value) - 1, 0, 0);
+#else
+  ssize_t length = fgetxattr(fd, SERVER_UPLOAD_XATTR, value, sizeof(value) - 1);
+#endif
+  long long stored_size;
+  unsigned int stored_crc;
+  int stored_flag;
+
+  if (length <= 0)
     return -1;
-  }
-  printf("INIT: Done with binding\n");
+
+  value[length] = '\0';
+  if (sscanf(value, "%lld %8x %d", &stored_size, &stored_crc, &stored_flag) != 3 || stored_size < 0)
+    return -1;
+
+  *size = stored_size;
+  *crc = stored_crc;
+  *isChecksummed = stored_flag != 0;
   return 0;
 }
 
-/// @brief Initialises a root directory, if not existing already, representing the server file space.
-/// @return 0 if successful, -1 otherwise.
-int init_createRootDirectory()
+/// @brief Reads the stretches of an upload that PUTs of its ranges left on disk in a partial file.
+/// @param fd is the partial file.
+/// @param ranges is filled with the stretches, in order and apart from each other.
+/// @return no. of stretches, 0 if the file has no record of any.
+int upload_loadRanges(int fd, t_uploadRange ranges[SERVER_UPLOAD_MAX_RANGES])
 {
-  struct stat st1 = {0};
-  struct stat st2 = {0};
+  char value[SERVER_UPLOAD_MAX_RANGES * 42 + 1];
+
+#ifdef __APPLE__
+  ssize_t length = fgetxattr(fd, SERVER_UPLOAD_RANGES_XATTR, value, sizeof(value) - 1, 0, 0);
+#else
+  ssize_t length = fgetxattr(fd, SERVER_UPLOAD_RANGES_XATTR, value, sizeof(value) - 1);
+#endif
+  if (length <= 0)
+    return 0;
 
-  bool isDirectory1Fresh = false;
-  bool isDirectory2Fresh = false;
+  value[length] = '\0';
 
-  // init mutex for directory 1
-  if (pthread_mutex_init(&root_directory_1_mutex, NULL) != 0)
-  {
-    printf("INIT ERROR: root directory 1 mutex init failed\n");
-    exit(1);
-  }
+  int count = 0;
+  char *cursor = value;
+  long long start, end;
+  int consumed;
 
-  // init directory 1
-  if (stat(ROOT_DIRECTORY_1, &st1) == -1)
-  {
-    // created using S_IREAD, S_IWRITE, S_IEXEC (0400 | 0200 | 0100) permission flags
-    int res = mkdir(ROOT_DIRECTORY_1, 0700);
-    if (res != 0)
-    {
-      isRootDirectory1Init = false;
-      isDirectory1Available = false;
-      printf("INIT ERROR: root directory 1 creation failed\n");
-    }
-    else
-    {
-      isRootDirectory1Init = true;
-      isDirectory1Available = true;
-      isDirectory1Fresh = true;
-      printf("INIT: root directory 1 initialization successful\n");
-    }
-  }
-  else
+  while (count < SERVER_UPLOAD_MAX_RANGES && sscanf(cursor, "%lld-%lld%n", &start, &end, &consumed) == 2)
   {
-    isRootDirectory1Init = true;
-    isDirectory1Available = true;
-    isDirectory1Fresh = false;
-    printf("INIT: root directory 1 already exists.\n");
+    // a record that isn't in order can't be trusted at all
+    if (start < 0 || end <= start || (count > 0 && start <= ranges[count - 1].end))
+      return 0;
+
+    ranges[count].start = start;
+    ranges[count].end = end;
+    count++;
+    cursor += consumed;
   }
 
-  // init mutex for directory 2
-  if (pthread_mutex_init(&root_directory_2_mutex, NULL) != 0)
-  {
-    printf("INIT ERROR: root directory 2 mutex init failed\n");
-    exit(1);
-  }
+  return count;
+}
+
+/// @brief Records in a partial file that it holds another stretch of an upload on disk. Must hold upload_mutex, as
+///        PUTs of other ranges of the upload update the same record.
+/// @param fd is the partial file.
+/// @param start is where the stretch starts in the upload.
+/// @param end is where it ends, exclusive.
+/// @return 0 if the record was stored, -1 otherwise (eg. it has no room for another stretch).
+int upload_addRange(int fd, off_t start, off_t end)
+{
+  t_uploadRange ranges[SERVER_UPLOAD_MAX_RANGES + 1];
+  int count = upload_loadRanges(fd, ranges);
+  int merged = 0;
 
-  // init directory 2
-  if (stat(ROOT_DIRECTORY_2, &st2) == -1)
+  // stretches that touch the new one are merged into it, the others stay in order around it
+  for (int i = 0; i < count; i++)
   {
-    // created using S_IREAD, S_IWRITE, S_IEXEC (0400 | 0200 | 0100) permission flags
-    int res = mkdir(ROOT_DIRECTORY_2, 0700);
-    if (res != 0)
-    {
-      isRootDirectory2Init = false;
-      isDirectory2Available = false;
-      printf("INIT ERROR: root directory 2 creation failed\n");
-    }
-    else
+    if (ranges[i].end < start || ranges[i].start > end)
     {
-      isRootDirectory2Init = true;
-      isDirectory2Available = true;
-      isDirectory2Fresh = true;
-      printf("INIT: root directory 2 initialization successful\n");
+      ranges[merged++] = ranges[i];
+      continue;
     }
+
+    start = ranges[i].start < start ? ranges[i].start : start;
+    end = ranges[i].end > end ? ranges[i].end : end;
   }
-  else
+
+  int position = merged;
+  while (position > 0 && ranges[position - 1].start > start)
   {
-    isRootDirectory2Init = true;
-    isDirectory2Available = true;
-    isDirectory2Fresh = false;
-    printf("INIT: root directory 2 already exists.\n");
+    ranges[position] = ranges[position - 1];
+    position--;
   }
+  ranges[position].start = start;
+  ranges[position].end = end;
+  merged++;
 
-  if (!isRootDirectory1Init && !isRootDirectory2Init)
-  {
-    printf("INIT ERROR: both directory 1 and directory 2 init failed\n");
+  if (merged > SERVER_UPLOAD_MAX_RANGES)
     return -1;
+
+  char value[SERVER_UPLOAD_MAX_RANGES * 42 + 1];
+  int length = 0;
+  for (int i = 0; i < merged; i++)
+  {
+    length += snprintf(value + length, sizeof(value) - length, "%s%lld-%lld", i > 0 ? " " : "",
+                       (long long)ranges[i].start, (long long)ranges[i].end);
   }
 
-  if (isRootDirectory1Init && isRootDirectory2Init)
+#ifdef __APPLE__
+  return fsetxattr(fd, SERVER_UPLOAD_RANGES_XATTR, value, length, 0, 0);
+#else
+  return fsetxattr(fd, SERVER_UPLOAD_RANGES_XATTR, value, length, 0);
+#endif
+}
+
+/// @brief Tells how much of an upload a partial file holds on disk without a gap, starting at an offset.
+/// @param fd is the partial file.
+/// @param offset is where to start, in the upload.
+/// @return no. of bytes, 0 if the file doesn't hold the byte at offset.
+off_t upload_coveredLength(int fd, off_t offset)
+{
+  t_uploadRange ranges[SERVER_UPLOAD_MAX_RANGES];
+  int count = upload_loadRanges(fd, ranges);
+
+  for (int i = 0; i < count; i++)
   {
-    if (!isDirectory1Fresh && !isDirectory2Fresh)
-    {
-      printf("INIT: both directory 1 and directory 2 already exist\n");
-    }
-    else if (isDirectory1Fresh && isDirectory2Fresh)
-    {
-      printf("INIT: both directory 1 and directory 2 are fresh\n");
-    }
-    else if (!isDirectory1Fresh && isDirectory2Fresh)
-    {
-      printf("INIT: directory 2 is fresh, cloning directory 1 into directory 2\n");
-      directory_cloneDirectory1IntoDirectory2();
-    }
-    else if (isDirectory1Fresh && !isDirectory2Fresh)
-    {
-      printf("INIT: directory 1 is fresh, cloning directory 2 into directory 1\n");
-      directory_cloneDirectory2IntoDirectory1();
-    }
+    if (ranges[i].start <= offset && offset < ranges[i].end)
+      return ranges[i].end - offset;
   }
 
   return 0;
 }
 
-/// @brief Initialises the server. Creates and binds socket to a port and creates root directory.
-/// @return 0 if process is successful. -1 otherwise.
-int initServer()
+/// @brief Drops the stretches recorded by PUTs of ranges of an upload from its partial file.
+/// @param fd is the partial file.
+void upload_clearRanges(int fd)
 {
-  int status;
-  status = init_createServerSocket();
-  if (status != 0)
-    return -1;
-  status = init_bindServerSocket();
-  if (status != 0)
-    return -1;
-  status = init_createRootDirectory();
-  if (status != 0)
+#ifdef __APPLE__
+  fremovexattr(fd, SERVER_UPLOAD_RANGES_XATTR, 0);
+#else
+  fremovexattr(fd, SERVER_UPLOAD_RANGES_XATTR);
+#endif
+}
+
+/// @brief Drops the records of an upload from its partial file, before the file is renamed into place.
+/// @param fd is the partial file.
+void upload_clearProgress(int fd)
+{
+#ifdef __APPLE__
+  fremovexattr(fd, SERVER_UPLOAD_XATTR, 0);
+#else
+  fremovexattr(fd, SERVER_UPLOAD_XATTR);
+#endif
+  upload_clearRanges(fd);
+}
+
+/// @brief Finds the file a partial file of a PUT is renamed to, eg. "f1/big.dat" for "f1/big.dat.put-partial" or
+///        for "f1/big.dat.9f0c6e1a22b84d07.put-partial" of an upload.
+/// @param temp_path is the partial file, relative to the root directory.
+/// @param destination is filled with the file it becomes.
+/// @param size is the capacity of destination.
+/// @return 0 if the destination was found, -1 if temp_path isn't a partial file of a PUT.
+int upload_destinationPath(const char *temp_path, char *destination, size_t size)
+{
+  size_t length = strlen(temp_path);
+  size_t suffix_length = strlen(SERVER_PUT_TEMP_SUFFIX);
+
+  if (!directory_isPutTempFile(temp_path) || length - suffix_length >= size)
     return -1;
 
+  length -= suffix_length;
+  memcpy(destination, temp_path, length);
+  destination[length] = '\0';
+
+  // an upload is named right before the suffix
+  char *dot = strrchr(destination, '.');
+  if (dot != NULL && dot > destination && dot[-1] != '/' && upload_isValidId(dot + 1))
+    *dot = '\0';
+
   return 0;
 }
 
-#pragma endregion Init
+#pragma endregion Resumable Uploads
 
-#pragma region Directory Management
+#pragma region Directory Availability
 
-/// @brief This method tells whether the root directory 1 is initialzed.
-/// @return True if directory 1 is initialized.
-bool directory_isDirectory1Init()
+/// @brief Changes the availability of a replica.
+/// @param replica is the replica.
+/// @param availability represents the availability for the copy.
+void directory_changeAvailability(t_replica *replica, bool availability)
 {
-  struct stat st = {0};
+  pthread_mutex_lock(&replica_mutex);
 
-  if (isRootDirectory1Init)
-  {
-    // if directory 1 is marked as initialized, check whether it exists
-    if (stat(ROOT_DIRECTORY_1, &st) == 0)
-    {
-      // it exists and is available
-      printf("DIRECTORY: directory 1 is available\n");
-      return true;
-    }
-    else
-    {
-      // directory was marked initialized but isn't available anymore
-      isRootDirectory1Init = false;
+  replica->isAvailable = availability;
 
-      printf("DIRECTORY: directory 1 was marked initialized but isn't available anymore\n");
-      return false;
-    }
-  }
-  else
+  pthread_cond_broadcast(&replica_changed);
+  pthread_mutex_unlock(&replica_mutex);
+}
+
+/// @brief Acquires a replica for a command. Any no. of commands can share it, the paths they
+///        touch are guarded by path locks.
+/// @param replica is the replica.
+void directory_acquireDirectory(t_replica *replica)
+{
+  pthread_rwlock_rdlock(&replica->lock);
+}
+
+/// @brief Releases a replica after a command.
+/// @param replica is the replica.
+void directory_releaseDirectory(t_replica *replica)
+{
+  pthread_rwlock_unlock(&replica->lock);
+}
+
+/// @brief Acquires every replica for cloning one into another, waiting out every running command.
+void directory_acquireAllDirectories()
+{
+  // always in the order of the config file, like commands holding several replicas, so they can't deadlock
+  for (int i = 0; i < replica_count; i++)
   {
-    // directory was marked as not initialized, check whether it exists
-    if (stat(ROOT_DIRECTORY_1, &st) == 0)
-    {
-      // it exists, need to be initialized again
-      printf("DIRECTORY: Directory 1 is available now, cloning from directory 2\n");
+    pthread_rwlock_wrlock(&replicas[i].lock);
+    directory_changeAvailability(&replicas[i], false);
+  }
+}
 
-      struct stat st2 = {0};
+/// @brief Releases every replica after cloning.
+void directory_releaseAllDirectories()
+{
+  for (int i = 0; i < replica_count; i++)
+  {
+    directory_changeAvailability(&replicas[i], true);
+    pthread_rwlock_unlock(&replicas[i].lock);
+  }
+}
 
-      if (isRootDirectory2Init && stat(ROOT_DIRECTORY_2, &st2) == 0)
-      {
-        // clone directory 2 into directory 1
-        printf("DIRECTORY: triggered cloning directory 2 into directory 1\n");
-        directory_cloneDirectory2IntoDirectory1();
+/// @brief Picks the replica a lagging one is brought up to date from: the primary while it is online, as it never
+///        lags behind, otherwise the first online replica.
+/// @param target is the lagging replica, never picked.
+/// @return the replica to copy from, NULL if no other replica is online.
+t_replica *directory_findSourceDirectory(const t_replica *target)
+{
+  if (primary_replica != target && atomic_load(&primary_replica->isInit))
+    return primary_replica;
 
-        isRootDirectory1Init = true;
+  for (int i = 0; i < replica_count; i++)
+  {
+    if (&replicas[i] != target && atomic_load(&replicas[i].isInit))
+      return &replicas[i];
+  }
 
-        return true;
-      }
-      else
-      {
-        // both directories are not available, and we cannot serve any requests
-        printf("DIRECTORY ERROR: root directory 1 and root directory 2 both are unavailable\n");
-        exit(1);
-      }
+  return NULL;
+}
 
-      isRootDirectory1Init = false;
+#pragma endregion Directory Availability
 
-      return true;
-    }
-    else
-    {
-      // directory doesn't exist and is not available
-      printf("DIRECTORY: directory 1 is not available\n");
-      return false;
-    }
+#pragma region Path Locks
+
+// whether a lock in the mode of the row can be granted while one in the mode of the column is held
+const bool path_lockCompatibility[LOCK_MODE_COUNT][LOCK_MODE_COUNT] = {
+    // IS     IX     S      X
+    {true, true, true, false},    // IS
+    {true, true, false, false},   // IX
+    {true, false, true, false},   // S
+    {false, false, false, false}, // X
+};
+
+/// @brief Hashes a path into the lock table.
+/// @param path is the path, relative to the root directory.
+/// @return the bucket of the path.
+unsigned int path_hashPath(const char *path)
+{
+  unsigned int hash = 5381;
+  while (*path)
+  {
+    hash = hash * 33 + (unsigned char)*path++;
   }
+  return hash % SERVER_PATH_LOCK_BUCKETS;
 }
 
-/// @brief This method tells whether the root directory 2 is initialzed.
-/// @return True if directory 2 is initialized.
-bool directory_isDirectory2Init()
+/// @brief Finds the lock state of a path, creating it if nobody holds the path yet. Must hold path_locks_mutex.
+/// @param path is the path, relative to the root directory.
+/// @return the lock state, NULL if out of memory.
+t_pathLock *path_findLock(const char *path)
 {
-  struct stat st = {0};
+  unsigned int bucket = path_hashPath(path);
 
-  if (isRootDirectory2Init)
+  for (t_pathLock *lock = path_locks[bucket]; lock != NULL; lock = lock->next)
   {
-    // if directory 2 is marked as initialized, check whether it exists
-    if (stat(ROOT_DIRECTORY_2, &st) == 0)
-    {
-      // it exists and is available
-      printf("DIRECTORY: directory 2 is available\n");
-      return true;
-    }
-    else
-    {
-      // directory was marked initialized but isn't available anymore
-      isRootDirectory2Init = false;
-
-      printf("DIRECTORY: directory 2 was marked initialized but isn't available anymore\n");
-      return false;
-    }
+    if (strcmp(lock->path, path) == 0)
+      return lock;
   }
-  else
-  {
-    // directory was marked as not initialized, check whether it exists
-    if (stat(ROOT_DIRECTORY_2, &st) == 0)
-    {
-      // it exists, need to be initialized again
-      printf("DIRECTORY: Directory 2 is available now, cloning from directory 1\n");
 
-      struct stat st1 = {0};
+  t_pathLock *lock = calloc(1, sizeof(t_pathLock));
+  if (lock == NULL)
+    return NULL;
 
-      if (isRootDirectory2Init && stat(ROOT_DIRECTORY_1, &st1) == 0)
-      {
-        // clone directory 1 into directory 2
-        printf("DIRECTORY: triggered cloning directory 1 into directory 2\n");
-        directory_cloneDirectory1IntoDirectory2();
+  strncpy(lock->path, path, sizeof(lock->path) - 1);
+  lock->next = path_locks[bucket];
+  path_locks[bucket] = lock;
 
-        isRootDirectory2Init = true;
+  return lock;
+}
 
-        return true;
-      }
-      else
-      {
-        // both directories are not available, and we cannot serve any requests
-        printf("DIRECTORY ERROR: root directory 2 and root directory 1 both are unavailable\n");
-        exit(1);
-      }
-
-      isRootDirectory2Init = false;
+/// @brief Drops a reference to the lock state of a path, freeing it once unused. Must hold path_locks_mutex.
+/// @param lock is the lock state.
+void path_dropLock(t_pathLock *lock)
+{
+  if (--lock->references > 0)
+    return;
 
-      return true;
-    }
-    else
-    {
-      // directory doesn't exist and is not available
-      printf("DIRECTORY: directory 2 is not available\n");
-      return false;
-    }
+  t_pathLock **link = &path_locks[path_hashPath(lock->path)];
+  while (*link != lock)
+  {
+    link = &(*link)->next;
   }
+  *link = lock->next;
+
+  free(lock);
 }
 
-/// @brief This method tells whether the root directory 1 is initialzed.
-/// @return True if directory 1 is initialized.
-bool directory_isDirectory1Available()
+/// @brief Tells whether a mode can be granted on a path right now.
+/// @param lock is the lock state of the path.
+/// @param mode is the mode asked for.
+/// @param isWaitingExclusive is true if the request asking is itself one of the waiting exclusive requests.
+/// @return true if the mode can be granted.
+bool path_isGrantable(const t_pathLock *lock, int mode, bool isWaitingExclusive)
 {
-  bool res;
-  if (!directory_isDirectory1Init())
+  for (int held = 0; held < LOCK_MODE_COUNT; held++)
   {
-    printf("DIRECTORY: directory 1 is not initialized\n");
-    return false;
+    if (lock->holders[held] > 0 && !path_lockCompatibility[mode][held])
+      return false;
   }
-  else
-  {
-    pthread_mutex_lock(&root_directory_1_availability_mutex);
 
-    res = isDirectory1Available;
+  // writers waiting for this path go first, new readers queue up behind them
+  if (!isWaitingExclusive && lock->waiting_exclusive > 0 && mode != LOCK_MODE_EXCLUSIVE)
+    return false;
+
+  return true;
+}
+
+/// @brief Locks a path, and every directory on the way to it in the matching intent mode. All locks are granted
+///        together, so commands locking overlapping paths can't deadlock each other.
+/// @param path is the path, relative to the root directory.
+/// @param mode is LOCK_MODE_SHARED for reading the path or LOCK_MODE_EXCLUSIVE for changing it.
+/// @param set is filled with the locks held, to be passed to path_unlock.
+/// @return 0 if the path is locked, -1 otherwise, also for a path with a ".." in it.
+int path_lock(const char *path, int mode, t_pathLockSet *set)
+{
+  // "", "f1", "f1/f2", "f1/f2/h.txt" for "f1/f2/h.txt", leading/duplicate/trailing slashes and "./" are ignored
+  char prefixes[SERVER_MAX_PATH_DEPTH + 1][SERVER_PATH_SIZE];
+  int count = 1;
+  prefixes[0][0] = '\0';
+
+  char normalized[SERVER_PATH_SIZE];
+  int length = 0;
+  const char *cursor = path;
+
+  while (*cursor != '\0')
+  {
+    while (*cursor == '/')
+      cursor++;
 
-    pthread_mutex_unlock(&root_directory_1_availability_mutex);
+    const char *end = cursor;
+    while (*end != '\0' && *end != '/')
+      end++;
 
-    if (res)
+    int component = end - cursor;
+    if (component == 0 || (component == 1 && cursor[0] == '.'))
     {
-      printf("AVAILABILITY: Directory 1 is available\n");
+      cursor = end;
+      continue;
     }
-    else
+
+    // "x/../f.txt" is "f.txt" on disk but would lock another key, and could reach outside the root or into the store
+    if (component == 2 && cursor[0] == '.' && cursor[1] == '.')
+      return -1;
+
+    if (length + component + 1 >= SERVER_PATH_SIZE)
+      return -1;
+
+    if (length > 0)
+      normalized[length++] = '/';
+    memcpy(normalized + length, cursor, component);
+    length += component;
+    normalized[length] = '\0';
+
+    // too deep to track every level, the deepest tracked directory stands in for the rest of the path
+    if (count <= SERVER_MAX_PATH_DEPTH)
     {
-      printf("AVAILABILITY: Directory 1 is not available\n");
+      strcpy(prefixes[count], normalized);
+      count++;
     }
 
-    return res;
+    cursor = end;
   }
-}
 
-/// @brief This method tells whether the root directory 2 is available.
-/// @return True if directory 2 is available.
-bool directory_isDirectory2Available()
-{
-  bool res;
-  if (!directory_isDirectory2Init())
-  {
-    printf("DIRECTORY: directory 2 is not intialized\n");
-    return false;
-  }
-  else
+  int intent = mode == LOCK_MODE_EXCLUSIVE ? LOCK_MODE_INTENT_EXCLUSIVE : LOCK_MODE_INTENT_SHARED;
+
+  pthread_mutex_lock(&path_locks_mutex);
+
+  set->count = 0;
+  for (int i = 0; i < count; i++)
   {
-    pthread_mutex_lock(&root_directory_2_availability_mutex);
+    t_pathLock *lock = path_findLock(prefixes[i]);
+    if (lock == NULL)
+    {
+      for (int j = 0; j < set->count; j++)
+        path_dropLock(set->locks[j]);
+      pthread_mutex_unlock(&path_locks_mutex);
 
-    res = isDirectory2Available;
+      printf("PATH LOCK ERROR: Couldn't allocate memory for lock on %s\n", prefixes[i]);
+      return -1;
+    }
 
-    pthread_mutex_unlock(&root_directory_2_availability_mutex);
+    lock->references++;
+    set->locks[i] = lock;
+    set->modes[i] = i == count - 1 ? mode : intent;
+    set->count++;
+  }
 
-    if (res)
+  bool isWaiting = false;
+  while (true)
+  {
+    bool isGrantable = true;
+    for (int i = 0; i < set->count && isGrantable; i++)
     {
-      printf("AVAILABILITY: Directory 2 is available\n");
+      isGrantable = path_isGrantable(set->locks[i], set->modes[i], isWaiting);
     }
-    else
+
+    if (isGrantable)
+      break;
+
+    if (!isWaiting && mode == LOCK_MODE_EXCLUSIVE)
     {
-      printf("AVAILABILITY: Directory 2 is not available\n");
+      isWaiting = true;
+      set->locks[set->count - 1]->waiting_exclusive++;
     }
 
-    return res;
+    printf("PATH LOCK: waiting for /%s\n", prefixes[count - 1]);
+    pthread_cond_wait(&path_locks_released, &path_locks_mutex);
   }
-}
-
-#pragma endregion Directory Management
-
-#pragma region Communication
 
-/// @brief Sends a message to the client.
-/// @param client_sock is the socket of the client the message is to be sent to.
-/// @param server_message represents the server message.
-void server_sendMessageToClient(int client_sock, char *server_message)
-{
-  // printf("SENDING TO CLIENT: %s\n", server_message);
-  if (send(client_sock, server_message, strlen(server_message), 0) < 0)
+  if (isWaiting)
   {
-    printf("ERROR: Can't send\n");
-    server_closeServerSocket();
+    set->locks[set->count - 1]->waiting_exclusive--;
+  }
+  for (int i = 0; i < set->count; i++)
+  {
+    set->locks[i]->holders[set->modes[i]]++;
   }
+
+  pthread_mutex_unlock(&path_locks_mutex);
+
+  return 0;
 }
 
-/// @brief Receives a message from the client.
-/// @param client_sock is the socket of the client the message is to be received from.
-/// @param client_message represents the received client message.
-void server_recieveMessageFromClient(int client_sock, char *client_message)
+/// @brief Releases the locks taken by path_lock.
+/// @param set represents the locks held.
+void path_unlock(t_pathLockSet *set)
 {
-  // Receive the server's response:
-  if (recv(client_sock, client_message, CODE_SIZE + CODE_PADDING + CLIENT_MESSAGE_SIZE, 0) < 0)
+  pthread_mutex_lock(&path_locks_mutex);
+
+  for (int i = 0; i < set->count; i++)
   {
-    printf("ERROR: Error while receiving client's msg\n");
-    server_closeServerSocket();
+    set->locks[i]->holders[set->modes[i]]--;
+    path_dropLock(set->locks[i]);
   }
+  set->count = 0;
 
-  // printf("RECIEVED FROM CLIENT: %s\n", client_message);
+  pthread_cond_broadcast(&path_locks_released);
+  pthread_mutex_unlock(&path_locks_mutex);
 }
 
-#pragma endregion Communication
+#pragma endregion Path Locks
 
-#pragma region Helpers
+#pragma region Mirror Rebuild
 
-/// @brief Checks the existence of a directory in the server space.
-/// @param path represents the directory path that needs to be examined for existence.
-/// @return true if the directory exists, false otherwise.
-bool directory_isDirectoryExists(const char *path)
+/// @brief Creates every missing directory on the way to a path, like mkdir -p.
+/// @param path is the full path of the file or directory.
+void rebuild_makeParentDirectories(const char *path)
 {
-  struct stat stats;
-
-  stat(path, &stats);
-
-  // Check for file existence
-  if (S_ISDIR(stats.st_mode))
-    return true;
-
-  return false;
-}
+  char partial[400];
+  strncpy(partial, path, sizeof(partial) - 1);
+  partial[sizeof(partial) - 1] = '\0';
 
-/// @brief Checks the existence of a file.
-/// @param filename represents the file path that needs to be checked.
-/// @return true if the file exists, false otherwise.
-bool directory_isFileExists(const char *filename)
-{
-  FILE *fp = fopen(filename, "r");
-  bool is_exist = false;
-  if (fp != NULL)
+  for (char *cursor = partial + 1; *cursor != '\0'; cursor++)
   {
-    is_exist = true;
-    fclose(fp); // close the file
+    if (*cursor == '/')
+    {
+      *cursor = '\0';
+      mkdir(partial, 0700);
+      *cursor = '/';
+    }
   }
-  return is_exist;
 }
 
-/// @brief Unlinks and removes a file.
-/// @param fpath represents the path of file/directory.
-/// @param sb buffer for stat command inside nftw command.
-/// @param typeflag type for nftw command.
-/// @param ftwbuf buffer for nftw command.
-/// @return 0 if successful.
-int directory_unlinkFile(const char *fpath, const struct stat *sb, int typeflag, struct FTW *ftwbuf)
+/// @brief Copies one file between replicas, keeping its permissions and times like cp -p. The kernel copies
+///        the contents itself where it can, without passing them through the server.
+/// @param source_path is the full path of the file copied.
+/// @param target_path is the full path of the copy.
+/// @param bytes_copied is increased by the size of the file, may be NULL.
+/// @return 0 if successful, -1 otherwise.
+int rebuild_copyFile(const char *source_path, const char *target_path, long long *bytes_copied)
 {
-  int rv = remove(fpath);
-
-  if (rv)
-    perror(fpath);
-
-  return rv;
-}
+  int source_fd = open(source_path, O_RDONLY);
+  if (source_fd < 0)
+    return -1;
 
-/// @brief Removes a directory recursively.
-/// @param path is the path of the directory to be removed.
-/// @return 0 if successful.
-int directory_removeDirectoryRecursively(char *path)
-{
-  return nftw(path, directory_unlinkFile, 64, FTW_DEPTH | FTW_PHYS);
-}
+  // the mode, the length copied and the times all come from it
+  struct stat source_stat;
+  if (fstat(source_fd, &source_stat) != 0)
+  {
+    close(source_fd);
+    return -1;
+  }
 
-#pragma endregion Helpers
+  int target_fd = open(target_path, O_WRONLY | O_CREAT | O_TRUNC, source_stat.st_mode & 0777);
+  if (target_fd < 0)
+  {
+    close(source_fd);
+    return -1;
+  }
 
-#pragma region Commands
+  int status = 0;
+  off_t copied = 0;
 
-/// @brief To receive a file from client to the server.
-/// @param remote_file_path represents the path in server space where the received file needs to be stored.
-void command_get(int client_sock, char *remote_file_path)
-{
-  printf("COMMAND: GET started\n");
+#ifdef __linux__
+  while (copied < source_stat.st_size)
+  {
+    ssize_t bytes = copy_file_range(source_fd, NULL, target_fd, NULL, source_stat.st_size - copied, 0);
+    if (bytes < 0 && errno == EINTR)
+      continue;
+    if (bytes <= 0)
+      break;
 
-  FILE *remote_file;
+    copied += bytes;
+  }
+#endif
 
-  char response_message[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
-  memset(response_message, 0, sizeof(response_message));
+  // copy_file_range is unavailable (eg. across file systems on older kernels), or the file grew while copying
+  if (copied > 0)
+    lseek(source_fd, copied, SEEK_SET);
 
-  // setup available directories and respective target file paths
-  char actual_path[200];
-  int targetDirectory = 0;
+  char buffer[64 * 1024];
+  ssize_t bytes_read;
 
-  // wait until one of the directories becomes available
-  while (true)
+  while ((bytes_read = read(source_fd, buffer, sizeof(buffer))) > 0)
   {
-    if (directory_isDirectory1Available())
+    if (write(target_fd, buffer, bytes_read) != bytes_read)
     {
-      directory_acquireDirectory1();
-
-      printf("GET: Directory 1 is acquired\n");
-      strcpy(actual_path, ROOT_DIRECTORY_1);
-      targetDirectory = 1;
+      status = -1;
       break;
     }
-    else if (directory_isDirectory2Available())
-    {
-      directory_acquireDirectory2();
+    copied += bytes_read;
+  }
+  if (bytes_read < 0)
+    status = -1;
 
-      printf("GET: Directory 2 is acquired\n");
-      strcpy(actual_path, ROOT_DIRECTORY_2);
+  fchmod(target_fd, source_stat.st_mode & 0777);
+  checksum_copy(source_fd, target_fd);
 
-      targetDirectory = 2;
-      break;
-    }
-    else
-    {
-      printf("GET: Waiting for available directory\n");
-    }
-  }
+#ifdef __APPLE__
+  struct timespec times[2] = {source_stat.st_atimespec, source_stat.st_mtimespec};
+#else
+  struct timespec times[2] = {source_stat.st_atim, source_stat.st_mtim};
+#endif
+  futimens(target_fd, times);
 
-  // we have a directory available, start prep to read
-  strncat(actual_path, remote_file_path, strlen(remote_file_path));
+  close(source_fd);
+  close(target_fd);
 
-  remote_file = fopen(actual_path, "r");
-  printf("GET: Looking for file: %s\n", actual_path);
+  if (bytes_copied != NULL)
+    *bytes_copied += copied;
 
-  // Check if the file exists on the server
-  if (remote_file == NULL)
+  return status;
+}
+
+/// @brief Removes entries from a directory of the stale replica that the healthy replica doesn't have.
+/// @param source_path is the full path of the directory on the healthy replica.
+/// @param target_path is the full path of the directory on the stale replica.
+void rebuild_removeStaleEntries(const char *source_path, const char *target_path)
+{
+  DIR *target_dir = opendir(target_path);
+  if (target_dir == NULL)
+    return;
+
+  struct dirent *entry;
+  while ((entry = readdir(target_dir)) != NULL)
   {
-    // file doesn't exist
-    printf("GET ERROR: File not found on server\n");
+    // a PUT may be writing into the directory right now, its temporary file is none of the rebuild's business
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 || directory_isPutTempFile(entry->d_name))
+      continue;
 
-    strcat(response_message, "E:404 ");
-    strcat(response_message, "File not found on server");
+    char source_entry[800], target_entry[800];
+    struct stat entry_stat;
+    snprintf(source_entry, sizeof(source_entry), "%s/%s", source_path, entry->d_name);
+    snprintf(target_entry, sizeof(target_entry), "%s/%s", target_path, entry->d_name);
 
-    server_sendMessageToClient(client_sock, response_message);
+    if (lstat(source_entry, &entry_stat) != 0)
+    {
+      directory_removeDirectoryRecursively(target_entry);
+    }
   }
-  else
-  {
-    // File found on server
-    printf("GET: File Found on server\n");
 
-    // Send success response to client
-    strcat(response_message, "S:200 ");
-    strcat(response_message, "File found on server");
+  closedir(target_dir);
+}
 
-    server_sendMessageToClient(client_sock, response_message);
-    memset(response_message, 0, sizeof(response_message));
+/// @brief Queues a directory for the rebuild workers. Must hold the rebuild mutex.
+/// @param rebuild represents the rebuild.
+/// @param path is the directory, relative to the root directory, "" for the root itself.
+/// @return 0 if queued, -1 if out of memory.
+int rebuild_pushDirectory(t_rebuild *rebuild, const char *path)
+{
+  if (rebuild->queue_count == rebuild->queue_capacity)
+  {
+    int capacity = rebuild->queue_capacity > 0 ? rebuild->queue_capacity * 2 : 64;
+    char **queue = realloc(rebuild->queue, capacity * sizeof(char *));
+    if (queue == NULL)
+      return -1;
 
-    // recieve client's first response
-    char client_message[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
-    memset(client_message, '\0', sizeof(client_message));
+    rebuild->queue = queue;
+    rebuild->queue_capacity = capacity;
+  }
 
-    server_recieveMessageFromClient(client_sock, client_message);
+  char *copy = strdup(path);
+  if (copy == NULL)
+    return -1;
 
-    if (strncmp(client_message, "S:100", CODE_SIZE) == 0)
-    {
-      // Client said we can start sending the file
-      // Send file data to client
-      printf("GET: Client hinted at sending file contents.\n");
-      char buffer[SERVER_MESSAGE_SIZE - 1];
-      memset(buffer, 0, sizeof(buffer));
-      int bytes_read;
+  rebuild->queue[rebuild->queue_count++] = copy;
+  pthread_cond_signal(&rebuild->changed);
 
-      while (true)
-      {
-        if (strncmp(client_message, "S:100", CODE_SIZE) != 0)
-        {
-          printf("GET ERROR: stopped abruptly because client is not accepting data anymore\n");
-          break;
-        }
+  return 0;
+}
 
-        if ((bytes_read = fread(buffer, sizeof(char), SERVER_MESSAGE_SIZE - 1, remote_file)) > 0)
-        {
-          // printf("BUFFER: %s \n", buffer);
-          printf("GET: Continue\n");
-          memset(response_message, 0, sizeof(response_message));
+/// @brief Copies one directory of the tree: files are copied, sub directories are created and queued for any
+///        worker to pick up, and entries the healthy replica no longer has are removed.
+/// @param rebuild represents the rebuild.
+/// @param path is the directory, relative to the root directory.
+void rebuild_copyDirectory(t_rebuild *rebuild, const char *path)
+{
+  char source_path[400];
+  char target_path[400];
+  snprintf(source_path, sizeof(source_path), "%s%s", rebuild->source_root, path);
+  snprintf(target_path, sizeof(target_path), "%s%s", rebuild->target_root, path);
 
-          strcat(response_message, "S:206 ");
-          strncat(response_message, buffer, bytes_read);
+  rebuild_removeStaleEntries(source_path, target_path);
 
-          memset(buffer, 0, sizeof(buffer));
+  DIR *source_dir = opendir(source_path);
+  if (source_dir == NULL)
+  {
+    printf("REBUILD ERROR: couldn't open %s\n", source_path);
 
-          server_sendMessageToClient(client_sock, response_message);
+    pthread_mutex_lock(&rebuild->mutex);
+    rebuild->errors++;
+    pthread_mutex_unlock(&rebuild->mutex);
+    return;
+  }
 
-          memset(client_message, '\0', sizeof(client_message));
+  long files_copied = 0;
+  long long bytes_copied = 0;
+  int errors = 0;
 
-          server_recieveMessageFromClient(client_sock, client_message);
-        }
-        else
-        {
-          // Reached end of file, tell client we are done sending stuff
-          printf("GET: reached end of file\n");
+  struct dirent *entry;
+  while ((entry = readdir(source_dir)) != NULL)
+  {
+    // a PUT in progress renames its file into place itself, half a file is no use to the copy
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 || directory_isPutTempFile(entry->d_name))
+      continue;
 
-          memset(response_message, 0, sizeof(response_message));
+    char relative_path[SERVER_PATH_SIZE * 2];
+    char source_entry[800], target_entry[800];
+    struct stat entry_stat;
 
-          strcat(response_message, "S:200 ");
-          strcat(response_message, "File sent successfully");
+    snprintf(relative_path, sizeof(relative_path), "%s%s%s", path, path[0] == '\0' ? "" : "/", entry->d_name);
+    snprintf(source_entry, sizeof(source_entry), "%s%s", rebuild->source_root, relative_path);
+    snprintf(target_entry, sizeof(target_entry), "%s%s", rebuild->target_root, relative_path);
 
-          server_sendMessageToClient(client_sock, response_message);
-          break;
-        }
-      }
-    }
-    else
+    if (lstat(source_entry, &entry_stat) != 0)
+      continue;
+
+    if (S_ISDIR(entry_stat.st_mode))
     {
-      // The client is not accepting data
-      memset(response_message, 0, sizeof(response_message));
+      struct stat target_stat;
+      if (lstat(target_entry, &target_stat) == 0 && !S_ISDIR(target_stat.st_mode))
+        directory_removeDirectoryRecursively(target_entry);
 
-      strcat(response_message, "E:500 ");
-      strcat(response_message, "The client did not agree to receive the file contents.");
+      mkdir(target_entry, entry_stat.st_mode & 0777);
 
-      server_sendMessageToClient(client_sock, response_message);
+      pthread_mutex_lock(&rebuild->mutex);
+      if (rebuild_pushDirectory(rebuild, relative_path) != 0)
+        errors++;
+      pthread_mutex_unlock(&rebuild->mutex);
+    }
+    else if (S_ISREG(entry_stat.st_mode))
+    {
+      struct stat target_stat;
+      if (lstat(target_entry, &target_stat) == 0 && S_ISDIR(target_stat.st_mode))
+        directory_removeDirectoryRecursively(target_entry);
 
-      printf("GET: The client did not agree to receive the file contents.\n");
+      if (rebuild_copyFile(source_entry, target_entry, &bytes_copied) != 0)
+      {
+        printf("REBUILD ERROR: couldn't copy %s\n", source_entry);
+        errors++;
+      }
+      files_copied++;
     }
   }
 
-  // release the directory which we are using for this command
-  fclose(remote_file);
-  if (targetDirectory == 1)
-  {
-    directory_releaseDirectory1();
-  }
-  else if (targetDirectory == 2)
-  {
-    directory_releaseDirectory2();
-  }
-  else
+  closedir(source_dir);
+
+  pthread_mutex_lock(&rebuild->mutex);
+
+  rebuild->files_copied += files_copied;
+  rebuild->bytes_copied += bytes_copied;
+  rebuild->errors += errors;
+
+  // progress at most once a second
+  time_t now = time(NULL);
+  if (now != rebuild->last_report)
   {
-    printf("GET ERROR: Unlocking directory mutex - No Directory is available\n");
+    rebuild->last_report = now;
+    printf("REBUILD: %ld files, %lld bytes copied into %s, %d directories queued\n",
+           rebuild->files_copied, rebuild->bytes_copied, rebuild->target_root, rebuild->queue_count);
   }
 
-  printf("COMMAND: GET complete\n\n");
+  pthread_mutex_unlock(&rebuild->mutex);
 }
 
-/// @brief Gives the relevant information for a file.
-/// @param client_sock is the socket of the client which is requesting the information.
-/// @param remote_file_path is the path of the file whose information is requested.
-void command_info(int client_sock, char *remote_file_path)
+/// @brief Body of every rebuild worker. Takes directories off the queue until the whole tree is copied.
+/// @param rebuild_arg represents the rebuild.
+/// @return NULL when the tree is copied.
+void *rebuild_runWorker(void *rebuild_arg)
 {
-  printf("COMMAND: INFO started\n");
+  t_rebuild *rebuild = rebuild_arg;
 
-  // setup available directories and respective target file paths
-  char actual_path[200];
-  int targetDirectory = 0;
+  pthread_mutex_lock(&rebuild->mutex);
 
-  // wait for a directory to become available
   while (true)
   {
-    if (directory_isDirectory1Available())
+    // the tree is done once nothing is queued and nobody is reading a directory that could queue more
+    while (rebuild->queue_count == 0 && rebuild->active > 0)
     {
-      directory_acquireDirectory1();
-
-      printf("INFO: Directory 1 is acquired\n");
-      strcpy(actual_path, ROOT_DIRECTORY_1);
-      targetDirectory = 1;
-      break;
+      pthread_cond_wait(&rebuild->changed, &rebuild->mutex);
     }
-    else if (directory_isDirectory2Available())
-    {
-      directory_acquireDirectory2();
+    if (rebuild->queue_count == 0)
+      break;
 
-      printf("INFO: Directory 2 is acquired\n");
-      strcpy(actual_path, ROOT_DIRECTORY_2);
+    char *path = rebuild->queue[--rebuild->queue_count];
+    rebuild->active++;
 
-      targetDirectory = 2;
-      break;
-    }
-    else
-    {
-      printf("INFO: Waiting for available directory\n");
-    }
-  }
+    pthread_mutex_unlock(&rebuild->mutex);
 
-  // we have a directory available, start prep to read
-  strncat(actual_path, remote_file_path, strlen(remote_file_path));
+    rebuild_copyDirectory(rebuild, path);
+    free(path);
 
-  printf("INFO: actual path: %s\n", actual_path);
+    pthread_mutex_lock(&rebuild->mutex);
 
-  char response_message[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
-  memset(response_message, 0, sizeof(response_message));
+    rebuild->active--;
+    if (rebuild->queue_count == 0 && rebuild->active == 0)
+      pthread_cond_broadcast(&rebuild->changed);
+  }
 
-  if (!directory_isDirectoryExists(actual_path) && !directory_isFileExists(actual_path))
-  {
-    // directory doesn't exist
-    printf("INFO: Directory/File doesn't exist\n");
+  pthread_mutex_unlock(&rebuild->mutex);
 
-    strcat(response_message, "E:404 ");
-    strcat(response_message, "Directory/File doesn't exist");
+  return NULL;
+}
 
-    server_sendMessageToClient(client_sock, response_message);
+/// @brief Copies the whole tree of one root directory into another with SERVER_REBUILD_THREADS threads, leaving
+///        the target identical to the source. Takes no replica locks, callers decide what may run alongside.
+/// @param source_root is the root directory copied from.
+/// @param target_root is the root directory copied into.
+/// @return 0 if everything was copied, -1 otherwise.
+int rebuild_copyTree(const char *source_root, const char *target_root)
+{
+  t_rebuild rebuild;
+  memset(&rebuild, 0, sizeof(rebuild));
+  rebuild.source_root = source_root;
+  rebuild.target_root = target_root;
+  pthread_mutex_init(&rebuild.mutex, NULL);
+  pthread_cond_init(&rebuild.changed, NULL);
+
+  struct timespec started;
+  clock_gettime(CLOCK_MONOTONIC, &started);
+
+  printf("REBUILD: copying %s into %s\n", source_root, target_root);
+
+  rebuild_pushDirectory(&rebuild, "");
+
+  pthread_t workers[SERVER_REBUILD_THREADS];
+  int worker_count = 0;
+
+  for (int i = 0; i < SERVER_REBUILD_THREADS; i++)
+  {
+    if (pthread_create(&workers[worker_count], NULL, rebuild_runWorker, &rebuild) == 0)
+      worker_count++;
   }
-  else
+
+  // without any thread to help, copy on this one
+  if (worker_count == 0)
+    rebuild_runWorker(&rebuild);
+
+  for (int i = 0; i < worker_count; i++)
   {
-    // directory exists
-    printf("INFO: Directory/File exists\n");
+    pthread_join(workers[i], NULL);
+  }
 
-    struct stat sb;
+  printf("REBUILD: copied %ld files, %lld bytes into %s in %.2f s with %d errors\n", rebuild.files_copied,
+         rebuild.bytes_copied, target_root, server_millisecondsSince(&started) / 1000.0, rebuild.errors);
 
-    if (stat(actual_path, &sb) == -1)
-    {
-      // Info retrieval failed
-      printf("INFO ERROR: Directory/File Information Retrieval failed\n");
-      perror("stat");
+  free(rebuild.queue);
+  pthread_mutex_destroy(&rebuild.mutex);
+  pthread_cond_destroy(&rebuild.changed);
 
-      strcat(response_message, "E:406 ");
-      strcat(response_message, "Directory/File Information Retrieval failed");
+  return rebuild.errors == 0 ? 0 : -1;
+}
 
-      server_sendMessageToClient(client_sock, response_message);
-    }
-    else
-    {
-      // We found the information of the directory/file
-      printf("INFO: Directory/File Information Retrieval successful\n");
+#pragma endregion Mirror Rebuild
 
-      strcat(response_message, "S:200 Information Retrieval successful\n");
-      char temp[2000];
-      memset(temp, '\0', sizeof(temp));
+#pragma region Directory Cloning
 
-      sprintf(temp, "Ownership:                UID=%ld   GID=%ld\n", (long)sb.st_uid, (long)sb.st_gid);
-      strcat(response_message, temp);
-      sprintf(temp, "File size:                %lld bytes\n", (long long)sb.st_size);
-      strcat(response_message, temp);
-      sprintf(temp, "Last file access:         %s", ctime(&sb.st_atime));
-      strcat(response_message, temp);
-      sprintf(temp, "Last file modification:   %s", ctime(&sb.st_mtime));
-      strcat(response_message, temp);
+/// @brief Clones one replica into another.
+/// @param source is the replica copied.
+/// @param target is the replica the copy is written into.
+void directory_cloneDirectory(t_replica *source, t_replica *target)
+{
+  directory_acquireAllDirectories();
 
-      server_sendMessageToClient(client_sock, response_message);
-    }
-  }
+  printf("DIRECTORY CLONING: starting cloning root directory %d into root directory %d\n", source->id, target->id);
+  rebuild_copyTree(source->root, target->root);
 
-  // release the directory we had acquired for this command
-  if (targetDirectory == 1)
+  directory_releaseAllDirectories();
+  printf("DIRECTORY CLONING: cloning complete for root directory %d into root directory %d\n", source->id, target->id);
+}
+
+#pragma endregion Directory Cloning
+
+#pragma region Chunk Store
+
+// SHA-256 round constants
+const uint32_t sha256_rounds[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+#define SHA256_ROTATE(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/// @brief Mixes one 64 byte block into a SHA-256 state.
+/// @param state is the state, updated in place.
+/// @param block is the block.
+void dedup_sha256Block(uint32_t state[8], const unsigned char *block)
+{
+  uint32_t w[64];
+
+  for (int i = 0; i < 16; i++)
   {
-    directory_releaseDirectory1();
+    w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 | (uint32_t)block[4 * i + 2] << 8 |
+           (uint32_t)block[4 * i + 3];
   }
-  else if (targetDirectory == 2)
+  for (int i = 16; i < 64; i++)
   {
-    directory_releaseDirectory2();
+    uint32_t s0 = SHA256_ROTATE(w[i - 15], 7) ^ SHA256_ROTATE(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    uint32_t s1 = SHA256_ROTATE(w[i - 2], 17) ^ SHA256_ROTATE(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = w[i - 16] + s0 + w[i - 7] + s1;
   }
-  else
+
+  uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+  uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+  for (int i = 0; i < 64; i++)
   {
-    printf("INFO ERROR: Unlocking directory mutex - No Directory is available\n");
+    uint32_t t1 = h + (SHA256_ROTATE(e, 6) ^ SHA256_ROTATE(e, 11) ^ SHA256_ROTATE(e, 25)) + ((e & f) ^ (~e & g)) +
+                  sha256_rounds[i] + w[i];
+    uint32_t t2 = (SHA256_ROTATE(a, 2) ^ SHA256_ROTATE(a, 13) ^ SHA256_ROTATE(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
   }
 
-  printf("COMMAND: INFO complete\n\n");
+  state[0] += a;
+  state[1] += b;
+  state[2] += c;
+  state[3] += d;
+  state[4] += e;
+  state[5] += f;
+  state[6] += g;
+  state[7] += h;
 }
 
-/// @brief Creates a directory in the server.
-/// @param client_sock represents the socket of the client that is requesting the command.
-/// @param folder_path represents the path of the directory to be created.
-void command_makeDirectory(int client_sock, char *folder_path)
+/// @brief Computes the SHA-256 of a chunk, the name it is stored under.
+/// @param data is the chunk.
+/// @param length is the no. of bytes in the chunk.
+/// @param digest is filled with the SHA-256.
+void dedup_sha256(const void *data, size_t length, unsigned char digest[SHA256_SIZE])
 {
-  printf("COMMAND: MD started\n");
+  uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  const unsigned char *cursor = data;
+  size_t remaining = length;
 
-  // setup available directories and respective target file paths
-  char actual_path1[200];
-  char actual_path2[200];
+  for (; remaining >= 64; cursor += 64, remaining -= 64)
+  {
+    dedup_sha256Block(state, cursor);
+  }
 
-  // acquire directories for this command
-  if (directory_isDirectory1Init())
+  // what is left, a 1 bit, zeros and the length in bits fill one or two more blocks
+  unsigned char tail[128] = {0};
+  size_t tail_length = remaining < 56 ? 64 : 128;
+  uint64_t bits = (uint64_t)length * 8;
+
+  memcpy(tail, cursor, remaining);
+  tail[remaining] = 0x80;
+  for (int i = 0; i < 8; i++)
   {
-    directory_acquireDirectory1();
+    tail[tail_length - 1 - i] = (unsigned char)(bits >> (8 * i));
+  }
 
-    printf("MD: Directory 1 is acquired\n");
+  dedup_sha256Block(state, tail);
+  if (tail_length == 128)
+    dedup_sha256Block(state, tail + 64);
 
-    strcpy(actual_path1, ROOT_DIRECTORY_1);
-    strncat(actual_path1, folder_path, strlen(folder_path));
+  for (int i = 0; i < 8; i++)
+  {
+    digest[4 * i] = state[i] >> 24;
+    digest[4 * i + 1] = state[i] >> 16;
+    digest[4 * i + 2] = state[i] >> 8;
+    digest[4 * i + 3] = state[i];
+  }
+}
 
-    printf("MD: actual path: %s\n", actual_path1);
+/// @brief Spells out a SHA-256 in hex.
+/// @param hash is the SHA-256.
+/// @param hex is filled with 2 * SHA256_SIZE hex digits and a NUL.
+void dedup_formatHash(const unsigned char hash[SHA256_SIZE], char hex[2 * SHA256_SIZE + 1])
+{
+  for (int i = 0; i < SHA256_SIZE; i++)
+  {
+    sprintf(hex + 2 * i, "%02x", hash[i]);
   }
+}
 
-  if (directory_isDirectory2Init())
+/// @brief Reads a SHA-256 spelt out in hex, as in manifests and chunk names.
+/// @param hex is the hex digits, only the first 2 * SHA256_SIZE are read.
+/// @param hash is filled with the SHA-256.
+/// @return 0 if successful, -1 if hex doesn't start with a SHA-256.
+int dedup_parseHash(const char *hex, unsigned char hash[SHA256_SIZE])
+{
+  for (int i = 0; i < SHA256_SIZE; i++)
   {
-    directory_acquireDirectory2();
+    unsigned int byte;
+    if (!isxdigit((unsigned char)hex[2 * i]) || !isxdigit((unsigned char)hex[2 * i + 1]) ||
+        sscanf(hex + 2 * i, "%2x", &byte) != 1)
+      return -1;
+
+    hash[i] = byte;
+  }
 
-    printf("MD: Directory 2 is acquired\n");
+  return 0;
+}
 
-    strcpy(actual_path2, ROOT_DIRECTORY_2);
-    strncat(actual_path2, folder_path, strlen(folder_path));
+/// @brief Builds the path a chunk is stored at on a replica.
+/// @param root is the root directory of the replica.
+/// @param hash is the SHA-256 of the chunk.
+/// @param path is filled with the full path of the chunk.
+/// @param size is the size of path.
+void dedup_chunkPath(const char *root, const unsigned char hash[SHA256_SIZE], char *path, size_t size)
+{
+  char hex[2 * SHA256_SIZE + 1];
+  dedup_formatHash(hash, hex);
 
-    printf("MD: actual path: %s\n", actual_path2);
-  }
+  // spread over 256 directories, so none of them grows too large to search
+  snprintf(path, size, "%s%s/%.2s/%s", root, SERVER_CHUNK_DIRECTORY, hex, hex);
+}
+
+/// @brief Tells whether a path a client gave lies in the chunk store, which only the server may touch.
+/// @param path is the path, relative to the root directory.
+/// @return true if the path is SERVER_CHUNK_DIRECTORY or below it.
+bool dedup_isStorePath(const char *path)
+{
+  // skip leading slashes and "./" like path_lock does
+  while (*path == '/' || (path[0] == '.' && (path[1] == '/' || path[1] == '\0')))
+    path++;
+
+  size_t length = strlen(SERVER_CHUNK_DIRECTORY);
+
+  return strncmp(path, SERVER_CHUNK_DIRECTORY, length) == 0 && (path[length] == '\0' || path[length] == '/');
+}
+
+/// @brief Registers a write that may refer to chunks already in the store, so a collection doesn't remove them.
+/// @return the epoch of the write, to be passed to dedup_endWrite.
+int dedup_beginWrite()
+{
+  pthread_mutex_lock(&chunk_store.mutex);
+
+  int epoch = chunk_store.epoch;
+  chunk_store.writers[epoch & 1]++;
+
+  pthread_mutex_unlock(&chunk_store.mutex);
+
+  return epoch;
+}
+
+/// @brief Ends a write registered with dedup_beginWrite.
+/// @param epoch is the epoch of the write.
+void dedup_endWrite(int epoch)
+{
+  pthread_mutex_lock(&chunk_store.mutex);
+
+  if (--chunk_store.writers[epoch & 1] == 0)
+    pthread_cond_broadcast(&chunk_store.isDrained);
+
+  pthread_mutex_unlock(&chunk_store.mutex);
+}
 
-  // both directories are not initialized, quit program
-  if (!isRootDirectory1Init && !isRootDirectory2Init)
+/// @brief Starts a new epoch for a collection and waits for every write of the previous one to finish.
+/// @return when the epoch started, chunks touched since then are in use.
+time_t dedup_startCollection()
+{
+  pthread_mutex_lock(&chunk_store.mutex);
+
+  int previous = chunk_store.epoch++;
+  time_t started = time(NULL);
+
+  while (chunk_store.writers[previous & 1] > 0)
   {
-    printf("MD ERROR: No Directory is available\n");
-    server_closeServerSocket();
-    exit(1);
+    pthread_cond_wait(&chunk_store.isDrained, &chunk_store.mutex);
   }
 
-  // start communicating with client
-  char response_message[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
-  memset(response_message, 0, sizeof(response_message));
+  pthread_mutex_unlock(&chunk_store.mutex);
+
+  return started;
+}
+
+/// @brief Frees a manifest read by dedup_loadManifest.
+/// @param manifest is the manifest, may be NULL.
+void dedup_freeManifest(t_manifest *manifest)
+{
+  if (manifest == NULL)
+    return;
+
+  free(manifest->chunks);
+  free(manifest->chunk);
+  free(manifest);
+}
+
+/// @brief Reads the manifest a deduplicated file is stored as.
+/// @param fd is the replica file.
+/// @param manifest is set to the manifest, to be freed with dedup_freeManifest, or NULL if the file is stored whole.
+/// @return 0 if successful, -1 if the file is a manifest that can't be read.
+int dedup_loadManifest(int fd, t_manifest **manifest)
+{
+  *manifest = NULL;
 
-  if ((isRootDirectory1Init && directory_isDirectoryExists(actual_path1)) ||
-      (isRootDirectory2Init && directory_isDirectoryExists(actual_path2)))
+  char magic[sizeof(MANIFEST_MAGIC)];
+  if (pread(fd, magic, sizeof(magic), 0) != sizeof(magic) || memcmp(magic, MANIFEST_MAGIC " ", sizeof(magic)) != 0)
+    return 0;
+
+  struct stat manifest_stat;
+  if (fstat(fd, &manifest_stat) != 0)
+    return -1;
+
+  char *text = malloc(manifest_stat.st_size + 1);
+  t_manifest *loaded = calloc(1, sizeof(t_manifest));
+  int status = text != NULL && loaded != NULL ? 0 : -1;
+
+  if (status == 0 && pread(fd, text, manifest_stat.st_size, 0) != manifest_stat.st_size)
+    status = -1;
+
+  // every chunk line is 2 * SHA256_SIZE hex digits, a space, a length and a newline
+  char *cursor = text;
+  if (status == 0)
   {
-    // directory already exists in atleast one directory
-    printf("MD: Directory already exists\n");
+    text[manifest_stat.st_size] = '\0';
 
-    strcat(response_message, "E:406 ");
-    strcat(response_message, "Directory already exists");
+    if (sscanf(text, MANIFEST_MAGIC " %lld %d", &loaded->size, &loaded->count) != 2 || loaded->count < 0 ||
+        loaded->count > manifest_stat.st_size / (2 * SHA256_SIZE + 3) || (cursor = strchr(text, '\n')) == NULL)
+      status = -1;
+  }
 
-    server_sendMessageToClient(client_sock, response_message);
+  if (status == 0)
+  {
+    loaded->chunks = malloc((loaded->count > 0 ? loaded->count : 1) * sizeof(t_chunkRef));
+    status = loaded->chunks != NULL ? 0 : -1;
   }
-  else
+
+  long long offset = 0;
+  uint32_t largest = 1;
+
+  for (int i = 0; i < loaded->count && status == 0; i++)
   {
-    // directory doesn't exist on both directories
-    printf("MD: Directory doesn't exist, creating directory\n");
+    t_chunkRef *chunk = &loaded->chunks[i];
+    cursor++;
 
-    int res1 = mkdir(actual_path1, 0700);
-    int res2 = mkdir(actual_path2, 0700);
-    if (res1 != 0 || res2 != 0)
+    char *end;
+    if (dedup_parseHash(cursor, chunk->hash) != 0 || cursor[2 * SHA256_SIZE] != ' ')
     {
-      // creation of directory failed
-      printf("MD ERROR: directory creation failed\n");
-      perror("mkdir");
-      strcat(response_message, "E:406 ");
-      strcat(response_message, "Directory creation failed");
-
-      server_sendMessageToClient(client_sock, response_message);
+      status = -1;
+      break;
     }
-    else
-    {
-      // creation of directory successful
-      printf("MD: Directory creation successful\n");
-
-      strcat(response_message, "S:200 ");
-      strcat(response_message, "Directory creation successful");
 
-      server_sendMessageToClient(client_sock, response_message);
+    unsigned long length = strtoul(cursor + 2 * SHA256_SIZE + 1, &end, 10);
+    if (*end != '\n' || length == 0 || length > UINT32_MAX)
+    {
+      status = -1;
+      break;
     }
+
+    chunk->length = length;
+    chunk->offset = offset;
+    offset += length;
+    largest = length > largest ? length : largest;
+    cursor = end;
   }
 
-  // release directories acquired for this command
-  if (isRootDirectory1Init)
+  if (status == 0 && offset != loaded->size)
+    status = -1;
+
+  if (status == 0)
   {
-    directory_releaseDirectory1();
+    loaded->chunk = malloc(largest);
+    loaded->loaded = -1;
+    status = loaded->chunk != NULL ? 0 : -1;
   }
-  if (isRootDirectory2Init)
+
+  free(text);
+
+  if (status != 0)
   {
-    directory_releaseDirectory2();
+    printf("DEDUP ERROR: Couldn't read a manifest\n");
+    dedup_freeManifest(loaded);
+    return -1;
   }
 
-  printf("COMMAND: MD complete\n\n");
+  *manifest = loaded;
+  return 0;
 }
 
-/// @brief To create and store a replica of a local client file to server space.
-/// @param client_sock is the socket of the client that is requesting the command.
-/// @param remote_file_path is the path in server where the replica needs to be saved.
-void command_put(int client_sock, char *remote_file_path)
+/// @brief Reads a chunk and makes sure it is the one the manifest names.
+/// @param root is the root directory of the replica.
+/// @param chunk is the chunk.
+/// @param buffer is filled with the chunk, holds at least chunk->length bytes.
+/// @return 0 if successful, -1 if the chunk is missing or its contents don't match its SHA-256.
+int dedup_readChunk(const char *root, const t_chunkRef *chunk, char *buffer)
 {
-  printf("COMMAND: PUT started\n");
-
-  // setup available directories and respective target file paths
-  FILE *remote_file1;
-  FILE *remote_file2;
+  char path[2 * SERVER_PATH_SIZE];
+  dedup_chunkPath(root, chunk->hash, path, sizeof(path));
 
-  char actual_path1[200];
-  char actual_path2[200];
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    printf("DEDUP ERROR: chunk %s is missing\n", path);
+    return -1;
+  }
 
-  // acquire all directories for this command
-  if (directory_isDirectory1Init())
+  uint32_t filled = 0;
+  while (filled < chunk->length)
   {
-    directory_acquireDirectory1();
+    ssize_t bytes_read = pread(fd, buffer + filled, chunk->length - filled, filled);
+    if (bytes_read < 0 && errno == EINTR)
+      continue;
+    if (bytes_read <= 0)
+      break;
 
-    printf("PUT: Directory 1 is acquired\n");
+    filled += bytes_read;
+  }
 
-    strcpy(actual_path1, ROOT_DIRECTORY_1);
-    strncat(actual_path1, remote_file_path, strlen(remote_file_path));
+  close(fd);
 
-    remote_file1 = fopen(actual_path1, "w");
+  unsigned char hash[SHA256_SIZE];
+  if (filled == chunk->length)
+    dedup_sha256(buffer, filled, hash);
 
-    printf("PUT: actual path: %s\n", actual_path1);
+  if (filled != chunk->length || memcmp(hash, chunk->hash, SHA256_SIZE) != 0)
+  {
+    printf("DEDUP ERROR: chunk %s is corrupt\n", path);
+    return -1;
   }
 
-  if (directory_isDirectory2Init())
+  return 0;
+}
+
+/// @brief Reads part of a deduplicated file back out of its chunks.
+/// @param manifest is the manifest of the file, remembers the chunk last read.
+/// @param root is the root directory of the replica.
+/// @param buffer is filled with the contents.
+/// @param offset is where to start reading in the file.
+/// @param length is the no. of bytes to read, must not run past the end of the file.
+/// @return 0 if successful, -1 if a chunk is missing or corrupt.
+int dedup_readFile(t_manifest *manifest, const char *root, char *buffer, long long offset, int length)
+{
+  int filled = 0;
+  int index = manifest->loaded >= 0 ? manifest->loaded : 0;
+
+  while (filled < length)
   {
-    directory_acquireDirectory2();
+    // files are mostly read front to back, so the chunk wanted is the one loaded or one of the next few
+    while (index < manifest->count - 1 && manifest->chunks[index].offset + manifest->chunks[index].length <= offset)
+      index++;
+    while (index > 0 && manifest->chunks[index].offset > offset)
+      index--;
 
-    printf("PUT: Directory 2 is acquired\n");
+    const t_chunkRef *chunk = &manifest->chunks[index];
 
-    strcpy(actual_path2, ROOT_DIRECTORY_2);
-    strncat(actual_path2, remote_file_path, strlen(remote_file_path));
+    if (index != manifest->loaded)
+    {
+      manifest->loaded = -1;
+      if (dedup_readChunk(root, chunk, manifest->chunk) != 0)
+        return -1;
+      manifest->loaded = index;
+    }
 
-    remote_file2 = fopen(actual_path2, "w");
+    int start = offset - chunk->offset;
+    int count = chunk->length - start < (uint32_t)(length - filled) ? (int)chunk->length - start : length - filled;
 
-    printf("PUT: actual path: %s\n", actual_path2);
+    memcpy(buffer + filled, manifest->chunk + start, count);
+    filled += count;
+    offset += count;
   }
 
-  // both directories are not available, quit program
-  if (!isRootDirectory1Init && !isRootDirectory2Init)
-  {
-    printf("PUT ERROR: No Directory is available\n");
-    server_closeServerSocket();
-    exit(1);
-  }
+  return 0;
+}
 
-  // Start communicating with client
-  char response_message[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
-  memset(response_message, 0, sizeof(response_message));
-  char client_message[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
-  memset(client_message, 0, sizeof(client_message));
+/// @brief Copies the chunks of a deduplicated file that another replica doesn't have yet, so the manifest can be
+///        copied after them. Whole files need nothing.
+/// @param source_root is the root directory of the replica the file is copied from.
+/// @param target_root is the root directory of the replica the file is copied to.
+/// @param source_path is the full path of the file copied.
+/// @return 0 if the target has every chunk of the file, -1 otherwise.
+int dedup_copyChunks(const char *source_root, const char *target_root, const char *source_path)
+{
+  int fd = open(source_path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+
+  t_manifest *manifest;
+  int status = dedup_loadManifest(fd, &manifest);
+  close(fd);
 
-  if ((isRootDirectory1Init && remote_file1 == NULL) || (isRootDirectory2Init && remote_file2 == NULL))
+  for (int i = 0; manifest != NULL && i < manifest->count; i++)
   {
-    printf("PUT ERROR: File could not be opened. Please check whether the location exists.\n");
+    char source_chunk[2 * SERVER_PATH_SIZE], target_chunk[2 * SERVER_PATH_SIZE];
+    char temp_path[2 * SERVER_PATH_SIZE + 64];
+    struct stat chunk_stat;
 
-    strcat(response_message, "E:404 ");
-    strcat(response_message, "File could not be opened. Please check whether the location exists.");
+    dedup_chunkPath(source_root, manifest->chunks[i].hash, source_chunk, sizeof(source_chunk));
+    dedup_chunkPath(target_root, manifest->chunks[i].hash, target_chunk, sizeof(target_chunk));
 
-    server_sendMessageToClient(client_sock, response_message);
+    if (lstat(target_chunk, &chunk_stat) == 0)
+      continue;
+
+    // a chunk is only ever seen whole under its name, and as new, so a collection running meanwhile keeps it
+    snprintf(temp_path, sizeof(temp_path), "%s.%ld%s", target_chunk, atomic_fetch_add(&chunk_store.temp_files, 1),
+             SERVER_PUT_TEMP_SUFFIX);
+    rebuild_makeParentDirectories(temp_path);
+
+    if (rebuild_copyFile(source_chunk, temp_path, NULL) != 0 || utimensat(AT_FDCWD, temp_path, NULL, 0) != 0 ||
+        rename(temp_path, target_chunk) != 0)
+    {
+      printf("DEDUP ERROR: Couldn't copy chunk %s\n", source_chunk);
+      unlink(temp_path);
+      status = -1;
+    }
   }
-  else
+
+  dedup_freeManifest(manifest);
+
+  return status;
+}
+
+/// @brief Adds the chunks of every deduplicated file in a directory of a replica, recursively, to a list.
+/// @param directory_path is the full path of the directory.
+/// @param isRoot is true for the root directory, whose chunk store isn't searched.
+/// @param list is the list the chunks are added to.
+/// @return 0 if successful, -1 if something couldn't be read, so the list may be missing chunks in use.
+int dedup_markDirectory(const char *directory_path, bool isRoot, t_hashList *list)
+{
+  DIR *dir = opendir(directory_path);
+  if (dir == NULL)
+    return -1;
+
+  int status = 0;
+  struct dirent *entry;
+
+  while (status == 0 && (entry = readdir(dir)) != NULL)
   {
-    // Tell client that server is ready to recieve the file
-    strcat(response_message, "S:100 ");
-    strcat(response_message, "Ready to write file on server");
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 || directory_isPutTempFile(entry->d_name) ||
+        (isRoot && strcmp(entry->d_name, SERVER_CHUNK_DIRECTORY) == 0))
+      continue;
 
-    server_sendMessageToClient(client_sock, response_message);
+    char entry_path[800];
+    struct stat entry_stat;
+    snprintf(entry_path, sizeof(entry_path), "%s/%s", directory_path, entry->d_name);
 
-    // get first block from client
-    server_recieveMessageFromClient(client_sock, client_message);
+    if (lstat(entry_path, &entry_stat) != 0)
+      continue;
 
-    while (true)
+    if (S_ISDIR(entry_stat.st_mode))
     {
-      if (strncmp(client_message, "S:206", CODE_SIZE) == 0)
-      {
-        // Client sent more data
-        char *file_contents;
-        file_contents = client_message + CODE_SIZE + CODE_PADDING;
+      status = dedup_markDirectory(entry_path, false, list);
+      continue;
+    }
+    if (!S_ISREG(entry_stat.st_mode))
+      continue;
 
-        if (isRootDirectory1Init)
-        {
-          printf("PUT: Writing to file on directory 1: %s\n", file_contents);
-          fwrite(file_contents, sizeof(char), strlen(file_contents), remote_file1);
-        }
-        if (isRootDirectory2Init)
+    int fd = open(entry_path, O_RDONLY);
+    t_manifest *manifest = NULL;
+
+    if (fd < 0 || dedup_loadManifest(fd, &manifest) != 0)
+      status = -1;
+    if (fd >= 0)
+      close(fd);
+
+    for (int i = 0; manifest != NULL && i < manifest->count && status == 0; i++)
+    {
+      if (list->count == list->capacity)
+      {
+        int capacity = list->capacity > 0 ? list->capacity * 2 : 1024;
+        unsigned char(*hashes)[SHA256_SIZE] = realloc(list->hashes, capacity * sizeof(*hashes));
+        if (hashes == NULL)
         {
-          printf("PUT: Writing to file on directory 2: %s\n", file_contents);
-          fwrite(file_contents, sizeof(char), strlen(file_contents), remote_file2);
+          status = -1;
+          break;
         }
 
-        memset(response_message, 0, sizeof(response_message));
-        strcat(response_message, "S:100 ");
-        strcat(response_message, "Success Continue");
+        list->hashes = hashes;
+        list->capacity = capacity;
+      }
 
-        server_sendMessageToClient(client_sock, response_message);
+      memcpy(list->hashes[list->count++], manifest->chunks[i].hash, SHA256_SIZE);
+    }
 
-        // get next block from client
-        memset(client_message, 0, sizeof(client_message));
-        server_recieveMessageFromClient(client_sock, client_message);
-      }
-      else if (strncmp(client_message, "E:500", CODE_SIZE) == 0)
-      {
-        // Client gave an error
-        printf("PUT ERROR: File could not be recieved\n");
+    dedup_freeManifest(manifest);
+  }
 
-        break;
-      }
-      else if (strncmp(client_message, "S:200", CODE_SIZE) == 0)
+  closedir(dir);
+
+  return status;
+}
+
+/// @brief Orders SHA-256s for qsort and bsearch.
+int dedup_compareHashes(const void *a, const void *b)
+{
+  return memcmp(a, b, SHA256_SIZE);
+}
+
+/// @brief Removes the chunks of a replica that no file refers to and that weren't used since a collection started,
+///        and the temporary files of chunks left behind by a crash.
+/// @param replica is the replica.
+/// @param list is every chunk its files refer to, sorted.
+/// @param started is when the collection started.
+void dedup_sweepChunks(t_replica *replica, const t_hashList *list, time_t started)
+{
+  char store_path[2 * SERVER_PATH_SIZE];
+  snprintf(store_path, sizeof(store_path), "%s%s", replica->root, SERVER_CHUNK_DIRECTORY);
+
+  DIR *store_dir = opendir(store_path);
+  if (store_dir == NULL)
+    return;
+
+  int removed = 0;
+  long long bytes_freed = 0;
+  struct dirent *bucket;
+
+  while ((bucket = readdir(store_dir)) != NULL)
+  {
+    if (strcmp(bucket->d_name, ".") == 0 || strcmp(bucket->d_name, "..") == 0)
+      continue;
+
+    char bucket_path[sizeof(store_path) + 256];
+    snprintf(bucket_path, sizeof(bucket_path), "%s/%s", store_path, bucket->d_name);
+
+    DIR *bucket_dir = opendir(bucket_path);
+    if (bucket_dir == NULL)
+      continue;
+
+    struct dirent *entry;
+    while ((entry = readdir(bucket_dir)) != NULL)
+    {
+      unsigned char hash[SHA256_SIZE];
+      bool isTemp = directory_isPutTempFile(entry->d_name);
+
+      if (!isTemp && (strlen(entry->d_name) != 2 * SHA256_SIZE || dedup_parseHash(entry->d_name, hash) != 0 ||
+                      bsearch(hash, list->hashes, list->count, SHA256_SIZE, dedup_compareHashes) != NULL))
+        continue;
+
+      char chunk_path[sizeof(bucket_path) + 256];
+      struct stat chunk_stat;
+      snprintf(chunk_path, sizeof(chunk_path), "%s/%s", bucket_path, entry->d_name);
+
+      // a chunk reused from now on is touched first, file times may lag the clock a little
+      pthread_rwlock_wrlock(&chunk_store.sweep_lock);
+      if (lstat(chunk_path, &chunk_stat) == 0 && S_ISREG(chunk_stat.st_mode) && chunk_stat.st_mtime < started - 1 &&
+          unlink(chunk_path) == 0)
       {
-        // Client is done sending data
-        memset(response_message, 0, sizeof(response_message));
-        strcat(response_message, "S:200 ");
-        strcat(response_message, "File received successfully");
+        removed++;
+        bytes_freed += chunk_stat.st_size;
+      }
+      pthread_rwlock_unlock(&chunk_store.sweep_lock);
+    }
+
+    closedir(bucket_dir);
+  }
+
+  closedir(store_dir);
+
+  int in_use = 0;
+  for (int i = 0; i < list->count; i++)
+  {
+    if (i == 0 || memcmp(list->hashes[i], list->hashes[i - 1], SHA256_SIZE) != 0)
+      in_use++;
+  }
+
+  printf("DEDUP: %d unused chunks, %lld bytes, removed from directory %d, %d chunks in use\n", removed, bytes_freed,
+         replica->id, in_use);
+}
+
+/// @brief Removes the chunks no deduplicated file refers to anymore from every online replica. Chunks aren't
+///        counted as files come and go, they are found by listing the chunks every manifest refers to.
+void dedup_collectGarbage()
+{
+  if (SERVER_STORAGE_MODE != STORAGE_DEDUP)
+    return;
+
+  time_t started = dedup_startCollection();
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    t_replica *replica = &replicas[i];
+    if (!atomic_load(&replica->isInit))
+      continue;
+
+    // keep the replica from being cloned meanwhile
+    directory_acquireDirectory(replica);
+
+    t_hashList list = {0};
+    if (dedup_markDirectory(replica->root, true, &list) != 0)
+    {
+      printf("DEDUP ERROR: Couldn't read every manifest on directory %d, keeping its chunks\n", replica->id);
+    }
+    else
+    {
+      qsort(list.hashes, list.count, SHA256_SIZE, dedup_compareHashes);
+      dedup_sweepChunks(replica, &list, started);
+    }
+
+    free(list.hashes);
+
+    directory_releaseDirectory(replica);
+  }
+}
+
+#pragma endregion Chunk Store
+
+#pragma region Change Journal
+
+/// @brief Starts recording the changes a replica misses while it is offline.
+/// @param target is the replica that went offline.
+void journal_start(t_replica *target)
+{
+  t_journal *journal = &target->journal;
+
+  pthread_mutex_lock(&journal->mutex);
+
+  journal->count = 0;
+  journal->isTracking = true;
+  journal->isOverflowed = false;
+
+  pthread_mutex_unlock(&journal->mutex);
+
+  printf("JOURNAL: recording changes missed by directory %d\n", target->id);
+}
+
+/// @brief Remembers which directory a replica's root is, to tell on its return whether it is the same one.
+/// @param target is the replica.
+void journal_rememberDirectory(t_replica *target)
+{
+  t_journal *journal = &target->journal;
+  struct stat root_stat;
+
+  if (stat(target->root, &root_stat) != 0)
+    return;
+
+  pthread_mutex_lock(&journal->mutex);
+
+  journal->root_device = root_stat.st_dev;
+  journal->root_inode = root_stat.st_ino;
+
+  pthread_mutex_unlock(&journal->mutex);
+}
+
+/// @brief Tells whether a returning replica can be trusted to hold everything up to when it went offline: its root
+///        is the directory last seen and it is not empty (eg. a fresh drive with an empty root made on it).
+/// @param target is the returning replica. Must hold its journal mutex.
+/// @param source is the healthy replica it is restored from.
+/// @return true if replaying the journal is enough to restore it.
+bool journal_isSameDirectory(t_replica *target, t_replica *source)
+{
+  t_journal *journal = &target->journal;
+
+  struct stat root_stat;
+  if (stat(target->root, &root_stat) != 0 || root_stat.st_dev != journal->root_device ||
+      root_stat.st_ino != journal->root_inode)
+    return false;
+
+  return !directory_isDirectoryEmpty(target->root) || directory_isDirectoryEmpty(source->root);
+}
+
+/// @brief Brings one path of a returning replica to the state it has on the healthy replica: copies files,
+///        creates directories and removes whatever the healthy replica no longer has.
+/// @param source_root is the root directory of the healthy replica.
+/// @param target_root is the root directory of the returning replica.
+/// @param path is the path, relative to the root directory.
+void journal_syncPath(const char *source_root, const char *target_root, const char *path)
+{
+  char source_path[400];
+  char target_path[400];
+  snprintf(source_path, sizeof(source_path), "%s%s", source_root, path);
+  snprintf(target_path, sizeof(target_path), "%s%s", target_root, path);
+
+  struct stat source_stat, target_stat;
+  bool isSourceExisting = lstat(source_path, &source_stat) == 0;
+  bool isTargetExisting = lstat(target_path, &target_stat) == 0;
+
+  // whatever is in the way of the new state goes first
+  if (isTargetExisting && (!isSourceExisting || (source_stat.st_mode & S_IFMT) != (target_stat.st_mode & S_IFMT)))
+  {
+    directory_removeDirectoryRecursively(target_path);
+    isTargetExisting = false;
+  }
+
+  if (!isSourceExisting)
+  {
+    printf("JOURNAL: removed %s\n", target_path);
+  }
+  else if (S_ISDIR(source_stat.st_mode))
+  {
+    rebuild_makeParentDirectories(target_path);
+    mkdir(target_path, source_stat.st_mode & 0777);
+
+    // the directory may have been removed and made again, drop entries it had before
+    rebuild_removeStaleEntries(source_path, target_path);
+
+    printf("JOURNAL: synced directory %s\n", target_path);
+  }
+  else if (S_ISREG(source_stat.st_mode))
+  {
+    rebuild_makeParentDirectories(target_path);
+
+    // a deduplicated file is only its manifest, the chunks it names have to be there before it
+    int epoch = dedup_beginWrite();
+
+    if (dedup_copyChunks(source_root, target_root, source_path) != 0 ||
+        rebuild_copyFile(source_path, target_path, NULL) != 0)
+    {
+      printf("JOURNAL ERROR: couldn't copy %s to %s\n", source_path, target_path);
+    }
+    else
+    {
+      printf("JOURNAL: copied %s\n", target_path);
+    }
+
+    dedup_endWrite(epoch);
+  }
+}
+
+/// @brief Records a path changed by PUT/MD/RM in the journal of every replica that is offline. Must be called
+///        while the command still holds the replicas it changed.
+/// @param command_name names the command in the logs.
+/// @param path is the path changed, relative to the root directory.
+/// @param isWritten marks the replicas that have the change. One that was restored after the command picked its
+///        replicas gets the path synced from them here, NULL if the replicator brings the others up to date.
+void journal_recordChange(const char *command_name, const char *path, const bool isWritten[])
+{
+  // the replica the change is copied from, for replicas restored in the meantime
+  t_replica *source = NULL;
+  for (int i = 0; i < replica_count && isWritten != NULL && source == NULL; i++)
+  {
+    if (isWritten[i])
+      source = &replicas[i];
+  }
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    t_journal *journal = &replicas[i].journal;
+
+    if (isWritten != NULL && isWritten[i])
+      continue;
+
+    // the restore marks the replica online with this held, so it is either still journaled or already restored
+    pthread_mutex_lock(&journal->mutex);
+
+    if (atomic_load(&replicas[i].isInit))
+    {
+      if (source != NULL)
+      {
+        printf("JOURNAL: directory %d was restored during %s of %s, syncing it\n", replicas[i].id, command_name,
+               path);
+        journal_syncPath(source->root, replicas[i].root, path);
+      }
+    }
+    else if (journal->isTracking && !journal->isOverflowed)
+    {
+      // the replay syncs each path to its current state, so a path only needs to be in the journal once
+      bool isRecorded = false;
+      for (int j = 0; j < journal->count && !isRecorded; j++)
+      {
+        isRecorded = strcmp(journal->paths[j], path) == 0;
+      }
+
+      if (isRecorded)
+      {
+        // nothing to do
+      }
+      else if (journal->count == SERVER_JOURNAL_SIZE || strlen(path) >= SERVER_PATH_SIZE)
+      {
+        journal->isOverflowed = true;
+        printf("JOURNAL: journal of directory %d is full, it will be rebuilt when it returns\n", replicas[i].id);
+      }
+      else
+      {
+        strcpy(journal->paths[journal->count++], path);
+        printf("JOURNAL: %s of %s recorded for directory %d\n", command_name, path, replicas[i].id);
+      }
+    }
+
+    pthread_mutex_unlock(&journal->mutex);
+  }
+}
+
+/// @brief Takes a replica offline after a change could only be made on the others, with the path in its journal, so
+///        it is brought back in sync like any replica that returns. Must be called while the command still holds the
+///        replicas it changed.
+/// @param command_name names the command in the logs.
+/// @param replica is the replica the change failed on.
+/// @param path is the path changed, relative to the root directory.
+void journal_dropDirectory(const char *command_name, t_replica *replica, const char *path)
+{
+  if (atomic_exchange(&replica->isInit, false))
+  {
+    journal_start(replica);
+    printf("JOURNAL: directory %d taken offline, %s of %s failed on it\n", replica->id, command_name, path);
+  }
+
+  bool isWritten[SERVER_MAX_REPLICAS];
+  for (int i = 0; i < replica_count; i++)
+  {
+    isWritten[i] = &replicas[i] != replica;
+  }
+
+  journal_recordChange(command_name, path, isWritten);
+}
+
+/// @brief Syncs the paths recorded so far into a replica that is being restored and empties the journal.
+/// @param target is the replica being restored.
+/// @param source is the healthy replica it is restored from.
+/// @param isJournalHeld is true if the caller holds the journal's mutex, so no command records a change meanwhile.
+/// @return the no. of paths synced, -1 if the journal overflowed and the replica needs a full rebuild.
+int journal_replayChanges(t_replica *target, t_replica *source, bool isJournalHeld)
+{
+  t_journal *journal = &target->journal;
+
+  if (!isJournalHeld)
+    pthread_mutex_lock(&journal->mutex);
+
+  if (journal->isOverflowed)
+  {
+    // start over, the rebuild picks up everything the journal lost
+    journal->count = 0;
+    journal->isOverflowed = false;
+
+    if (!isJournalHeld)
+      pthread_mutex_unlock(&journal->mutex);
+    return -1;
+  }
+
+  // take the paths out, so commands can keep recording while they are synced
+  int count = journal->count;
+  char(*paths)[SERVER_PATH_SIZE] = malloc(sizeof(*paths) * (count > 0 ? count : 1));
+  if (paths == NULL)
+  {
+    if (!isJournalHeld)
+      pthread_mutex_unlock(&journal->mutex);
+    return -1;
+  }
+  memcpy(paths, journal->paths, sizeof(*paths) * count);
+  journal->count = 0;
+
+  if (!isJournalHeld)
+    pthread_mutex_unlock(&journal->mutex);
+
+  if (count > 0)
+  {
+    printf("JOURNAL: replaying %d changes from directory %d into directory %d\n", count, source->id, target->id);
+  }
+  for (int i = 0; i < count; i++)
+  {
+    journal_syncPath(source->root, target->root, paths[i]);
+  }
+
+  free(paths);
+  return count;
+}
+
+/// @brief Body of the restore thread. Brings a replica that came back up to date while the others keep serving,
+///        then marks it initialised. Only the paths changed while it was offline are synced, unless the journal was
+///        not running or overflowed, in which case the whole tree is rebuilt. Writes that land during the restore are
+///        journaled and caught up on, the last few with the journal held so nothing slips through.
+/// @param target_arg is the replica that came back.
+/// @return NULL when the replica is restored.
+void *journal_runRestore(void *target_arg)
+{
+  t_replica *target = target_arg;
+  t_journal *journal = &target->journal;
+  t_replica *source = directory_findSourceDirectory(target);
+
+  pthread_mutex_lock(&journal->mutex);
+
+  bool isRebuildNeeded = !journal->isTracking || journal->isOverflowed || source == NULL ||
+                         !journal_isSameDirectory(target, source);
+  if (isRebuildNeeded)
+  {
+    // the rebuild copies everything there is now, the journal only has to catch what changes during it
+    journal->count = 0;
+    journal->isTracking = true;
+    journal->isOverflowed = false;
+  }
+
+  pthread_mutex_unlock(&journal->mutex);
+
+  for (int pass = 0; pass < SERVER_REBUILD_CATCHUP_PASSES; pass++)
+  {
+    // the replica copied from may have gone offline since the last pass
+    source = directory_findSourceDirectory(target);
+    if (source == NULL)
+      break;
+
+    directory_acquireDirectory(source);
+
+    if (isRebuildNeeded)
+    {
+      printf("JOURNAL: no usable journal for directory %d, rebuilding it from directory %d\n", target->id, source->id);
+      rebuild_copyTree(source->root, target->root);
+      isRebuildNeeded = false;
+    }
+
+    int replayed = journal_replayChanges(target, source, false);
+
+    directory_releaseDirectory(source);
+
+    if (replayed < 0)
+      isRebuildNeeded = true;
+    else if (replayed == 0)
+      break;
+  }
+
+  // the last changes are replayed with the journal held, a command that changes a path meanwhile waits to record
+  // it and then finds the replica restored, so it syncs the path itself. Only the replicas involved are locked,
+  // commands keep running on the others
+  source = directory_findSourceDirectory(target);
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    if (&replicas[i] == target)
+      pthread_rwlock_wrlock(&target->lock);
+    else if (&replicas[i] == source)
+      directory_acquireDirectory(source);
+  }
+
+  // the health monitor compares the root with this as soon as the replica counts as online
+  journal_rememberDirectory(target);
+
+  pthread_mutex_lock(&journal->mutex);
+
+  if (source != NULL && (isRebuildNeeded || journal_replayChanges(target, source, true) < 0))
+  {
+    rebuild_copyTree(source->root, target->root);
+  }
+
+  journal->isRestoring = false;
+
+  if (source != NULL)
+  {
+    journal->count = 0;
+    journal->isTracking = false;
+    journal->isOverflowed = false;
+
+    atomic_store(&target->isInit, true);
+  }
+
+  pthread_mutex_unlock(&journal->mutex);
+
+  if (source != NULL)
+    directory_releaseDirectory(source);
+  pthread_rwlock_unlock(&target->lock);
+
+  if (source != NULL)
+    printf("JOURNAL: directory %d is up to date\n", target->id);
+  else
+    printf("JOURNAL ERROR: no online directory to restore directory %d from\n", target->id);
+
+  return NULL;
+}
+
+/// @brief Starts restoring a replica that came back, unless it is already being restored. The replica counts as
+///        offline until the restore thread marks it initialised.
+/// @param target is the replica that came back.
+void journal_restoreDirectory(t_replica *target)
+{
+  t_journal *journal = &target->journal;
+
+  pthread_mutex_lock(&journal->mutex);
+
+  if (journal->isRestoring)
+  {
+    pthread_mutex_unlock(&journal->mutex);
+    return;
+  }
+  journal->isRestoring = true;
+
+  pthread_mutex_unlock(&journal->mutex);
+
+  pthread_t restore_thread;
+  pthread_attr_t attr;
+
+  // detach thread so that it can end without having to join it
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  if (pthread_create(&restore_thread, &attr, journal_runRestore, target) != 0)
+  {
+    printf("JOURNAL ERROR: Couldn't start restoring directory %d\n", target->id);
+
+    pthread_mutex_lock(&journal->mutex);
+    journal->isRestoring = false;
+    pthread_mutex_unlock(&journal->mutex);
+  }
+
+  pthread_attr_destroy(&attr);
+}
+
+#pragma endregion Change Journal
+
+#pragma region Replication
+
+/// @brief Tells whether a replica is written after the reply by the replicator, rather than by the command.
+/// @param replica is the replica.
+/// @return true if the replica is a secondary and replication is asynchronous.
+bool replicator_isSecondary(const t_replica *replica)
+{
+  return SERVER_REPLICATION_MODE == REPLICATION_ASYNC && replica != primary_replica;
+}
+
+/// @brief Tells whether a replica still lacks a change to a path, so reads of the path must go elsewhere.
+/// @param replica is the replica.
+/// @param path is the path read, relative to the root directory.
+/// @return true if a queued change touches the path or a directory above it.
+bool replicator_isStale(const t_replica *replica, const char *path)
+{
+  if (!replicator_isSecondary(replica))
+    return false;
+
+  bool isStale = false;
+
+  pthread_mutex_lock(&replicator.mutex);
+
+  for (int i = 0; i < replicator.count && !isStale; i++)
+  {
+    const char *changed = replicator.queue[(replicator.head + i) % SERVER_REPLICATION_QUEUE_SIZE].path;
+    size_t length = strlen(changed);
+
+    isStale = strncmp(path, changed, length) == 0 && (path[length] == '\0' || path[length] == '/');
+  }
+
+  pthread_mutex_unlock(&replicator.mutex);
+
+  return isStale;
+}
+
+/// @brief Appends a line to the intent log and waits for it to reach the disk. Must hold the replicator mutex.
+/// @param command_name names the command changing the path.
+/// @param path is the path changed, relative to the root directory.
+/// @return 0 if the intent is durable, -1 otherwise.
+int replicator_logIntent(const char *command_name, const char *path)
+{
+  char line[SERVER_PATH_SIZE + 16];
+  int length = snprintf(line, sizeof(line), "%s %s\n", command_name, path);
+
+  if (replicator.log_desc < 0 || write(replicator.log_desc, line, length) != length ||
+      fdatasync(replicator.log_desc) != 0)
+  {
+    printf("REPLICATOR ERROR: Couldn't log intent to change %s\n", path);
+    return -1;
+  }
+
+  return 0;
+}
+
+/// @brief Decides whether a write command leaves the secondaries to the replicator. The intent is logged durably
+///        before the command touches the primary, so a crash can't lose the change for the secondaries.
+/// @param command_name names the command in the logs.
+/// @param path is the path changed, relative to the root directory.
+/// @param isUp tells, per replica, whether it is online. Secondaries left to the replicator are cleared.
+/// @return true if the command only writes the primary, false if it writes every online replica itself.
+bool replicator_deferDirectories(const char *command_name, const char *path, bool isUp[])
+{
+  if (SERVER_REPLICATION_MODE != REPLICATION_ASYNC || !isUp[primary_replica->id - 1])
+    return false;
+
+  // with only the primary online there is nothing to replicate, the journals of the others catch them up
+  bool isSecondaryUp = false;
+  for (int i = 0; i < replica_count; i++)
+  {
+    isSecondaryUp = isSecondaryUp || (isUp[i] && &replicas[i] != primary_replica);
+  }
+  if (!isSecondaryUp)
+    return false;
+
+  pthread_mutex_lock(&replicator.mutex);
+
+  // a full queue means the secondaries are far behind, write them directly until the replicator catches up
+  if (replicator.count + replicator.reserved == SERVER_REPLICATION_QUEUE_SIZE ||
+      replicator_logIntent(command_name, path) != 0)
+  {
+    pthread_mutex_unlock(&replicator.mutex);
+    return false;
+  }
+
+  replicator.reserved++;
+
+  pthread_mutex_unlock(&replicator.mutex);
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    if (&replicas[i] != primary_replica)
+      isUp[i] = false;
+  }
+
+  return true;
+}
+
+/// @brief Hands a change to the replicator once the command is done with the primary. Must be called while the
+///        command still holds the path, so no read slips in before the secondaries count as stale.
+/// @param command_name names the command in the logs.
+/// @param path is the path changed, relative to the root directory.
+void replicator_queueChange(const char *command_name, const char *path)
+{
+  pthread_mutex_lock(&replicator.mutex);
+
+  t_replicationEntry *entry = &replicator.queue[(replicator.head + replicator.count) % SERVER_REPLICATION_QUEUE_SIZE];
+  strncpy(entry->command, command_name, sizeof(entry->command) - 1);
+  entry->command[sizeof(entry->command) - 1] = '\0';
+  strncpy(entry->path, path, sizeof(entry->path) - 1);
+  entry->path[sizeof(entry->path) - 1] = '\0';
+  clock_gettime(CLOCK_MONOTONIC, &entry->queued_at);
+
+  replicator.count++;
+  replicator.reserved--;
+
+  pthread_cond_signal(&replicator.isChangeQueued);
+  pthread_mutex_unlock(&replicator.mutex);
+}
+
+/// @brief Syncs the path of a change from the primary into every online secondary. Secondaries that are offline get
+///        it recorded in their journal.
+/// @param entry is the change.
+void replicator_applyChange(const t_replicationEntry *entry)
+{
+  // keep writers off the path while it is copied, so a secondary never gets half a file
+  t_pathLockSet path_locks_held;
+  bool isLocked = path_lock(entry->path, LOCK_MODE_SHARED, &path_locks_held) == 0;
+
+  // the primary and every online secondary, in the order of the config file
+  bool isUp[SERVER_MAX_REPLICAS];
+  bool isPrimaryUp = atomic_load(&primary_replica->isInit);
+
+  if (isPrimaryUp)
+  {
+    for (int i = 0; i < replica_count; i++)
+    {
+      isUp[i] = atomic_load(&replicas[i].isInit) || &replicas[i] == primary_replica;
+      if (isUp[i])
+        directory_acquireDirectory(&replicas[i]);
+    }
+
+    for (int i = 0; i < replica_count; i++)
+    {
+      if (isUp[i] && &replicas[i] != primary_replica)
+        journal_syncPath(primary_replica->root, replicas[i].root, entry->path);
+    }
+
+    for (int i = 0; i < replica_count; i++)
+    {
+      if (isUp[i])
+        directory_releaseDirectory(&replicas[i]);
+    }
+  }
+
+  // replicas that went offline since get it from their journal when they return
+  journal_recordChange(entry->command, entry->path, isPrimaryUp ? isUp : NULL);
+
+  if (isLocked)
+    path_unlock(&path_locks_held);
+}
+
+/// @brief Body of the replicator thread. Applies queued changes to the secondaries, oldest first, by syncing each
+///        path from the primary, and reports how far the secondaries lag behind.
+/// @param arg is unused.
+/// @return never returns.
+void *replicator_run(void *arg)
+{
+  (void)arg;
+
+  while (true)
+  {
+    pthread_mutex_lock(&replicator.mutex);
+
+    while (replicator.count == 0)
+    {
+      pthread_cond_wait(&replicator.isChangeQueued, &replicator.mutex);
+    }
+
+    // the entry stays queued, and the path stale, until it is applied
+    t_replicationEntry entry = replicator.queue[replicator.head];
+
+    pthread_mutex_unlock(&replicator.mutex);
+
+    replicator_applyChange(&entry);
+
+    pthread_mutex_lock(&replicator.mutex);
+
+    replicator.head = (replicator.head + 1) % SERVER_REPLICATION_QUEUE_SIZE;
+    replicator.count--;
+    replicator.applied++;
+
+    double lag_ms = replicator.count > 0 ? server_millisecondsSince(&replicator.queue[replicator.head].queued_at) : 0;
+    printf("REPLICATOR: applied %s of %s after %.2f ms, lag %d changes / %.2f ms, %ld applied\n", entry.command,
+           entry.path, server_millisecondsSince(&entry.queued_at), replicator.count, lag_ms, replicator.applied);
+
+    // everything logged is on every replica, start the log over
+    if (replicator.count == 0 && replicator.reserved == 0 && ftruncate(replicator.log_desc, 0) != 0)
+    {
+      printf("REPLICATOR ERROR: Couldn't truncate the intent log\n");
+    }
+
+    pthread_mutex_unlock(&replicator.mutex);
+  }
+
+  return NULL;
+}
+
+/// @brief Opens the intent log and starts the replicator. Changes logged but not applied before the server last
+///        stopped are queued again first.
+/// @return 0 if successful, -1 otherwise.
+int replicator_init()
+{
+  if (SERVER_REPLICATION_MODE != REPLICATION_ASYNC)
+    return 0;
+
+  replicator.log_desc = open(SERVER_INTENT_LOG, O_RDWR | O_CREAT | O_APPEND, 0600);
+  if (replicator.log_desc < 0)
+  {
+    printf("INIT ERROR: Couldn't open the intent log %s\n", SERVER_INTENT_LOG);
+    return -1;
+  }
+
+  FILE *log = fdopen(dup(replicator.log_desc), "r");
+  char command[8];
+  char path[SERVER_PATH_SIZE];
+
+  // the log is only started over once the queue drains, so it can hold more changes than fit in the queue. The
+  // oldest queued ones are applied right away to make room, none of the log is skipped
+  int applied_count = 0;
+  while (log != NULL && fscanf(log, "%7s %199s", command, path) == 2)
+  {
+    if (replicator.count == SERVER_REPLICATION_QUEUE_SIZE)
+    {
+      replicator_applyChange(&replicator.queue[replicator.head]);
+
+      replicator.head = (replicator.head + 1) % SERVER_REPLICATION_QUEUE_SIZE;
+      replicator.count--;
+      applied_count++;
+    }
+
+    replicator.reserved++;
+    replicator_queueChange(command, path);
+  }
+  if (log != NULL)
+    fclose(log);
+
+  if (applied_count > 0)
+    printf("INIT: %d changes from the intent log were replayed into the secondaries\n", applied_count);
+  if (replicator.count > 0)
+    printf("INIT: %d changes from the intent log are replayed into the secondaries\n", replicator.count);
+
+  pthread_t replicator_thread;
+  pthread_attr_t attr;
+
+  // detach thread, it lives as long as the server
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  int status = pthread_create(&replicator_thread, &attr, replicator_run, NULL);
+  pthread_attr_destroy(&attr);
+
+  if (status != 0)
+  {
+    printf("INIT ERROR: Couldn't start the replicator\n");
+    return -1;
+  }
+
+  printf("INIT: asynchronous replication from directory %d into the other directories\n", primary_replica->id);
+  return 0;
+}
+
+#pragma endregion Replication
+
+#pragma region Health Monitor
+
+/// @brief Checks one replica's root directory and handles it going offline or coming back. Replica state changes
+///        only here, commands just read the flags.
+/// @param replica is the replica.
+void monitor_probeDirectory(t_replica *replica)
+{
+  t_journal *journal = &replica->journal;
+
+  struct stat root_stat;
+  bool isReachable = stat(replica->root, &root_stat) == 0 && S_ISDIR(root_stat.st_mode);
+
+  if (atomic_load(&replica->isInit))
+  {
+    pthread_mutex_lock(&journal->mutex);
+    bool isSameRoot = root_stat.st_dev == journal->root_device && root_stat.st_ino == journal->root_inode;
+    pthread_mutex_unlock(&journal->mutex);
+
+    if (isReachable && isSameRoot)
+      return;
+
+    // gone, or swapped for another directory between two probes, either way it misses changes from now on
+    atomic_store(&replica->isInit, false);
+    journal_start(replica);
+
+    printf("HEALTH: directory %d is %s\n", replica->id, isReachable ? "a different directory now" : "not available anymore");
+  }
+  else if (isReachable && directory_findSourceDirectory(replica) != NULL)
+  {
+    // back, bring it up to date with the others, it stays offline until the restore is done
+    journal_restoreDirectory(replica);
+    return;
+  }
+
+  bool isAnyServing = false;
+  for (int i = 0; i < replica_count && !isAnyServing; i++)
+  {
+    isAnyServing = atomic_load(&replicas[i].isInit) || replicas[i].journal.isRestoring;
+  }
+
+  if (!isAnyServing)
+  {
+    // no directory is available, and we cannot serve any requests
+    printf("HEALTH ERROR: all %d root directories are unavailable\n", replica_count);
+    exit(1);
+  }
+
+  // readers waiting for a replica pick another one
+  pthread_mutex_lock(&replica_mutex);
+  pthread_cond_broadcast(&replica_changed);
+  pthread_mutex_unlock(&replica_mutex);
+}
+
+#ifdef __linux__
+/// @brief Watches the directory a replica root lives in, so removing, renaming or recreating the root wakes the
+///        monitor right away. The parent itself may be missing while the drive is unplugged, it is watched again
+///        on every round.
+/// @param inotify_desc is the inotify instance.
+/// @param root is the root directory of the replica.
+/// @param watch_desc is the watch for the parent, -1 if not watched yet.
+void monitor_watchParent(int inotify_desc, const char *root, int *watch_desc)
+{
+  if (*watch_desc >= 0)
+    return;
+
+  char parent[400];
+  strncpy(parent, root, sizeof(parent) - 1);
+  parent[sizeof(parent) - 1] = '\0';
+
+  // "./root1/" lives in "."
+  size_t length = strlen(parent);
+  while (length > 1 && parent[length - 1] == '/')
+    parent[--length] = '\0';
+
+  *watch_desc = inotify_add_watch(inotify_desc, dirname(parent),
+                                  IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF |
+                                      IN_UNMOUNT | IN_ONLYDIR);
+}
+#endif
+
+/// @brief Body of the health monitor thread. Probes every replica every SERVER_HEALTH_PROBE_MS, and right away when
+///        the directories holding them change or a file system is mounted or unmounted.
+/// @param arg is unused.
+/// @return never returns.
+void *monitor_run(void *arg)
+{
+  (void)arg;
+
+  struct pollfd pfds[2];
+  int pfd_count = 0;
+
+#ifdef __linux__
+  int watch_descs[SERVER_MAX_REPLICAS];
+  for (int i = 0; i < replica_count; i++)
+  {
+    watch_descs[i] = -1;
+  }
+
+  int inotify_desc = inotify_init1(IN_NONBLOCK);
+  if (inotify_desc >= 0)
+  {
+    pfds[pfd_count].fd = inotify_desc;
+    pfds[pfd_count].events = POLLIN;
+    pfd_count++;
+  }
+
+  // the kernel flags the mount table whenever a drive is mounted or unmounted
+  int mounts_desc = open("/proc/self/mounts", O_RDONLY);
+  if (mounts_desc >= 0)
+  {
+    pfds[pfd_count].fd = mounts_desc;
+    pfds[pfd_count].events = POLLPRI;
+    pfd_count++;
+  }
+#endif
+
+  while (true)
+  {
+#ifdef __linux__
+    for (int i = 0; i < replica_count && inotify_desc >= 0; i++)
+    {
+      monitor_watchParent(inotify_desc, replicas[i].root, &watch_descs[i]);
+    }
+#endif
+
+    int ready = poll(pfds, pfd_count, SERVER_HEALTH_PROBE_MS);
+
+#ifdef __linux__
+    if (ready > 0 && inotify_desc >= 0 && (pfds[0].revents & POLLIN))
+    {
+      char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+      ssize_t length;
+
+      while ((length = read(inotify_desc, events, sizeof(events))) > 0)
+      {
+        for (char *cursor = events; cursor < events + length;)
+        {
+          struct inotify_event *event = (struct inotify_event *)cursor;
+
+          // a watched parent went away, watch it again once it is back. Replicas sharing a parent share the watch.
+          for (int i = 0; i < replica_count && (event->mask & IN_IGNORED); i++)
+          {
+            if (event->wd == watch_descs[i])
+              watch_descs[i] = -1;
+          }
+
+          cursor += sizeof(struct inotify_event) + event->len;
+        }
+      }
+    }
+    if (ready > 0 && mounts_desc >= 0)
+    {
+      // rewind so the next mount change is reported again
+      lseek(mounts_desc, 0, SEEK_SET);
+    }
+#else
+    (void)ready;
+#endif
+
+    for (int i = 0; i < replica_count; i++)
+    {
+      monitor_probeDirectory(&replicas[i]);
+    }
+  }
+
+  return NULL;
+}
+
+/// @brief Starts the health monitor.
+/// @return 0 if successful, -1 otherwise.
+int monitor_init()
+{
+  pthread_t monitor_thread;
+  pthread_attr_t attr;
+
+  // detach thread, it lives as long as the server
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  int status = pthread_create(&monitor_thread, &attr, monitor_run, NULL);
+  pthread_attr_destroy(&attr);
+
+  if (status != 0)
+  {
+    printf("INIT ERROR: Couldn't start the health monitor\n");
+    return -1;
+  }
+
+  printf("INIT: health monitor probes replicas every %d ms\n", SERVER_HEALTH_PROBE_MS);
+  return 0;
+}
+
+#pragma endregion Health Monitor
+
+#pragma region Group Commit
+
+/// @brief Flushes a file and the drive cache behind it.
+/// @param fd is the file.
+/// @return 0 if the file is on disk, -1 otherwise.
+int commit_syncFile(int fd)
+{
+#ifdef __APPLE__
+  // fsync on macOS leaves the data in the drive's cache
+  if (fcntl(fd, F_FULLFSYNC) == 0)
+    return 0;
+#endif
+
+  return fsync(fd);
+}
+
+/// @brief Makes a round of PUTs durable: flushes their files, renames them into place and flushes the directories
+///        that changed. Each directory is flushed once, however many files of the round landed in it. A replica a
+///        file couldn't be put in place on while others have it is taken offline, to be resynced.
+/// @param batch is the PUTs of the round, the status of each is set.
+/// @return the no. of files committed.
+int commit_flushBatch(t_commit *batch)
+{
+  int file_count = 0;
+
+#ifdef __linux__
+  // start writing back every file before waiting on any of them, so the disk works on all of them at once
+  for (t_commit *commit = batch; commit != NULL; commit = commit->next)
+  {
+    for (int i = 0; i < replica_count; i++)
+    {
+      if (commit->fds[i] >= 0)
+        sync_file_range(commit->fds[i], 0, 0, SYNC_FILE_RANGE_WRITE);
+    }
+  }
+#endif
+
+  for (t_commit *commit = batch; commit != NULL; commit = commit->next)
+  {
+    bool isFlushed[SERVER_MAX_REPLICAS];
+    int renamed_count = 0;
+
+    for (int i = 0; i < replica_count; i++)
+    {
+      commit->isRenamed[i] = false;
+      isFlushed[i] = commit->fds[i] >= 0 && commit_syncFile(commit->fds[i]) == 0;
+
+      if (commit->fds[i] >= 0 && !isFlushed[i])
+        printf("COMMIT ERROR: Couldn't flush %s\n", commit->temp_paths[i]);
+    }
+
+    // the old file stays in place, whole, until the new one is
+    for (int i = 0; i < replica_count; i++)
+    {
+      if (!isFlushed[i])
+        continue;
+
+      if (rename(commit->temp_paths[i], commit->actual_paths[i]) != 0)
+      {
+        printf("COMMIT ERROR: Couldn't rename %s into place\n", commit->temp_paths[i]);
+        continue;
+      }
+
+      commit->isRenamed[i] = true;
+      renamed_count++;
+      file_count++;
+    }
+
+    commit->status = renamed_count > 0 ? 0 : -1;
+
+    // once the file is in place on some replica, one it couldn't be put in place on is behind, it goes offline to
+    // be resynced. If it is in place on none, nothing diverged and the PUT just fails
+    for (int i = 0; i < replica_count && commit->status == 0; i++)
+    {
+      size_t root_length = strlen(replicas[i].root);
+      if (commit->fds[i] < 0 || commit->isRenamed[i] ||
+          strncmp(commit->actual_paths[i], replicas[i].root, root_length) != 0)
+        continue;
+
+      unlink(commit->temp_paths[i]);
+      journal_dropDirectory("COMMIT", &replicas[i], commit->actual_paths[i] + root_length);
+    }
+  }
+
+  // the renames are only durable once the directories holding them are flushed
+  char(*directories)[2 * SERVER_PATH_SIZE] = malloc(sizeof(*directories) * (file_count > 0 ? file_count : 1));
+  int directory_count = 0;
+
+  for (t_commit *commit = batch; commit != NULL && directories != NULL; commit = commit->next)
+  {
+    for (int i = 0; i < replica_count; i++)
+    {
+      if (!commit->isRenamed[i])
+        continue;
+
+      char parent[2 * SERVER_PATH_SIZE];
+      strncpy(parent, commit->actual_paths[i], sizeof(parent) - 1);
+      parent[sizeof(parent) - 1] = '\0';
+      strcpy(parent, dirname(parent));
+
+      bool isListed = false;
+      for (int j = 0; j < directory_count && !isListed; j++)
+      {
+        isListed = strcmp(directories[j], parent) == 0;
+      }
+
+      if (!isListed)
+        strcpy(directories[directory_count++], parent);
+    }
+  }
+
+  for (int i = 0; i < directory_count; i++)
+  {
+    int directory_fd = open(directories[i], O_RDONLY);
+
+    if (directory_fd < 0 || commit_syncFile(directory_fd) != 0)
+      printf("COMMIT ERROR: Couldn't flush directory %s\n", directories[i]);
+
+    if (directory_fd >= 0)
+      close(directory_fd);
+  }
+
+  free(directories);
+
+  return file_count;
+}
+
+/// @brief Body of the committer thread. Takes every PUT queued since the last round and commits them together, so
+///        PUTs finishing at the same time share the wait for the disk.
+/// @param arg is unused.
+/// @return never returns.
+void *commit_run(void *arg)
+{
+  (void)arg;
+
+  while (true)
+  {
+    pthread_mutex_lock(&committer.mutex);
+
+    while (committer.pending == NULL)
+    {
+      pthread_cond_wait(&committer.isPending, &committer.mutex);
+    }
+
+    // oldest first
+    t_commit *batch = NULL;
+    while (committer.pending != NULL)
+    {
+      t_commit *commit = committer.pending;
+      committer.pending = commit->next;
+      commit->next = batch;
+      batch = commit;
+    }
+
+    pthread_mutex_unlock(&committer.mutex);
+
+    struct timespec started_at;
+    clock_gettime(CLOCK_MONOTONIC, &started_at);
+
+    int file_count = commit_flushBatch(batch);
+
+    pthread_mutex_lock(&committer.mutex);
+
+    int put_count = 0;
+    for (t_commit *commit = batch; commit != NULL; commit = commit->next)
+    {
+      commit->isDone = true;
+      put_count++;
+    }
+
+    committer.rounds++;
+    committer.committed += put_count;
+
+    printf("COMMIT: %d PUTs, %d files made durable in %.2f ms, %ld PUTs in %ld rounds so far\n", put_count,
+           file_count, server_millisecondsSince(&started_at), committer.committed, committer.rounds);
+
+    pthread_cond_broadcast(&committer.isCommitted);
+    pthread_mutex_unlock(&committer.mutex);
+  }
+
+  return NULL;
+}
+
+/// @brief Hands the files of a finished PUT to the committer and waits until they are durable at their destination.
+/// @param commit represents the PUT, its files stay open until this returns.
+/// @return 0 if the file is in place and on disk on the replicas that are still online, -1 if it is on none of them.
+int commit_files(t_commit *commit)
+{
+  pthread_mutex_lock(&committer.mutex);
+
+  commit->isDone = false;
+  commit->next = committer.pending;
+  committer.pending = commit;
+
+  pthread_cond_signal(&committer.isPending);
+
+  while (!commit->isDone)
+  {
+    pthread_cond_wait(&committer.isCommitted, &committer.mutex);
+  }
+
+  pthread_mutex_unlock(&committer.mutex);
+
+  return commit->status;
+}
+
+/// @brief Starts the committer.
+/// @return 0 if successful, -1 otherwise.
+int commit_init()
+{
+  pthread_t commit_thread;
+  pthread_attr_t attr;
+
+  // detach thread, it lives as long as the server
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  int status = pthread_create(&commit_thread, &attr, commit_run, NULL);
+  pthread_attr_destroy(&attr);
+
+  if (status != 0)
+  {
+    printf("INIT ERROR: Couldn't start the committer\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+#pragma endregion Group Commit
+
+#pragma region Deduplicated Writes
+
+/// @brief Flushes the new chunks of a PUT to disk and renames them into place, all of them in one round.
+/// @param dedup represents the PUT.
+/// @return 0 if every chunk is in place and on disk, -1 otherwise.
+int dedup_flushChunks(t_dedup *dedup)
+{
+  if (dedup->pending_count == 0)
+    return 0;
+
+  for (int i = 0; i < dedup->pending_count; i++)
+  {
+    dedup->pending[i].next = i + 1 < dedup->pending_count ? &dedup->pending[i + 1] : NULL;
+  }
+
+  commit_flushBatch(&dedup->pending[0]);
+
+  for (int i = 0; i < dedup->pending_count; i++)
+  {
+    t_commit *commit = &dedup->pending[i];
+
+    if (commit->status != 0)
+      dedup->isFailed = true;
+
+    for (int j = 0; j < replica_count; j++)
+    {
+      if (commit->fds[j] < 0)
+        continue;
+
+      close(commit->fds[j]);
+      commit->fds[j] = -1;
+
+      if (commit->status != 0)
+        unlink(commit->temp_paths[j]);
+    }
+  }
+
+  dedup->pending_count = 0;
+
+  return dedup->isFailed ? -1 : 0;
+}
+
+/// @brief Stores the chunk cut so far on every replica the PUT writes, unless a replica has it already, and adds it
+///        to the manifest.
+/// @param dedup represents the PUT.
+void dedup_storeChunk(t_dedup *dedup)
+{
+  unsigned char hash[SHA256_SIZE];
+  char hex[2 * SHA256_SIZE + 1];
+
+  dedup_sha256(dedup->chunk, dedup->chunk_length, hash);
+  dedup_formatHash(hash, hex);
+
+  // the manifest line
+  if (dedup->manifest_length + sizeof(hex) + 16 > dedup->manifest_capacity)
+  {
+    size_t capacity = dedup->manifest_capacity * 2;
+    char *manifest = realloc(dedup->manifest, capacity);
+    if (manifest == NULL)
+    {
+      dedup->isFailed = true;
+      return;
+    }
+
+    dedup->manifest = manifest;
+    dedup->manifest_capacity = capacity;
+  }
+
+  dedup->manifest_length += sprintf(dedup->manifest + dedup->manifest_length, "%s %d\n", hex, dedup->chunk_length);
+  dedup->size += dedup->chunk_length;
+  dedup->chunk_count++;
+
+  // the same chunk may come again before the last ones were flushed
+  for (int i = 0; i < dedup->pending_count; i++)
+  {
+    if (memcmp(dedup->pending_hashes[i], hash, SHA256_SIZE) == 0)
+      return;
+  }
+
+  t_commit *commit = &dedup->pending[dedup->pending_count];
+  bool isNew = false;
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    commit->fds[i] = -1;
+
+    if (!dedup->isUp[i])
+      continue;
+
+    char *temp_path = dedup->pending_temp_paths[dedup->pending_count][i];
+    char *actual_path = dedup->pending_paths[dedup->pending_count][i];
+    dedup_chunkPath(replicas[i].root, hash, actual_path, sizeof(dedup->pending_paths[0][0]));
+
+    // touching a chunk the replica has keeps a running collection from removing it
+    pthread_rwlock_rdlock(&chunk_store.sweep_lock);
+    bool isStored = utimensat(AT_FDCWD, actual_path, NULL, 0) == 0;
+    pthread_rwlock_unlock(&chunk_store.sweep_lock);
+
+    if (isStored)
+      continue;
+
+    // concurrent PUTs may store the same chunk, each into a temporary file of its own
+    snprintf(temp_path, sizeof(dedup->pending_temp_paths[0][0]), "%s.%ld%s", actual_path,
+             atomic_fetch_add(&chunk_store.temp_files, 1), SERVER_PUT_TEMP_SUFFIX);
+
+    commit->fds[i] = open(temp_path, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    if (commit->fds[i] < 0 && errno == ENOENT)
+    {
+      rebuild_makeParentDirectories(temp_path);
+      commit->fds[i] = open(temp_path, O_WRONLY | O_CREAT | O_EXCL, 0666);
+    }
+
+    // stored with a CRC32C like any checksummed file, so the scrubber can tell a rotten copy
+    if (commit->fds[i] < 0 || write(commit->fds[i], dedup->chunk, dedup->chunk_length) != dedup->chunk_length ||
+        checksum_store(commit->fds[i], checksum_crc32c(0, dedup->chunk, dedup->chunk_length)) != 0)
+    {
+      printf("DEDUP ERROR: Couldn't write chunk %s\n", temp_path);
+      dedup->isFailed = true;
+
+      if (commit->fds[i] >= 0)
+      {
+        close(commit->fds[i]);
+        unlink(temp_path);
+        commit->fds[i] = -1;
+      }
+      continue;
+    }
+
+    commit->temp_paths[i] = temp_path;
+    commit->actual_paths[i] = actual_path;
+    isNew = true;
+  }
+
+  if (!isNew)
+    return;
+
+  dedup->bytes_stored += dedup->chunk_length;
+  memcpy(dedup->pending_hashes[dedup->pending_count], hash, SHA256_SIZE);
+
+  if (++dedup->pending_count == SERVER_CHUNK_FLUSH_COUNT)
+    dedup_flushChunks(dedup);
+}
+
+/// @brief Cuts the next part of a PUT into chunks. A chunk ends where a rolling hash over its last bytes hits a
+///        fixed pattern, so the same content is cut the same way wherever it is in a file, and an edit only changes
+///        the chunks around it.
+/// @param dedup represents the PUT.
+/// @param data is the next part of the file.
+/// @param length is the no. of bytes in it.
+void dedup_write(t_dedup *dedup, const char *data, size_t length)
+{
+  // the hash shifts older bytes out to the left, so the top bits depend on the most bytes
+  const uint64_t boundary_mask = ((1ULL << SERVER_CHUNK_AVERAGE_BITS) - 1) << (64 - SERVER_CHUNK_AVERAGE_BITS);
+
+  for (size_t i = 0; i < length; i++)
+  {
+    unsigned char byte = data[i];
+
+    dedup->chunk[dedup->chunk_length++] = byte;
+    dedup->fingerprint = (dedup->fingerprint << 1) + chunk_gear[byte];
+
+    if ((dedup->chunk_length >= SERVER_CHUNK_MIN_SIZE && (dedup->fingerprint & boundary_mask) == 0) ||
+        dedup->chunk_length == SERVER_CHUNK_MAX_SIZE)
+    {
+      dedup_storeChunk(dedup);
+      dedup->chunk_length = 0;
+      dedup->fingerprint = 0;
+    }
+  }
+}
+
+/// @brief Starts cutting a PUT into chunks.
+/// @param fds is the file of the PUT on each replica, -1 for the replicas that are not written.
+/// @return the state of the PUT, to be closed with dedup_close, NULL if out of memory.
+t_dedup *dedup_open(const int fds[])
+{
+  t_dedup *dedup = malloc(sizeof(t_dedup));
+  if (dedup == NULL)
+    return NULL;
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    dedup->isUp[i] = fds[i] >= 0;
+  }
+  dedup->chunk = malloc(SERVER_CHUNK_MAX_SIZE);
+  dedup->chunk_length = 0;
+  dedup->fingerprint = 0;
+  dedup->manifest_capacity = 4096;
+  dedup->manifest = malloc(dedup->manifest_capacity);
+  dedup->manifest_length = 0;
+  dedup->size = 0;
+  dedup->chunk_count = 0;
+  dedup->bytes_stored = 0;
+  dedup->pending_count = 0;
+  dedup->isFailed = false;
+
+  if (dedup->chunk == NULL || dedup->manifest == NULL)
+  {
+    free(dedup->chunk);
+    free(dedup->manifest);
+    free(dedup);
+    return NULL;
+  }
+
+  dedup->epoch = dedup_beginWrite();
+
+  return dedup;
+}
+
+/// @brief Stores the last chunk of a PUT, makes every new chunk durable and writes the manifest into the files the
+///        PUT commits in place of the contents.
+/// @param dedup represents the PUT.
+/// @param fds is the file on each replica, -1 for the replicas that are not written.
+/// @return 0 if successful, -1 otherwise.
+int dedup_finish(t_dedup *dedup, const int fds[])
+{
+  if (dedup->chunk_length > 0)
+  {
+    dedup_storeChunk(dedup);
+    dedup->chunk_length = 0;
+  }
+
+  if (dedup_flushChunks(dedup) != 0)
+    return -1;
+
+  char header[64];
+  int header_length = sprintf(header, MANIFEST_MAGIC " %lld %d\n", dedup->size, dedup->chunk_count);
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    if (fds[i] >= 0 && (write(fds[i], header, header_length) != header_length ||
+                        write(fds[i], dedup->manifest, dedup->manifest_length) != (ssize_t)dedup->manifest_length))
+      dedup->isFailed = true;
+  }
+
+  printf("DEDUP: %lld bytes in %d chunks, %lld bytes were new\n", dedup->size, dedup->chunk_count, dedup->bytes_stored);
+
+  return dedup->isFailed ? -1 : 0;
+}
+
+/// @brief Ends a PUT that was cut into chunks, dropping the chunks it didn't flush.
+/// @param dedup represents the PUT, may be NULL.
+void dedup_close(t_dedup *dedup)
+{
+  if (dedup == NULL)
+    return;
+
+  for (int i = 0; i < dedup->pending_count; i++)
+  {
+    for (int j = 0; j < replica_count; j++)
+    {
+      if (dedup->pending[i].fds[j] < 0)
+        continue;
+
+      close(dedup->pending[i].fds[j]);
+      unlink(dedup->pending[i].temp_paths[j]);
+    }
+  }
+
+  dedup_endWrite(dedup->epoch);
+
+  free(dedup->chunk);
+  free(dedup->manifest);
+  free(dedup);
+}
+
+/// @brief Prepares the rolling hash chunks are cut with, if files are deduplicated.
+/// @return 0 if successful, -1 otherwise.
+int dedup_init()
+{
+  if (SERVER_STORAGE_MODE != STORAGE_DEDUP)
+    return 0;
+
+  // any fixed random values do, they only have to be the same every time the server runs (splitmix64)
+  uint64_t seed = 0;
+  for (int i = 0; i < 256; i++)
+  {
+    uint64_t value = (seed += 0x9e3779b97f4a7c15ULL);
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    chunk_gear[i] = value ^ (value >> 31);
+  }
+
+  printf("INIT: files are deduplicated in chunks of %d to %d bytes, %d on average\n", SERVER_CHUNK_MIN_SIZE,
+         SERVER_CHUNK_MAX_SIZE, 1 << SERVER_CHUNK_AVERAGE_BITS);
+  return 0;
+}
+
+#pragma endregion Deduplicated Writes
+
+#pragma region Scrubber
+
+/// @brief Paces the scrubber's reads to SERVER_SCRUB_BYTES_PER_SECOND, and holds it back altogether while clients
+///        are transferring files, so it never competes with them for the disks.
+/// @param scrub represents the running pass.
+/// @param bytes is the no. of bytes just read.
+void scrub_throttle(t_scrub *scrub, size_t bytes)
+{
+  scrub->bytes_read += bytes;
+
+  // each block is due a fixed time after the one before, time spent backing off doesn't buy a burst later
+  double now_ms = server_millisecondsSince(&scrub->started_at);
+  if (scrub->next_read_ms < now_ms)
+    scrub->next_read_ms = now_ms;
+  scrub->next_read_ms += bytes * 1000.0 / SERVER_SCRUB_BYTES_PER_SECOND;
+
+  if (scrub->next_read_ms > now_ms)
+    usleep((useconds_t)((scrub->next_read_ms - now_ms) * 1000));
+
+  while (atomic_load(&foreground_transfers) > 0)
+  {
+    usleep(SERVER_SCRUB_BACKOFF_MS * 1000);
+  }
+}
+
+/// @brief Reads a file at the scrubber's pace and computes its CRC32C.
+/// @param scrub represents the running pass.
+/// @param path is the file.
+/// @param crc is filled with the CRC32C of the file.
+/// @param state is set to 1 if the file matches the CRC32C stored with it, -1 if it doesn't and 0 if it can't tell.
+/// @return 0 if the whole file was read, -1 otherwise.
+int scrub_checksumFile(t_scrub *scrub, const char *path, uint32_t *crc, int *state)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+
+  uint32_t stored_crc;
+  bool isStored = checksum_load(fd, &stored_crc) == 0;
+  *crc = 0;
+
+  // a manifest is stored with the CRC32C of the file it stands for, the chunks it names are checked on their own
+  t_manifest *manifest;
+  bool isBroken = dedup_loadManifest(fd, &manifest) != 0;
+  bool isManifest = isBroken || manifest != NULL;
+  dedup_freeManifest(manifest);
+
+  ssize_t bytes_read;
+  while ((bytes_read = read(fd, scrub->buffer, SERVER_SCRUB_BLOCK_SIZE)) > 0)
+  {
+    *crc = checksum_crc32c(*crc, scrub->buffer, bytes_read);
+    scrub_throttle(scrub, bytes_read);
+  }
+
+#ifdef __linux__
+  // the scrubber reads every file once, leave the page cache to the files clients are using
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+
+  if (isManifest)
+    *state = isBroken ? -1 : 0;
+  else
+    *state = !isStored ? 0 : *crc == stored_crc ? 1 : -1;
+
+  close(fd);
+  return bytes_read == 0 ? 0 : -1;
+}
+
+/// @brief Tells whether a path still looks as it did when it was checked, so a repair doesn't undo a newer write.
+/// @param path is the path.
+/// @param checked_stat is what lstat gave when it was checked, st_mode 0 if it didn't exist.
+/// @return true if the path is unchanged.
+bool scrub_isUnchanged(const char *path, const struct stat *checked_stat)
+{
+  struct stat path_stat;
+
+  if (lstat(path, &path_stat) != 0)
+    return checked_stat->st_mode == 0;
+
+  // a PUT renames a new file over the old one, so a new inode gives it away even within the same second
+  return path_stat.st_mode == checked_stat->st_mode && path_stat.st_ino == checked_stat->st_ino &&
+         path_stat.st_size == checked_stat->st_size && path_stat.st_mtime == checked_stat->st_mtime;
+}
+
+/// @brief Repairs one path of a replica from a good copy, unless either copy changed since it was checked.
+/// @param scrub represents the running pass.
+/// @param good is the replica holding the good copy.
+/// @param bad is the replica repaired.
+/// @param path is the path, relative to the root directory.
+/// @param good_stat is the good copy as it was checked.
+/// @param bad_stat is the bad copy as it was checked, st_mode 0 if it was missing.
+void scrub_repairPath(t_scrub *scrub, t_replica *good, t_replica *bad, const char *path, const struct stat *good_stat,
+                      const struct stat *bad_stat)
+{
+  char good_path[800], bad_path[800];
+  snprintf(good_path, sizeof(good_path), "%s%s", good->root, path);
+  snprintf(bad_path, sizeof(bad_path), "%s%s", bad->root, path);
+
+  // the bad copy is rewritten in place, so readers have to stay off the path as well as writers, a GET balanced
+  // onto the bad replica would otherwise stream a half copied file
+  t_pathLockSet path_locks_held;
+  if (path_lock(path, LOCK_MODE_EXCLUSIVE, &path_locks_held) != 0)
+    return;
+
+  // in the order of the config file, like every command holding several replicas
+  t_replica *first = good < bad ? good : bad;
+  t_replica *second = good < bad ? bad : good;
+  directory_acquireDirectory(first);
+  directory_acquireDirectory(second);
+
+  if (!atomic_load(&good->isInit) || !atomic_load(&bad->isInit) || replicator_isStale(bad, path) ||
+      !scrub_isUnchanged(good_path, good_stat) || !scrub_isUnchanged(bad_path, bad_stat))
+  {
+    printf("SCRUB: %s changed while it was checked, leaving it to the next pass\n", path);
+  }
+  else
+  {
+    journal_syncPath(good->root, bad->root, path);
+    scrub->repaired++;
+
+    printf("SCRUB: repaired %s on directory %d from directory %d\n", path, bad->id, good->id);
+  }
+
+  directory_releaseDirectory(second);
+  directory_releaseDirectory(first);
+
+  path_unlock(&path_locks_held);
+}
+
+/// @brief Compares one file of the reference replica with its copy on the target and repairs whichever copy is bad.
+///        A copy whose contents match its stored CRC32C is known good, one that doesn't is known bad. Without stored
+///        CRC32Cs to tell, the reference wins.
+/// @param scrub represents the running pass.
+/// @param path is the file, relative to the root directory.
+/// @param reference_stat is the reference copy.
+void scrub_checkFile(t_scrub *scrub, const char *path, const struct stat *reference_stat)
+{
+  char reference_path[800], target_path[800];
+  snprintf(reference_path, sizeof(reference_path), "%s%s", scrub->reference->root, path);
+  snprintf(target_path, sizeof(target_path), "%s%s", scrub->target->root, path);
+
+  struct stat target_stat = {0};
+  if (lstat(target_path, &target_stat) != 0 || !S_ISREG(target_stat.st_mode) ||
+      target_stat.st_size != reference_stat->st_size)
+  {
+    if (lstat(target_path, &target_stat) != 0)
+      target_stat.st_mode = 0;
+
+    printf("SCRUB: %s is missing or differs in size on directory %d\n", path, scrub->target->id);
+    scrub_repairPath(scrub, scrub->reference, scrub->target, path, reference_stat, &target_stat);
+    return;
+  }
+
+  // 1 known good, 0 can't tell, -1 known bad
+  uint32_t reference_crc, target_crc;
+  int reference_state, target_state;
+
+  if (scrub_checksumFile(scrub, reference_path, &reference_crc, &reference_state) != 0 ||
+      scrub_checksumFile(scrub, target_path, &target_crc, &target_state) != 0)
+    return;
+
+  scrub->files_checked++;
+
+  if (reference_crc == target_crc && reference_state >= 0 && target_state >= 0)
+    return;
+
+  printf("SCRUB: %s differs between directory %d and directory %d\n", path, scrub->reference->id, scrub->target->id);
+
+  if (reference_state == 1 || (reference_state == 0 && target_state != 1))
+  {
+    scrub_repairPath(scrub, scrub->reference, scrub->target, path, reference_stat, &target_stat);
+  }
+  else if (target_state == 1)
+  {
+    scrub_repairPath(scrub, scrub->target, scrub->reference, path, &target_stat, reference_stat);
+  }
+  else
+  {
+    printf("SCRUB ERROR: no copy of %s matches its checksum, it can't be repaired\n", path);
+    scrub->unresolved++;
+  }
+}
+
+/// @brief Removes a partial file of a PUT that wasn't written to for SERVER_UPLOAD_EXPIRY_SECONDS, left behind by an
+///        upload that was never resumed or by a crash.
+/// @param replica is the replica holding the file.
+/// @param path is the partial file, relative to the root directory.
+void scrub_expirePartialFile(t_replica *replica, const char *path)
+{
+  char destination[SERVER_PATH_SIZE];
+  char full_path[800];
+  struct stat file_stat;
+
+  if (upload_destinationPath(path, destination, sizeof(destination)) != 0)
+    return;
+
+  snprintf(full_path, sizeof(full_path), "%s%s", replica->root, path);
+  if (lstat(full_path, &file_stat) != 0 || !S_ISREG(file_stat.st_mode) ||
+      time(NULL) - file_stat.st_mtime < SERVER_UPLOAD_EXPIRY_SECONDS)
+    return;
+
+  // a PUT opens its partial file while it holds the destination, so a resumed upload isn't pulled from under it
+  t_pathLockSet path_locks_held;
+  if (path_lock(destination, LOCK_MODE_EXCLUSIVE, &path_locks_held) != 0)
+    return;
+
+  if (lstat(full_path, &file_stat) == 0 && S_ISREG(file_stat.st_mode) &&
+      time(NULL) - file_stat.st_mtime >= SERVER_UPLOAD_EXPIRY_SECONDS && unlink(full_path) == 0)
+  {
+    printf("SCRUB: removed %s from directory %d, it wasn't written to for %lld seconds\n", path, replica->id,
+           (long long)(time(NULL) - file_stat.st_mtime));
+  }
+
+  path_unlock(&path_locks_held);
+}
+
+/// @brief Compares a directory of the reference replica with the target, recursively, repairing what differs.
+/// @param scrub represents the running pass.
+/// @param path is the directory, relative to the root directory, "" for the root.
+void scrub_checkDirectory(t_scrub *scrub, const char *path)
+{
+  char reference_path[800], target_path[800];
+  snprintf(reference_path, sizeof(reference_path), "%s%s", scrub->reference->root, path);
+  snprintf(target_path, sizeof(target_path), "%s%s", scrub->target->root, path);
+
+  // a replica that went offline, or fell behind on purpose, is caught up by the journal or the replicator
+  if (!atomic_load(&scrub->reference->isInit) || !atomic_load(&scrub->target->isInit) ||
+      replicator_isStale(scrub->target, path))
+    return;
+
+  struct stat target_stat = {0};
+  if (lstat(target_path, &target_stat) != 0 || !S_ISDIR(target_stat.st_mode))
+  {
+    struct stat reference_stat;
+    if (lstat(target_path, &target_stat) != 0)
+      target_stat.st_mode = 0;
+
+    if (lstat(reference_path, &reference_stat) == 0)
+      scrub_repairPath(scrub, scrub->reference, scrub->target, path, &reference_stat, &target_stat);
+    return;
+  }
+
+  for (int pass = 0; pass < 2; pass++)
+  {
+    // the reference's entries first, then whatever only the target has
+    DIR *dir = opendir(pass == 0 ? reference_path : target_path);
+    if (dir == NULL)
+      return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        continue;
+
+      char relative_path[SERVER_PATH_SIZE];
+      if (snprintf(relative_path, sizeof(relative_path), "%s%s%s", path, path[0] == '\0' ? "" : "/", entry->d_name) >=
+          (int)sizeof(relative_path))
+        continue;
+
+      // partial files belong to the PUTs writing them, only the abandoned ones are cleared away
+      if (directory_isPutTempFile(entry->d_name))
+      {
+        scrub_expirePartialFile(pass == 0 ? scrub->reference : scrub->target, relative_path);
+        continue;
+      }
+
+      char entry_path[800];
+      struct stat reference_stat = {0};
+      snprintf(entry_path, sizeof(entry_path), "%s%s", scrub->reference->root, relative_path);
+      bool isOnReference = lstat(entry_path, &reference_stat) == 0;
+
+      if (pass == 0 && isOnReference && S_ISDIR(reference_stat.st_mode))
+      {
+        scrub_checkDirectory(scrub, relative_path);
+      }
+      else if (pass == 0 && isOnReference && S_ISREG(reference_stat.st_mode))
+      {
+        if (!replicator_isStale(scrub->target, relative_path))
+          scrub_checkFile(scrub, relative_path, &reference_stat);
+      }
+      else if (pass == 1 && !isOnReference && !replicator_isStale(scrub->target, relative_path))
+      {
+        struct stat entry_stat;
+        snprintf(entry_path, sizeof(entry_path), "%s%s", scrub->target->root, relative_path);
+
+        if (lstat(entry_path, &entry_stat) == 0)
+        {
+          printf("SCRUB: %s is only on directory %d\n", relative_path, scrub->target->id);
+          scrub_repairPath(scrub, scrub->reference, scrub->target, relative_path, &reference_stat, &entry_stat);
+        }
+      }
+    }
+
+    closedir(dir);
+  }
+}
+
+/// @brief Body of the scrubber thread. Every SERVER_SCRUB_INTERVAL_SECONDS, walks the reference replica (the primary
+///        while it is online) and every other online replica side by side and repairs the copies that went bad.
+/// @param arg is unused.
+/// @return never returns.
+void *scrub_run(void *arg)
+{
+  (void)arg;
+
+  t_scrub scrub;
+  scrub.buffer = malloc(SERVER_SCRUB_BLOCK_SIZE);
+  if (scrub.buffer == NULL)
+  {
+    printf("SCRUB ERROR: Couldn't allocate memory for a block, the scrubber is off\n");
+    return NULL;
+  }
+
+  while (true)
+  {
+    sleep(SERVER_SCRUB_INTERVAL_SECONDS);
+
+    // chunks no file needs anymore are dropped first, so they aren't compared either
+    dedup_collectGarbage();
+
+    scrub.reference = directory_findSourceDirectory(NULL);
+
+    for (int i = 0; i < replica_count && scrub.reference != NULL; i++)
+    {
+      scrub.target = &replicas[i];
+      if (scrub.target == scrub.reference || !atomic_load(&scrub.target->isInit))
+        continue;
+
+      clock_gettime(CLOCK_MONOTONIC, &scrub.started_at);
+      scrub.next_read_ms = 0;
+      scrub.bytes_read = 0;
+      scrub.files_checked = 0;
+      scrub.repaired = 0;
+      scrub.unresolved = 0;
+
+      printf("SCRUB: comparing directory %d with directory %d\n", scrub.target->id, scrub.reference->id);
+
+      scrub_checkDirectory(&scrub, "");
+
+      printf("SCRUB: directory %d checked in %.1f s, %ld files and %lld bytes read, %d repaired, %d unresolved\n",
+             scrub.target->id, server_millisecondsSince(&scrub.started_at) / 1000, scrub.files_checked,
+             scrub.bytes_read, scrub.repaired, scrub.unresolved);
+    }
+  }
+
+  return NULL;
+}
+
+/// @brief Starts the scrubber, unless SERVER_SCRUB_INTERVAL_SECONDS turns it off.
+/// @return 0 if successful, -1 otherwise.
+int scrub_init()
+{
+  if (SERVER_SCRUB_INTERVAL_SECONDS <= 0)
+    return 0;
+
+  pthread_t scrub_thread;
+  pthread_attr_t attr;
+
+  // detach thread, it lives as long as the server
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  int status = pthread_create(&scrub_thread, &attr, scrub_run, NULL);
+  pthread_attr_destroy(&attr);
+
+  if (status != 0)
+  {
+    printf("INIT ERROR: Couldn't start the scrubber\n");
+    return -1;
+  }
+
+  printf("INIT: scrubber compares the replicas every %d s, reading at most %d bytes/s\n",
+         SERVER_SCRUB_INTERVAL_SECONDS, SERVER_SCRUB_BYTES_PER_SECOND);
+  return 0;
+}
+
+#pragma endregion Scrubber
+
+#pragma region Init
+
+/// @brief Initializes the socket when the server goes up.
+/// @return 0 if socket creation is successful, -1 otherwise.
+int init_createServerSocket()
+{
+  // Create socket:
+  socket_desc = socket(AF_INET, SOCK_STREAM, 0);
+
+  if (socket_desc < 0)
+  {
+    printf("ERROR: Error while creating socket\n");
+    server_closeServerSocket();
+    return -1;
+  }
+  printf("INIT: Socket created successfully\n");
+  return 0;
+}
+
+/// @brief Binds the server socket to the port.
+/// @return 0 in case of successful binding. -1 otherwise.
+int init_bindServerSocket()
+{
+  // Set port and IP:
+  server_addr.sin_family = AF_INET;
+  server_addr.sin_port = htons(SERVER_PORT);
+  server_addr.sin_addr.s_addr = inet_addr(SERVER_IP);
+
+  // Bind to the set port and IP:S
+  if (bind(socket_desc, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0)
+  {
+    printf("ERROR: Couldn't bind to the port\n");
+    server_closeServerSocket();
+    return -1;
+  }
+  printf("INIT: Done with binding\n");
+  return 0;
+}
+
+/// @brief Starts listening on the server socket, with room for bursts of clients connecting at once.
+/// @return 0 if successful, -1 otherwise.
+int init_listenServerSocket()
+{
+  if (listen(socket_desc, SERVER_LISTEN_BACKLOG) < 0)
+  {
+    printf("ERROR: Error while listening\n");
+    server_closeServerSocket();
+    return -1;
+  }
+  printf("INIT: Listening for incoming connections\n");
+
+  // every connection costs a descriptor, allow as many as the system lets us have
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+  {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  return 0;
+}
+
+/// @brief Adds a replica to the ones the server keeps.
+/// @param root is the root directory of the replica, a '/' is added if it doesn't end with one.
+/// @return 0 if successful, -1 otherwise.
+int init_addReplica(const char *root)
+{
+  size_t length = strlen(root);
+
+  if (replica_count == SERVER_MAX_REPLICAS || length == 0 || length + 2 > SERVER_PATH_SIZE)
+  {
+    printf("INIT ERROR: Couldn't add replica %s, at most %d replicas with roots shorter than %d characters\n", root,
+           SERVER_MAX_REPLICAS, SERVER_PATH_SIZE - 1);
+    return -1;
+  }
+
+  t_replica *replica = &replicas[replica_count];
+
+  replica->id = replica_count + 1;
+  strcpy(replica->root, root);
+  if (root[length - 1] != '/')
+    strcat(replica->root, "/");
+
+  if (pthread_rwlock_init(&replica->lock, NULL) != 0 || pthread_mutex_init(&replica->journal.mutex, NULL) != 0)
+  {
+    printf("INIT ERROR: root directory %d lock init failed\n", replica->id);
+    exit(1);
+  }
+  atomic_init(&replica->isInit, false);
+
+  replica_count++;
+  return 0;
+}
+
+/// @brief Loads the replicas from SERVER_CONFIG_FILE. Every line is either `replica <root directory>` or
+///        `primary <no.>`, lines starting with # are comments. Replicas are numbered from 1 in the order they are
+///        listed. Without the file, the server keeps ROOT_DIRECTORY_1 and ROOT_DIRECTORY_2.
+/// @return 0 if successful, -1 otherwise.
+int init_loadReplicas()
+{
+  int primary = SERVER_PRIMARY_DIRECTORY;
+  bool isPrimaryGiven = false;
+
+  FILE *config = fopen(SERVER_CONFIG_FILE, "r");
+
+  if (config == NULL)
+  {
+    printf("INIT: no %s, using the built-in root directories\n", SERVER_CONFIG_FILE);
+
+    if (init_addReplica(ROOT_DIRECTORY_1) != 0 || init_addReplica(ROOT_DIRECTORY_2) != 0)
+      return -1;
+  }
+  else
+  {
+    char line[2 * SERVER_PATH_SIZE];
+    int line_no = 0;
+
+    while (fgets(line, sizeof(line), config) != NULL)
+    {
+      char key[16];
+      char value[SERVER_PATH_SIZE];
+      int fields = sscanf(line, "%15s %199s", key, value);
+      line_no++;
+
+      if (fields <= 0 || key[0] == '#')
+        continue;
+
+      if (fields == 2 && strcmp(key, "replica") == 0)
+      {
+        if (init_addReplica(value) != 0)
+        {
+          fclose(config);
+          return -1;
+        }
+      }
+      else if (fields == 2 && strcmp(key, "primary") == 0)
+      {
+        primary = atoi(value);
+        isPrimaryGiven = true;
+      }
+      else
+      {
+        printf("INIT ERROR: %s line %d is not understood: %s", SERVER_CONFIG_FILE, line_no, line);
+        fclose(config);
+        return -1;
+      }
+    }
+
+    fclose(config);
+  }
+
+  if (replica_count == 0)
+  {
+    printf("INIT ERROR: %s lists no replica\n", SERVER_CONFIG_FILE);
+    return -1;
+  }
+
+  if (primary < 1 || primary > replica_count)
+  {
+    if (isPrimaryGiven)
+    {
+      printf("INIT ERROR: primary %d is not one of the %d replicas\n", primary, replica_count);
+      return -1;
+    }
+    primary = 1;
+  }
+  primary_replica = &replicas[primary - 1];
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    printf("INIT: root directory %d is %s%s\n", replicas[i].id, replicas[i].root,
+           &replicas[i] == primary_replica ? " (primary)" : "");
+  }
+
+  return 0;
+}
+
+/// @brief Initialises the root directories, if not existing already, representing the server file space.
+/// @return 0 if successful, -1 otherwise.
+int init_createRootDirectory()
+{
+  bool isFresh[SERVER_MAX_REPLICAS];
+  int online = 0;
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    t_replica *replica = &replicas[i];
+    struct stat st = {0};
+
+    isFresh[i] = false;
+
+    if (stat(replica->root, &st) == -1)
+    {
+      // created using S_IREAD, S_IWRITE, S_IEXEC (0400 | 0200 | 0100) permission flags
+      int res = mkdir(replica->root, 0700);
+      if (res != 0)
+      {
+        atomic_store(&replica->isInit, false);
+        replica->isAvailable = false;
+        printf("INIT ERROR: root directory %d creation failed\n", replica->id);
+      }
+      else
+      {
+        atomic_store(&replica->isInit, true);
+        replica->isAvailable = true;
+        isFresh[i] = true;
+        printf("INIT: root directory %d initialization successful\n", replica->id);
+      }
+    }
+    else
+    {
+      atomic_store(&replica->isInit, true);
+      replica->isAvailable = true;
+      printf("INIT: root directory %d already exists.\n", replica->id);
+    }
+
+    if (atomic_load(&replica->isInit))
+      online++;
+  }
+
+  if (online == 0)
+  {
+    printf("INIT ERROR: init failed for every root directory\n");
+    return -1;
+  }
+
+  // fresh replicas are cloned from one that already existed, the primary if it did
+  t_replica *source = NULL;
+  for (int i = 0; i < replica_count; i++)
+  {
+    bool isUsable = atomic_load(&replicas[i].isInit) && !isFresh[i];
+
+    if (isUsable && (source == NULL || &replicas[i] == primary_replica))
+      source = &replicas[i];
+  }
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    if (source == NULL || !isFresh[i])
+      continue;
+
+    printf("INIT: directory %d is fresh, cloning directory %d into directory %d\n", replicas[i].id, source->id,
+           replicas[i].id);
+    directory_cloneDirectory(source, &replicas[i]);
+  }
+
+  if (source == NULL)
+  {
+    printf("INIT: every root directory is fresh\n");
+  }
+
+  // a replica that goes offline from here on is told apart from a different directory by its root
+  for (int i = 0; i < replica_count; i++)
+  {
+    if (atomic_load(&replicas[i].isInit))
+      journal_rememberDirectory(&replicas[i]);
+  }
+
+  return 0;
+}
+
+/// @brief Initialises the server. Creates and binds socket to a port and creates root directory.
+/// @return 0 if process is successful. -1 otherwise.
+int initServer()
+{
+  int status;
+  status = init_createServerSocket();
+  if (status != 0)
+    return -1;
+  status = init_bindServerSocket();
+  if (status != 0)
+    return -1;
+  status = init_listenServerSocket();
+  if (status != 0)
+    return -1;
+  status = init_loadReplicas();
+  if (status != 0)
+    return -1;
+  status = init_createRootDirectory();
+  if (status != 0)
+    return -1;
+  status = replicator_init();
+  if (status != 0)
+    return -1;
+  status = monitor_init();
+  if (status != 0)
+    return -1;
+  status = commit_init();
+  if (status != 0)
+    return -1;
+  status = dedup_init();
+  if (status != 0)
+    return -1;
+  status = scrub_init();
+  if (status != 0)
+    return -1;
+
+  return 0;
+}
+
+#pragma endregion Init
+
+#pragma region Directory Management
+
+/// @brief This method tells whether a root directory is initialzed, as last seen by the health monitor.
+/// @param replica is the replica.
+/// @return True if the directory is initialized.
+bool directory_isDirectoryInit(t_replica *replica)
+{
+  return atomic_load(&replica->isInit);
+}
+
+/// @brief Picks a replica to read from and acquires it. Of the replicas that are up, the one serving the fewest
+///        reads is picked, so reads spread over every copy. Replicas serving as many reads take turns, so short reads
+///        that never overlap, like the pieces of a parallel GET, still use every copy. Waits without spinning while
+///        all are being cloned.
+/// @param command_name names the command in the logs.
+/// @param path is the path read, a replica that hasn't caught up with a change to it is not picked.
+/// @param root_path is filled with the root directory of the picked replica.
+/// @return the replica acquired.
+t_replica *directory_acquireReadDirectory(const char *command_name, const char *path, char *root_path)
+{
+  t_replica *target = NULL;
+
+  while (target == NULL)
+  {
+    // a replica that is behind on a change to the path can't serve it yet
+    bool isUp[SERVER_MAX_REPLICAS];
+    for (int i = 0; i < replica_count; i++)
+    {
+      isUp[i] = directory_isDirectoryInit(&replicas[i]) && !replicator_isStale(&replicas[i], path);
+    }
+
+    pthread_mutex_lock(&replica_mutex);
+
+    for (int turn = 0; turn < replica_count; turn++)
+    {
+      int i = (read_turn + turn) % replica_count;
+      if (isUp[i] && replicas[i].isAvailable && (target == NULL || replicas[i].reads < target->reads))
+        target = &replicas[i];
+    }
+
+    if (target != NULL)
+    {
+      target->reads++;
+      read_turn = (read_turn + 1) % replica_count;
+    }
+    else
+    {
+      printf("%s: Waiting for available directory\n", command_name);
+
+      // the health monitor and the end of a clone both signal, the timeout only covers a missed wakeup
+      struct timespec deadline;
+      clock_gettime(CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += 1;
+
+      pthread_cond_timedwait(&replica_changed, &replica_mutex, &deadline);
+    }
+
+    pthread_mutex_unlock(&replica_mutex);
+  }
+
+  directory_acquireDirectory(target);
+  strcpy(root_path, target->root);
+
+  printf("%s: Directory %d is acquired\n", command_name, target->id);
+
+  return target;
+}
+
+/// @brief Releases a replica acquired by directory_acquireReadDirectory.
+/// @param replica is the replica.
+void directory_releaseReadDirectory(t_replica *replica)
+{
+  directory_releaseDirectory(replica);
+
+  pthread_mutex_lock(&replica_mutex);
+
+  replica->reads--;
+
+  pthread_mutex_unlock(&replica_mutex);
+}
+
+/// @brief Picks the replicas a write command changes and acquires them: every online replica, except the
+///        secondaries left to the replicator in asynchronous mode.
+/// @param command_name names the command in the logs.
+/// @param path is the path changed, relative to the root directory.
+/// @param isStaged is true if the command only writes partial files, eg. a range of an upload. Those are written on
+///        every online replica and left out of the journals and the replicator, FINISH is what changes the path.
+/// @param set is filled with the replicas acquired and the path on each of them.
+void directory_acquireWriteDirectories(const char *command_name, const char *path, bool isStaged, t_writeSet *set)
+{
+  set->count = 0;
+  set->isStaged = isStaged;
+
+  // which replicas are online, as last seen by the health monitor
+  for (int i = 0; i < replica_count; i++)
+  {
+    set->isUp[i] = directory_isDirectoryInit(&replicas[i]);
+  }
+
+  // with asynchronous replication the secondaries are left to the replicator, the client doesn't wait for them
+  set->isDeferred = !isStaged && replicator_deferDirectories(command_name, path, set->isUp);
+
+  // in the order of the config file, like cloning, so commands can't deadlock with it
+  for (int i = 0; i < replica_count; i++)
+  {
+    if (!set->isUp[i])
+      continue;
+
+    directory_acquireDirectory(&replicas[i]);
+
+    printf("%s: Directory %d is acquired\n", command_name, replicas[i].id);
+
+    snprintf(set->actual_paths[i], sizeof(set->actual_paths[i]), "%s%s", replicas[i].root, path);
+
+    printf("%s: actual path: %s\n", command_name, set->actual_paths[i]);
+
+    set->count++;
+  }
+
+  // no directory is available, quit program
+  if (set->count == 0)
+  {
+    printf("%s ERROR: No Directory is available\n", command_name);
+    server_closeServerSocket();
+    exit(1);
+  }
+}
+
+/// @brief Releases the replicas acquired by directory_acquireWriteDirectories. The replicas the command did not
+///        write are told about the change first, while the command still holds the path.
+/// @param command_name names the command in the logs.
+/// @param path is the path changed, relative to the root directory.
+/// @param set represents the replicas acquired.
+void directory_releaseWriteDirectories(const char *command_name, const char *path, t_writeSet *set)
+{
+  // replicas that are offline or behind get this path synced when they catch up
+  if (!set->isStaged)
+    journal_recordChange(command_name, path, set->isDeferred ? NULL : set->isUp);
+  if (set->isDeferred)
+    replicator_queueChange(command_name, path);
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    if (set->isUp[i])
+      directory_releaseDirectory(&replicas[i]);
+  }
+}
+
+#pragma endregion Directory Management
+
+#pragma region Communication
+
+/// @brief Bounds every blocking send and receive on a client socket by SERVER_IDLE_TIMEOUT_SECONDS, so a client that
+///        stops in the middle of a command can't keep a worker and the locks of the command forever. A call that runs
+///        out of time fails with EAGAIN, and the command gives up on the client like on one that went away.
+/// @param client_sock is the socket of the client.
+void server_setClientTimeouts(int client_sock)
+{
+  struct timeval timeout;
+  timeout.tv_sec = SERVER_IDLE_TIMEOUT_SECONDS;
+  timeout.tv_usec = 0;
+
+  if (setsockopt(client_sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0 ||
+      setsockopt(client_sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) != 0)
+  {
+    printf("ERROR: Couldn't set the timeouts of client socket %d\n", client_sock);
+  }
+}
+
+/// @brief Tells whether the socket call that just failed ran out of the time server_setClientTimeouts gave it.
+/// @return true if the client stalled, false if the call failed for another reason.
+bool server_isClientTimedOut()
+{
+  return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+/// @brief Sends a message to the client.
+/// @param client_sock is the socket of the client the message is to be sent to.
+/// @param server_message represents the server message.
+/// @return 0 if the message was sent, -1 otherwise.
+int server_sendMessageToClient(int client_sock, char *server_message)
+{
+  // printf("SENDING TO CLIENT: %s\n", server_message);
+  if (frame_send(client_sock, FRAME_OP_STATUS, FRAME_FLAG_NONE, server_message, strlen(server_message)) < 0)
+  {
+    printf(server_isClientTimedOut() ? "ERROR: Client stopped reading, giving up on it\n" : "ERROR: Can't send\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+/// @brief Sends a block of a file to the client without copying it through user space.
+///        The frame header goes out first and the kernel then moves the file contents straight to the socket.
+/// @param client_sock is the socket of the client the data is to be sent to.
+/// @param fd is the descriptor of the file being sent.
+/// @param offset is the position in the file the block starts at.
+/// @param length is the no. of bytes in the block.
+/// @return 0 if the block was sent, -1 otherwise.
+int server_sendFileDataToClient(int client_sock, int fd, off_t offset, int length)
+{
+  if (frame_sendHeader(client_sock, FRAME_OP_DATA, FRAME_FLAG_NONE, length) < 0)
+  {
+    printf(server_isClientTimedOut() ? "ERROR: Client stopped reading, giving up on it\n" : "ERROR: Can't send\n");
+    return -1;
+  }
+
+  while (length > 0)
+  {
+#ifdef __linux__
+    ssize_t sent = sendfile(client_sock, fd, &offset, length);
+#else
+    // no sendfile(2) with these semantics here, fall back to a read and a send
+    char buffer[SERVER_MESSAGE_SIZE];
+    ssize_t sent = pread(fd, buffer, length < (int)sizeof(buffer) ? length : (int)sizeof(buffer), offset);
+    if (sent > 0)
+    {
+      sent = send(client_sock, buffer, sent, 0);
+      if (sent > 0)
+        offset += sent;
+    }
+#endif
+    if (sent < 0 && errno == EINTR)
+      continue;
+    if (sent <= 0)
+    {
+      // the header promised more bytes than we could deliver, the stream can't be recovered
+      printf(server_isClientTimedOut() ? "ERROR: Client stopped reading, giving up on it\n"
+                                       : "ERROR: Can't send file contents\n");
+      return -1;
+    }
+
+    length -= sent;
+  }
+
+  return 0;
+}
+
+/// @brief Sends a block of a file that is already in memory, eg. put back together from chunks.
+/// @param client_sock is the socket of the client.
+/// @param buffer is the block, holds at least length + CHECKSUM_SIZE bytes.
+/// @param length is the no. of bytes in the block.
+/// @param packed holds at least length + CHECKSUM_SIZE bytes for the block compressed, NULL to send it raw.
+/// @param isChecksummed is true if the client agreed on checksums, the frame then ends with the CRC32C of the block.
+/// @param file_crc is the CRC32C of the file up to the block, the block is added to it if isChecksummed.
+/// @return 0 if the whole frame was sent, -1 otherwise.
+int server_sendBlockToClient(int client_sock, char *buffer, int length, char *packed, bool isChecksummed,
+                             uint32_t *file_crc)
+{
+  char *payload = buffer;
+  int payload_length = length;
+  uint16_t flags = FRAME_FLAG_NONE;
+
+  // a block that doesn't get smaller goes out as it is
+  int packed_length = packed != NULL ? compress_block(buffer, length, packed, length - 1) : -1;
+  if (packed_length > 0)
+  {
+    payload = packed;
+    payload_length = packed_length;
+    flags |= FRAME_FLAG_COMPRESSED;
+  }
+
+  if (isChecksummed)
+  {
+    uint32_t crc = htonl(checksum_crc32c(0, buffer, length));
+    memcpy(payload + payload_length, &crc, CHECKSUM_SIZE);
+
+    *file_crc = checksum_crc32c(*file_crc, buffer, length);
+    payload_length += CHECKSUM_SIZE;
+    flags |= FRAME_FLAG_CHECKSUM;
+  }
+
+  if (frame_send(client_sock, FRAME_OP_DATA, flags, payload, payload_length) < 0)
+  {
+    printf(server_isClientTimedOut() ? "ERROR: Client stopped reading, giving up on it\n" : "ERROR: Can't send\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+/// @brief Sends a block of a file through a buffer, for clients that agreed on checksums or compression. The block
+///        has to pass through user space to be checksummed or compressed, so it is read rather than sent with sendfile.
+/// @param client_sock is the socket of the client.
+/// @param fd is the file.
+/// @param offset is where the block starts in the file.
+/// @param length is the no. of bytes in the block.
+/// @param buffer holds at least length + CHECKSUM_SIZE bytes.
+/// @param packed holds at least length + CHECKSUM_SIZE bytes for the block compressed, NULL to send it raw.
+/// @param isChecksummed is true if the frame is to end with the CRC32C of the block.
+/// @param file_crc is the CRC32C of the file up to the block, the block is added to it if isChecksummed.
+/// @return 0 if the whole frame was sent, -1 otherwise.
+int server_sendBufferedFileDataToClient(int client_sock, int fd, off_t offset, int length, char *buffer, char *packed,
+                                        bool isChecksummed, uint32_t *file_crc)
+{
+  int filled = 0;
+
+  while (filled < length)
+  {
+    ssize_t bytes_read = pread(fd, buffer + filled, length - filled, offset + filled);
+    if (bytes_read < 0 && errno == EINTR)
+      continue;
+    if (bytes_read <= 0)
+    {
+      printf("ERROR: Can't read file contents\n");
+      return -1;
+    }
+
+    filled += bytes_read;
+  }
+
+  return server_sendBlockToClient(client_sock, buffer, length, packed, isChecksummed, file_crc);
+}
+
+/// @brief Receives a frame from the client.
+/// @param client_sock is the socket of the client the message is to be received from.
+/// @param header is filled with the received frame header.
+/// @param client_message represents the received client message or file contents.
+/// @param capacity is the size of client_message.
+/// @return 0 if a frame was received, -1 otherwise.
+int server_recieveFrameFromClient(int client_sock, t_frameHeader *header, char *client_message, int capacity)
+{
+  if (frame_recv(client_sock, header, client_message, capacity) < 0)
+  {
+    printf(server_isClientTimedOut() ? "ERROR: Client stopped sending, giving up on it\n"
+                                     : "ERROR: Error while receiving client's msg\n");
+    return -1;
+  }
+
+  // printf("RECIEVED FROM CLIENT: %s\n", client_message);
+  return 0;
+}
+
+/// @brief Receives the payload of a frame whose header was already received from the client.
+/// @param client_sock is the socket of the client the message is to be received from.
+/// @param header is the header of the frame.
+/// @param client_message represents the received client message.
+/// @param capacity is the size of client_message.
+/// @return 0 if the payload was received, -1 otherwise.
+int server_recievePayloadFromClient(int client_sock, const t_frameHeader *header, char *client_message, int capacity)
+{
+  if (frame_recvPayload(client_sock, header, client_message, capacity) < 0)
+  {
+    printf(server_isClientTimedOut() ? "ERROR: Client stopped sending, giving up on it\n"
+                                     : "ERROR: Error while receiving client's msg\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+/// @brief Receives a message from the client.
+/// @param client_sock is the socket of the client the message is to be received from.
+/// @param client_message represents the received client message.
+/// @return 0 if a message was received, -1 otherwise.
+int server_recieveMessageFromClient(int client_sock, char *client_message)
+{
+  t_frameHeader header;
+
+  return server_recieveFrameFromClient(client_sock, &header, client_message, CODE_SIZE + CODE_PADDING + CLIENT_MESSAGE_SIZE);
+}
+
+#pragma endregion Communication
+
+#pragma region Mirrored Writes
+
+/// @brief Prepares to write a PUT into the given replica files. Where the kernel supports it, blocks are moved from
+///        the socket into a pipe and duplicated for every replica with tee, so they are never copied into user space.
+/// @param mirror represents the mirror to be prepared.
+/// @param fds is the file on each replica, -1 for the replicas that are not written.
+/// @param chunk_size is the largest block the client may send.
+/// @param isChecksummed is true if the client sends a CRC32C with every block. Those blocks are checked in a
+///        buffer, as they can't be spliced.
+/// @param isCompressed is true if the client may compress blocks. Those are expanded in a buffer before being written.
+/// @param isDeduplicated is true if the blocks are to be cut into chunks rather than written to the files.
+/// @return 0 if the mirror is ready, -1 if it couldn't be set up.
+int mirror_open(t_mirror *mirror, const int fds[], int chunk_size, bool isChecksummed, bool isCompressed,
+                bool isDeduplicated)
+{
+  mirror->source[0] = mirror->source[1] = -1;
+  mirror->dedup = NULL;
+  mirror->buffer = NULL;
+  mirror->expanded = NULL;
+  mirror->buffer_size = 0;
+  mirror->isSpliceAvailable = false;
+  mirror->isWriteFailed = false;
+  mirror->isChecksummed = true;
+  mirror->isChecksumFailed = false;
+  mirror->crc = 0;
+  mirror->size = 0;
+  mirror->range_start = -1;
+
+  int last = -1;
+  for (int i = 0; i < replica_count; i++)
+  {
+    mirror->fds[i] = fds[i];
+    mirror->copies[i][0] = mirror->copies[i][1] = -1;
+
+    if (fds[i] >= 0)
+      last = i;
+  }
+
+  // deduplicated files are cut into chunks on their way through, in a buffer
+  if (isDeduplicated)
+  {
+    mirror->dedup = dedup_open(fds);
+    if (mirror->dedup == NULL)
+    {
+      printf("MIRROR ERROR: Couldn't allocate memory for chunking\n");
+      return -1;
+    }
+  }
+
+#ifdef __linux__
+  mirror->isSpliceAvailable = mirror->dedup == NULL && pipe(mirror->source) == 0;
+
+  if (mirror->isSpliceAvailable)
+  {
+    // let a whole block sit in each pipe if the system allows it, fewer splice calls per block
+    fcntl(mirror->source[1], F_SETPIPE_SZ, chunk_size);
+  }
+
+  // the last replica written takes the blocks straight from the source pipe, the others need a pipe of their own
+  for (int i = 0; i < last && mirror->isSpliceAvailable; i++)
+  {
+    if (mirror->fds[i] < 0)
+      continue;
+
+    mirror->isSpliceAvailable = pipe(mirror->copies[i]) == 0;
+    if (mirror->isSpliceAvailable)
+      fcntl(mirror->copies[i][1], F_SETPIPE_SZ, chunk_size);
+  }
+#else
+  (void)last;
+#endif
+
+  if (!mirror->isSpliceAvailable || isChecksummed || isCompressed)
+  {
+    if (!mirror->isSpliceAvailable && mirror->dedup == NULL)
+      printf("MIRROR: splice is not available, writing replicas through a buffer\n");
+
+    mirror->buffer_size = chunk_size + CHECKSUM_SIZE + 1;
+    mirror->buffer = malloc(mirror->buffer_size);
+    if (mirror->buffer == NULL)
+    {
+      printf("MIRROR ERROR: Couldn't allocate memory for a block\n");
+      return -1;
+    }
+  }
+
+  if (isCompressed)
+  {
+    mirror->expanded = malloc(chunk_size);
+    if (mirror->expanded == NULL)
+    {
+      printf("MIRROR ERROR: Couldn't allocate memory for a block\n");
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/// @brief Closes the replica files and the pipes of a mirror.
+/// @param mirror represents the mirror to be closed.
+void mirror_close(t_mirror *mirror)
+{
+  for (int i = 0; i < replica_count; i++)
+  {
+    if (mirror->fds[i] >= 0)
+      close(mirror->fds[i]);
+    if (mirror->copies[i][0] >= 0)
+      close(mirror->copies[i][0]);
+    if (mirror->copies[i][1] >= 0)
+      close(mirror->copies[i][1]);
+  }
+
+  if (mirror->source[0] >= 0)
+    close(mirror->source[0]);
+  if (mirror->source[1] >= 0)
+    close(mirror->source[1]);
+
+  free(mirror->buffer);
+  free(mirror->expanded);
+  dedup_close(mirror->dedup);
+}
+
+#ifdef __linux__
+/// @brief Moves exactly `length` bytes out of a pipe into a replica file. If the file can't take them, the bytes
+///        are still drained so the pipe stays in step with the stream, and the mirror is marked as failed.
+/// @param mirror represents the mirror being written.
+/// @param pipe_read is the read end of the pipe holding the bytes.
+/// @param fd is the replica file.
+/// @param length is the no. of bytes to move.
+void mirror_drainPipe(t_mirror *mirror, int pipe_read, int fd, size_t length)
+{
+  while (length > 0)
+  {
+    ssize_t moved = splice(pipe_read, NULL, fd, NULL, length, SPLICE_F_MOVE);
+    if (moved < 0 && errno == EINTR)
+      continue;
+    if (moved <= 0)
+      break;
+
+    length -= moved;
+  }
+
+  if (length > 0)
+  {
+    printf("MIRROR ERROR: replica write failed\n");
+    mirror->isWriteFailed = true;
+
+    char discard[4096];
+    while (length > 0)
+    {
+      ssize_t dropped = read(pipe_read, discard, length < sizeof(discard) ? length : sizeof(discard));
+      if (dropped <= 0)
+        break;
+      length -= dropped;
+    }
+  }
+}
+#endif
+
+/// @brief Receives the payload of a data frame from the client and writes it to every replica file, or cuts it into
+///        chunks if files are deduplicated.
+/// @param mirror represents the mirror being written.
+/// @param client_sock is the socket of the client sending the data.
+/// @param header is the already received header of the data frame.
+/// @return 0 if the payload was consumed from the socket, -1 if the connection broke. Replica write errors don't fail
+///         the call, they are reported through mirror->isWriteFailed.
+int mirror_writeFromClient(t_mirror *mirror, int client_sock, const t_frameHeader *header)
+{
+#ifdef __linux__
+  if (mirror->isSpliceAvailable && !(header->flags & (FRAME_FLAG_CHECKSUM | FRAME_FLAG_COMPRESSED)))
+  {
+    mirror->isChecksummed = false;
+
+    // the last replica consumes the source pipe, every other replica gets a tee'd copy first
+    int last = -1;
+    for (int i = 0; i < replica_count; i++)
+    {
+      if (mirror->fds[i] >= 0)
+        last = i;
+    }
+
+    size_t remaining = header->length;
+
+    while (remaining > 0)
+    {
+      ssize_t received = splice(client_sock, NULL, mirror->source[1], NULL, remaining, SPLICE_F_MOVE | SPLICE_F_MORE);
+      if (received < 0 && errno == EINTR)
+        continue;
+      if (received <= 0)
+      {
+        printf(server_isClientTimedOut() ? "MIRROR ERROR: client stalled, giving up on it\n"
+                                         : "MIRROR ERROR: client stopped sending data\n");
+        return -1;
+      }
+
+      remaining -= received;
+
+      for (int i = 0; i < last; i++)
+      {
+        if (mirror->fds[i] < 0)
+          continue;
+
+        ssize_t copied = tee(mirror->source[0], mirror->copies[i][1], received, 0);
+        if (copied < 0)
+          copied = 0;
+        if (copied < received)
+          mirror->isWriteFailed = true;
+
+        mirror_drainPipe(mirror, mirror->copies[i][0], mirror->fds[i], copied);
+      }
+
+      mirror_drainPipe(mirror, mirror->source[0], last >= 0 ? mirror->fds[last] : -1, received);
+    }
+
+    mirror->size += header->length;
+    return 0;
+  }
+#endif
+
+  if (frame_recvPayload(client_sock, header, mirror->buffer, mirror->buffer_size) != 0)
+  {
+    printf(server_isClientTimedOut() ? "MIRROR ERROR: client stalled, giving up on it\n"
+                                     : "MIRROR ERROR: client stopped sending data\n");
+    return -1;
+  }
+
+  char *data = mirror->buffer;
+  uint32_t length = header->length;
+  uint32_t crc = 0;
+  bool isChecksummed = (header->flags & FRAME_FLAG_CHECKSUM) != 0;
+
+  if (!isChecksummed)
+  {
+    mirror->isChecksummed = false;
+  }
+  else if (length < CHECKSUM_SIZE)
+  {
+    mirror->isChecksumFailed = true;
+    isChecksummed = false;
+    length = 0;
+  }
+  else
+  {
+    length -= CHECKSUM_SIZE;
+    memcpy(&crc, mirror->buffer + length, CHECKSUM_SIZE);
+  }
+
+  if ((header->flags & FRAME_FLAG_COMPRESSED) && length > 0)
+  {
+    // the buffer holds a chunk, its CRC32C and a spare byte, a block never expands past the chunk
+    int capacity = mirror->buffer_size - CHECKSUM_SIZE - 1;
+    int expanded_length = compress_expand(mirror->buffer, length, mirror->expanded, capacity);
+    if (expanded_length < 0)
+    {
+      // nothing of a block that can't be expanded is written, the PUT fails like for a bad checksum
+      printf("MIRROR ERROR: block couldn't be expanded\n");
+      mirror->isChecksumFailed = true;
+      isChecksummed = false;
+      expanded_length = 0;
+    }
+
+    data = mirror->expanded;
+    length = expanded_length;
+  }
+
+  if (isChecksummed)
+  {
+    // the block is only written if it arrived as it was sent
+    if (ntohl(crc) != checksum_crc32c(0, data, length))
+    {
+      printf("MIRROR ERROR: block doesn't match its checksum\n");
+      mirror->isChecksumFailed = true;
+      length = 0;
+    }
+
+    mirror->crc = checksum_crc32c(mirror->crc, data, length);
+  }
+
+  if (mirror->dedup != NULL)
+  {
+    dedup_write(mirror->dedup, data, length);
+    if (mirror->dedup->isFailed)
+      mirror->isWriteFailed = true;
+
+    mirror->size += length;
+    return 0;
+  }
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    if (mirror->fds[i] >= 0 && write(mirror->fds[i], data, length) != length)
+    {
+      printf("MIRROR ERROR: replica write failed\n");
+      mirror->isWriteFailed = true;
+    }
+  }
+
+  mirror->size += length;
+  return 0;
+}
+
+/// @brief Stores the CRC32C of the file with every replica file of a mirror, if every block came with one.
+/// @param mirror represents the mirror written.
+void mirror_storeChecksum(t_mirror *mirror)
+{
+  if (!mirror->isChecksummed || mirror->isChecksumFailed)
+    return;
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    if (mirror->fds[i] >= 0 && checksum_store(mirror->fds[i], mirror->crc) != 0)
+      printf("MIRROR ERROR: Couldn't store the checksum of replica %d\n", replicas[i].id);
+  }
+}
+
+/// @brief Picks an upload up where an earlier PUT of it left off. The partial files of every replica have to agree on
+///        how much of the upload they hold, otherwise it starts over. Whatever they hold past that is cut off.
+/// @param mirror represents the mirror about to write the upload, opened on its partial files.
+/// @return the no. of bytes of the upload already on disk, the client sends the rest.
+off_t mirror_resume(t_mirror *mirror)
+{
+  off_t size = -1;
+  uint32_t crc = 0;
+  bool isChecksummed = false;
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    off_t replica_size;
+    uint32_t replica_crc;
+    bool isReplicaChecksummed;
+    struct stat fd_stat;
+
+    if (mirror->fds[i] < 0)
+      continue;
+
+    if (upload_loadProgress(mirror->fds[i], &replica_size, &replica_crc, &isReplicaChecksummed) != 0 ||
+        fstat(mirror->fds[i], &fd_stat) != 0 || fd_stat.st_size < replica_size ||
+        (size >= 0 && (replica_size != size || replica_crc != crc || isReplicaChecksummed != isChecksummed)))
+    {
+      size = 0;
+      break;
+    }
+
+    size = replica_size;
+    crc = replica_crc;
+    isChecksummed = isReplicaChecksummed;
+  }
+
+  if (size <= 0)
+  {
+    size = 0;
+    crc = 0;
+    isChecksummed = true;
+  }
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    if (mirror->fds[i] >= 0 && (ftruncate(mirror->fds[i], size) != 0 || lseek(mirror->fds[i], size, SEEK_SET) < 0))
+    {
+      printf("MIRROR ERROR: Couldn't resume the upload on replica %d\n", replicas[i].id);
+      mirror->isWriteFailed = true;
+    }
+
+    // stretches PUTs of ranges left past the cut are gone
+    if (mirror->fds[i] >= 0)
+      upload_clearRanges(mirror->fds[i]);
+  }
+
+  mirror->size = size;
+  mirror->crc = crc;
+  mirror->isChecksummed = isChecksummed;
+
+  return size;
+}
+
+/// @brief Picks up a range of an upload where an earlier PUT of it left off. Every replica has to hold the start of
+///        the range for it to be skipped, the client sends the rest.
+/// @param mirror represents the mirror about to write the range, opened on the partial files of the upload.
+/// @param offset is where the range starts in the upload.
+/// @return the no. of bytes from offset on already on disk. It may run past the end of the range.
+off_t mirror_resumeRange(t_mirror *mirror, off_t offset)
+{
+  off_t covered = -1;
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    if (mirror->fds[i] < 0)
+      continue;
+
+    off_t replica_covered = upload_coveredLength(mirror->fds[i], offset);
+    if (covered < 0 || replica_covered < covered)
+      covered = replica_covered;
+  }
+
+  if (covered < 0)
+    covered = 0;
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    if (mirror->fds[i] >= 0 && lseek(mirror->fds[i], offset + covered, SEEK_SET) < 0)
+    {
+      printf("MIRROR ERROR: Couldn't seek to the range on replica %d\n", replicas[i].id);
+      mirror->isWriteFailed = true;
+    }
+  }
+
+  mirror->range_start = offset + covered;
+
+  return covered;
+}
+
+/// @brief Makes what an upload received so far durable on every replica, and records how much that is. A PUT of the
+///        upload that gets cut off later resumes from here. Nothing is recorded once a block went bad.
+/// @param mirror represents the mirror writing the upload, or a range of it.
+/// @return 0 if the progress is recorded on every replica, -1 otherwise.
+int mirror_checkpoint(t_mirror *mirror)
+{
+  if (mirror->isWriteFailed || mirror->isChecksumFailed)
+    return -1;
+
+  int result = 0;
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    if (mirror->fds[i] < 0)
+      continue;
+
+    // the record must never run ahead of the data it describes
+    int status = commit_syncFile(mirror->fds[i]);
+
+    if (status == 0 && mirror->range_start < 0)
+    {
+      status = upload_storeProgress(mirror->fds[i], mirror->size, mirror->crc, mirror->isChecksummed);
+    }
+    else if (status == 0 && mirror->size > 0)
+    {
+      pthread_mutex_lock(&upload_mutex);
+      status = upload_addRange(mirror->fds[i], mirror->range_start, mirror->range_start + mirror->size);
+      pthread_mutex_unlock(&upload_mutex);
+    }
+
+    if (status != 0 || commit_syncFile(mirror->fds[i]) != 0)
+    {
+      printf("MIRROR ERROR: Couldn't record the progress of the upload on replica %d\n", replicas[i].id);
+      result = -1;
+    }
+  }
+
+  return result;
+}
+
+/// @brief Reads an upload back from its partial files, once PUTs of its ranges wrote it there, so it can be checked
+///        before it is committed. If files are deduplicated, it is cut into chunks on the way.
+/// @param fds is the partial file on each replica, -1 for the replicas that are not written.
+/// @param size is the size of the upload.
+/// @param dedup cuts the upload into chunks, only the first replica is read then. NULL if files aren't deduplicated.
+/// @param crcs is filled with the CRC32C of the upload as each replica read holds it.
+/// @return 0 if the upload could be read, -1 otherwise.
+int mirror_readBack(const int fds[], off_t size, t_dedup *dedup, uint32_t crcs[])
+{
+  char *buffer = malloc(SERVER_UPLOAD_BLOCK_SIZE);
+  if (buffer == NULL)
+  {
+    printf("MIRROR ERROR: Couldn't allocate memory for a block\n");
+    return -1;
+  }
+
+  int status = 0;
+  bool isFirst = true;
+
+  for (int i = 0; i < replica_count && status == 0; i++)
+  {
+    crcs[i] = 0;
+
+    if (fds[i] < 0 || (dedup != NULL && !isFirst))
+      continue;
+
+    for (off_t offset = 0; offset < size;)
+    {
+      size_t length = size - offset < SERVER_UPLOAD_BLOCK_SIZE ? size - offset : SERVER_UPLOAD_BLOCK_SIZE;
+      ssize_t bytes_read = pread(fds[i], buffer, length, offset);
+      if (bytes_read < 0 && errno == EINTR)
+        continue;
+      if (bytes_read <= 0)
+      {
+        printf("MIRROR ERROR: Couldn't read the upload back on replica %d\n", replicas[i].id);
+        status = -1;
+        break;
+      }
+
+      crcs[i] = checksum_crc32c(crcs[i], buffer, bytes_read);
+      if (dedup != NULL)
+        dedup_write(dedup, buffer, bytes_read);
+
+      offset += bytes_read;
+    }
+
+    isFirst = false;
+  }
+
+  free(buffer);
+  return status;
+}
+
+#pragma endregion Mirrored Writes
+
+#pragma region Worker Pool
+
+/// @brief Body of every worker thread. Takes requests off the queue, oldest first, and runs them.
+/// @param arg is unused.
+/// @return never returns.
+void *workerpool_runWorker(void *arg)
+{
+  (void)arg;
+
+  while (true)
+  {
+    pthread_mutex_lock(&worker_pool.mutex);
+
+    while (worker_pool.count == 0)
+    {
+      pthread_cond_wait(&worker_pool.isWorkAvailable, &worker_pool.mutex);
+    }
+
+    t_work work = worker_pool.queue[worker_pool.head];
+    worker_pool.head = (worker_pool.head + 1) % SERVER_WORK_QUEUE_SIZE;
+    worker_pool.count--;
+    worker_pool.busy_workers++;
+
+    double wait_ms = server_millisecondsSince(&work.queued_at);
+    worker_pool.served++;
+    worker_pool.total_wait_ms += wait_ms;
+    if (wait_ms > worker_pool.max_wait_ms)
+    {
+      worker_pool.max_wait_ms = wait_ms;
+    }
+
+    printf("WORKER POOL: request waited %.2f ms (avg %.2f ms, max %.2f ms), %d queued, %d/%d workers busy\n",
+           wait_ms, worker_pool.total_wait_ms / worker_pool.served, worker_pool.max_wait_ms,
+           worker_pool.count, worker_pool.busy_workers, worker_pool.worker_count);
+
+    pthread_mutex_unlock(&worker_pool.mutex);
+
+    work.run(work.arg);
+
+    pthread_mutex_lock(&worker_pool.mutex);
+    worker_pool.busy_workers--;
+    pthread_mutex_unlock(&worker_pool.mutex);
+  }
+
+  return NULL;
+}
+
+/// @brief Starts the worker threads, SERVER_WORKER_THREADS of them or SERVER_WORKERS_PER_CORE per CPU core.
+/// @return 0 if successful, -1 otherwise.
+int workerpool_init()
+{
+  memset(&worker_pool, 0, sizeof(worker_pool));
+
+  // a worker spends most of a transfer blocked on the network or the disks, not on a core
+  int worker_count = SERVER_WORKER_THREADS;
+  if (worker_count <= 0)
+  {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    worker_count = (cores > 0 ? (int)cores : 1) * SERVER_WORKERS_PER_CORE;
+  }
+
+  if (pthread_mutex_init(&worker_pool.mutex, NULL) != 0 || pthread_cond_init(&worker_pool.isWorkAvailable, NULL) != 0)
+  {
+    printf("WORKER POOL ERROR: Couldn't initialise the request queue\n");
+    return -1;
+  }
+
+  pthread_attr_t attr;
+
+  // detach threads, they live as long as the server
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  for (int i = 0; i < worker_count; i++)
+  {
+    pthread_t worker;
+    if (pthread_create(&worker, &attr, workerpool_runWorker, NULL) != 0)
+    {
+      printf("WORKER POOL ERROR: Couldn't start worker %d\n", i);
+      break;
+    }
+    worker_pool.worker_count++;
+  }
+
+  pthread_attr_destroy(&attr);
+
+  if (worker_pool.worker_count == 0)
+    return -1;
+
+  printf("WORKER POOL: %d workers, queue of %d requests\n", worker_pool.worker_count, SERVER_WORK_QUEUE_SIZE);
+  return 0;
+}
+
+/// @brief Queues a request for the next free worker.
+/// @param run is called on a worker thread with arg.
+/// @param arg is passed to run.
+/// @return 0 if the request was queued, -1 if the queue is full.
+int workerpool_submit(void (*run)(void *arg), void *arg)
+{
+  pthread_mutex_lock(&worker_pool.mutex);
+
+  if (worker_pool.count == SERVER_WORK_QUEUE_SIZE)
+  {
+    pthread_mutex_unlock(&worker_pool.mutex);
+
+    printf("WORKER POOL: queue full, %d requests waiting\n", SERVER_WORK_QUEUE_SIZE);
+    return -1;
+  }
+
+  t_work *work = &worker_pool.queue[(worker_pool.head + worker_pool.count) % SERVER_WORK_QUEUE_SIZE];
+  work->run = run;
+  work->arg = arg;
+  clock_gettime(CLOCK_MONOTONIC, &work->queued_at);
+  worker_pool.count++;
+
+  pthread_cond_signal(&worker_pool.isWorkAvailable);
+  pthread_mutex_unlock(&worker_pool.mutex);
+
+  return 0;
+}
+
+#pragma endregion Worker Pool
+
+#pragma region Commands
+
+/// @brief To receive a file from client to the server.
+/// @param session represents the connection of the client that is requesting the command.
+/// @param remote_file_path represents the path in server space where the received file needs to be stored.
+/// @param range_offset is where in the file to start sending from.
+/// @param range_length is the no. of bytes to send, 0 to send up to the end of the file.
+void command_get(t_session *session, char *remote_file_path, off_t range_offset, off_t range_length)
+{
+  int client_sock = session->sock;
+
+  printf("COMMAND: GET started\n");
+
+  // keep the path from being changed by other commands while this one runs
+  t_pathLockSet path_locks_held;
+  if (path_lock(remote_file_path, LOCK_MODE_SHARED, &path_locks_held) != 0)
+  {
+    printf("GET ERROR: Couldn't lock path %s\n", remote_file_path);
+    server_sendMessageToClient(client_sock, "E:406 Given path is not supported");
+
+    printf("COMMAND: GET complete\n\n");
+    return;
+  }
+
+  int remote_fd;
+  struct stat remote_stat;
+
+  char response_message[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
+  memset(response_message, 0, sizeof(response_message));
+
+  // setup available directories and respective target file paths
+  char actual_path[2 * SERVER_PATH_SIZE];
+
+  // read from whichever replica is up and less busy
+  t_replica *replica = directory_acquireReadDirectory("GET", remote_file_path, actual_path);
+
+  // we have a directory available, start prep to read
+  strncat(actual_path, remote_file_path, strlen(remote_file_path));
+
+  remote_fd = open(actual_path, O_RDONLY);
+  printf("GET: Looking for file: %s\n", actual_path);
+
+  // a deduplicated file is put back together from the chunks its manifest names
+  t_manifest *manifest = NULL;
+  bool isRanged = range_offset > 0 || range_length > 0;
+
+  // Check if the file exists on the server
+  if (remote_fd < 0 || fstat(remote_fd, &remote_stat) != 0 || !S_ISREG(remote_stat.st_mode))
+  {
+    // file doesn't exist
+    printf("GET ERROR: File not found on server\n");
+
+    strcat(response_message, "E:404 ");
+    strcat(response_message, "File not found on server");
+
+    server_sendMessageToClient(client_sock, response_message);
+  }
+  else if (dedup_loadManifest(remote_fd, &manifest) != 0)
+  {
+    printf("GET ERROR: the manifest of %s can't be read, the replica is corrupt\n", actual_path);
+
+    strcat(response_message, "E:500 ");
+    strcat(response_message, "File is corrupt on server");
+
+    server_sendMessageToClient(client_sock, response_message);
+  }
+  else if (range_offset > (manifest != NULL ? manifest->size : remote_stat.st_size))
+  {
+    printf("GET ERROR: Range starts past the end of the file\n");
+
+    strcat(response_message, "E:416 ");
+    strcat(response_message, "Range is outside the file");
+
+    server_sendMessageToClient(client_sock, response_message);
+  }
+  else
+  {
+    // File found on server
+    printf("GET: File Found on server\n");
+
+    // Send success response to client, a range is answered with the size of the whole file
+    if (isRanged)
+      sprintf(response_message, "S:206 %lld Range of file found on server",
+              (long long)(manifest != NULL ? manifest->size : remote_stat.st_size));
+    else
+      strcat(response_message, "S:200 File found on server");
+
+    server_sendMessageToClient(client_sock, response_message);
+    memset(response_message, 0, sizeof(response_message));
+
+    // recieve client's first response
+    char client_message[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
+    memset(client_message, '\0', sizeof(client_message));
+
+    server_recieveMessageFromClient(client_sock, client_message);
+
+    if (strncmp(client_message, "S:100", CODE_SIZE) == 0)
+    {
+      // Client said we can start sending the file, along with how many blocks it is ready for.
+      // Stream blocks without waiting for the client, only stopping when the credit runs out.
+      printf("GET: Client hinted at sending file contents.\n");
+      atomic_fetch_add(&foreground_transfers, 1);
+
+      int block_size;
+      int credits = atoi(client_message + CODE_SIZE + CODE_PADDING);
+      bool isWindowed = credits > 0;
+      off_t file_size = manifest != NULL ? manifest->size : remote_stat.st_size;
+
+      // the range is cut short at the end of the file
+      off_t offset = range_offset;
+      off_t range_end = range_length > 0 && range_length < file_size - range_offset ? range_offset + range_length
+                                                                                    : file_size;
+
+      // checksummed and compressed blocks, and blocks of deduplicated files, are read into a buffer to be sent from
+      // there
+      uint32_t file_crc = 0;
+      bool isBuffered = session->isChecksummed || session->isCompressed || manifest != NULL;
+      char *block = isBuffered ? malloc(session->chunk_size + CHECKSUM_SIZE) : NULL;
+      char *packed = session->isCompressed ? malloc(session->chunk_size + CHECKSUM_SIZE) : NULL;
+      if ((isBuffered && block == NULL) || (session->isCompressed && packed == NULL))
+      {
+        printf("GET ERROR: Couldn't allocate memory for a block\n");
+        session->isClosed = true;
+      }
+
+      while (!session->isClosed)
+      {
+        if (isWindowed && credits == 0)
+        {
+          // wait for the client to grant more blocks
+          memset(client_message, '\0', CODE_SIZE);
+          server_recieveMessageFromClient(client_sock, client_message);
+
+          if (strncmp(client_message, "S:100", CODE_SIZE) != 0)
+          {
+            printf("GET ERROR: stopped abruptly because client is not accepting data anymore\n");
+            session->isClosed = true;
+            break;
+          }
+
+          credits += atoi(client_message + CODE_SIZE + CODE_PADDING);
+          continue;
+        }
+
+        if (offset < range_end)
+        {
+          block_size = range_end - offset < session->chunk_size ? range_end - offset : session->chunk_size;
+
+          if (manifest != NULL && dedup_readFile(manifest, replica->root, block, offset, block_size) != 0)
+          {
+            printf("GET ERROR: a chunk of %s is missing or corrupt\n", actual_path);
+            server_sendMessageToClient(client_sock, "E:500 File is corrupt on server");
+
+            session->isClosed = true;
+            break;
+          }
+
+          int status;
+          if (manifest != NULL)
+            status = server_sendBlockToClient(client_sock, block, block_size, packed, session->isChecksummed, &file_crc);
+          else if (isBuffered)
+            status = server_sendBufferedFileDataToClient(client_sock, remote_fd, offset, block_size, block, packed,
+                                                         session->isChecksummed, &file_crc);
+          else
+            status = server_sendFileDataToClient(client_sock, remote_fd, offset, block_size);
+
+          if (status != 0)
+          {
+            session->isClosed = true;
+            break;
+          }
+
+          offset += block_size;
+          credits--;
+        }
+        else
+        {
+          // Reached end of file, tell client we are done sending stuff
+          printf("GET: reached end of file\n");
+
+          memset(response_message, 0, sizeof(response_message));
+
+          // the replica may have rotted since it was written, the client must not take it for good data. Only a
+          // whole file can be held against its stored checksum
+          uint32_t stored_crc;
+          bool isStored = session->isChecksummed && checksum_load(remote_fd, &stored_crc) == 0;
+          if (isStored && !isRanged && stored_crc != file_crc)
+          {
+            printf("GET ERROR: %s doesn't match its stored checksum, the replica is corrupt\n", actual_path);
+
+            strcat(response_message, "E:500 ");
+            strcat(response_message, "File is corrupt on server");
+
+            server_sendMessageToClient(client_sock, response_message);
+
+            // credit the client granted meanwhile is still on its way, the stream can't carry another command
+            session->isClosed = true;
+            break;
+          }
+
+          // a range running to the end of the file also carries the checksum of the whole file, so a client
+          // resuming a download can tell whether the part it already has still belongs to it
+          if (isStored && isRanged && range_end == file_size)
+            sprintf(response_message, "S:200 %s=%08x %s=%08x File sent successfully", CHECKSUM_FEATURE, file_crc,
+                    CHECKSUM_WHOLE_FIELD, stored_crc);
+          else if (session->isChecksummed)
+            sprintf(response_message, "S:200 %s=%08x File sent successfully", CHECKSUM_FEATURE, file_crc);
+          else
+            strcat(response_message, "S:200 File sent successfully");
+
+          server_sendMessageToClient(client_sock, response_message);
+
+          // the client acknowledges the whole file once, skip any credit it granted in the meantime
+          do
+          {
+            memset(client_message, '\0', CODE_SIZE);
+            if (server_recieveMessageFromClient(client_sock, client_message) != 0)
+            {
+              session->isClosed = true;
+              break;
+            }
+          } while (strncmp(client_message, "S:100", CODE_SIZE) == 0);
+
+          break;
+        }
+      }
+
+      free(block);
+      free(packed);
+      atomic_fetch_sub(&foreground_transfers, 1);
+    }
+    else
+    {
+      // The client is not accepting data
+      memset(response_message, 0, sizeof(response_message));
+
+      strcat(response_message, "E:500 ");
+      strcat(response_message, "The client did not agree to receive the file contents.");
+
+      server_sendMessageToClient(client_sock, response_message);
+
+      printf("GET: The client did not agree to receive the file contents.\n");
+    }
+  }
+
+  // release the directory which we are using for this command
+  if (remote_fd >= 0)
+  {
+    close(remote_fd);
+  }
+  dedup_freeManifest(manifest);
+  directory_releaseReadDirectory(replica);
+
+  path_unlock(&path_locks_held);
+
+  printf("COMMAND: GET complete\n\n");
+}
+
+/// @brief Gives the relevant information for a file.
+/// @param session represents the connection of the client which is requesting the information.
+/// @param remote_file_path is the path of the file whose information is requested.
+void command_info(t_session *session, char *remote_file_path)
+{
+  int client_sock = session->sock;
+
+  printf("COMMAND: INFO started\n");
+
+  // keep the path from being changed by other commands while this one runs
+  t_pathLockSet path_locks_held;
+  if (path_lock(remote_file_path, LOCK_MODE_SHARED, &path_locks_held) != 0)
+  {
+    printf("INFO ERROR: Couldn't lock path %s\n", remote_file_path);
+    server_sendMessageToClient(client_sock, "E:406 Given path is not supported");
+
+    printf("COMMAND: INFO complete\n\n");
+    return;
+  }
+
+  // setup available directories and respective target file paths
+  char actual_path[2 * SERVER_PATH_SIZE];
+
+  // read from whichever replica is up and less busy
+  t_replica *replica = directory_acquireReadDirectory("INFO", remote_file_path, actual_path);
+
+  // we have a directory available, start prep to read
+  strncat(actual_path, remote_file_path, strlen(remote_file_path));
+
+  printf("INFO: actual path: %s\n", actual_path);
+
+  char response_message[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
+  memset(response_message, 0, sizeof(response_message));
+
+  if (!directory_isDirectoryExists(actual_path) && !directory_isFileExists(actual_path))
+  {
+    // directory doesn't exist
+    printf("INFO: Directory/File doesn't exist\n");
+
+    strcat(response_message, "E:404 ");
+    strcat(response_message, "Directory/File doesn't exist");
+
+    server_sendMessageToClient(client_sock, response_message);
+  }
+  else
+  {
+    // directory exists
+    printf("INFO: Directory/File exists\n");
+
+    struct stat sb;
+
+    if (stat(actual_path, &sb) == -1)
+    {
+      // Info retrieval failed
+      printf("INFO ERROR: Directory/File Information Retrieval failed\n");
+      perror("stat");
+
+      strcat(response_message, "E:406 ");
+      strcat(response_message, "Directory/File Information Retrieval failed");
+
+      server_sendMessageToClient(client_sock, response_message);
+    }
+    else
+    {
+      // We found the information of the directory/file
+      printf("INFO: Directory/File Information Retrieval successful\n");
+
+      strcat(response_message, "S:200 Information Retrieval successful\n");
+      char temp[2000];
+      memset(temp, '\0', sizeof(temp));
+
+      // a deduplicated file is as large as its contents, not as its manifest
+      long long file_size = sb.st_size;
+      int fd = S_ISREG(sb.st_mode) ? open(actual_path, O_RDONLY) : -1;
+      t_manifest *manifest = NULL;
+
+      if (fd >= 0 && dedup_loadManifest(fd, &manifest) == 0 && manifest != NULL)
+        file_size = manifest->size;
+      if (fd >= 0)
+        close(fd);
+      dedup_freeManifest(manifest);
+
+      sprintf(temp, "Ownership:                UID=%ld   GID=%ld\n", (long)sb.st_uid, (long)sb.st_gid);
+      strcat(response_message, temp);
+      sprintf(temp, "File size:                %lld bytes\n", file_size);
+      strcat(response_message, temp);
+      sprintf(temp, "Last file access:         %s", ctime(&sb.st_atime));
+      strcat(response_message, temp);
+      sprintf(temp, "Last file modification:   %s", ctime(&sb.st_mtime));
+      strcat(response_message, temp);
+
+      server_sendMessageToClient(client_sock, response_message);
+    }
+  }
+
+  // release the directory we had acquired for this command
+  directory_releaseReadDirectory(replica);
+
+  path_unlock(&path_locks_held);
+
+  printf("COMMAND: INFO complete\n\n");
+}
+
+/// @brief Creates a directory in the server.
+/// @param session represents the connection of the client that is requesting the command.
+/// @param folder_path represents the path of the directory to be created.
+void command_makeDirectory(t_session *session, char *folder_path)
+{
+  int client_sock = session->sock;
+
+  printf("COMMAND: MD started\n");
+
+  // keep the path from being used by other commands while this one runs
+  t_pathLockSet path_locks_held;
+  if (path_lock(folder_path, LOCK_MODE_EXCLUSIVE, &path_locks_held) != 0)
+  {
+    printf("MD ERROR: Couldn't lock path %s\n", folder_path);
+    server_sendMessageToClient(client_sock, "E:406 Given path is not supported");
+
+    printf("COMMAND: MD complete\n\n");
+    return;
+  }
+
+  // acquire every replica this command writes, and the path on each of them
+  t_writeSet write_set;
+  directory_acquireWriteDirectories("MD", folder_path, false, &write_set);
+
+  // start communicating with client
+  char response_message[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
+  memset(response_message, 0, sizeof(response_message));
+
+  bool isExisting = false;
+  for (int i = 0; i < replica_count; i++)
+  {
+    isExisting = isExisting || (write_set.isUp[i] && directory_isDirectoryExists(write_set.actual_paths[i]));
+  }
+
+  if (isExisting)
+  {
+    // directory already exists in atleast one directory
+    printf("MD: Directory already exists\n");
+
+    strcat(response_message, "E:406 ");
+    strcat(response_message, "Directory already exists");
+
+    server_sendMessageToClient(client_sock, response_message);
+  }
+  else
+  {
+    // directory doesn't exist on any directory
+    printf("MD: Directory doesn't exist, creating directory\n");
+
+    bool isFailed = false;
+    for (int i = 0; i < replica_count; i++)
+    {
+      if (write_set.isUp[i] && mkdir(write_set.actual_paths[i], 0700) != 0)
+        isFailed = true;
+    }
+
+    if (isFailed)
+    {
+      // creation of directory failed
+      printf("MD ERROR: directory creation failed\n");
+      perror("mkdir");
+      strcat(response_message, "E:406 ");
+      strcat(response_message, "Directory creation failed");
+
+      server_sendMessageToClient(client_sock, response_message);
+    }
+    else
+    {
+      // creation of directory successful
+      printf("MD: Directory creation successful\n");
+
+      strcat(response_message, "S:200 ");
+      strcat(response_message, "Directory creation successful");
+
+      server_sendMessageToClient(client_sock, response_message);
+    }
+  }
+
+  // release directories acquired for this command
+  directory_releaseWriteDirectories("MD", folder_path, &write_set);
+
+  path_unlock(&path_locks_held);
+
+  printf("COMMAND: MD complete\n\n");
+}
+
+/// @brief To create and store a replica of a local client file to server space.
+/// @param session represents the connection of the client that is requesting the command.
+/// @param remote_file_path is the path in server where the replica needs to be saved.
+/// @param window_arg is the no. of blocks the client proposed to keep in flight, NULL if it did not propose any.
+/// @param upload_id names the upload if the client wants to be able to resume it, NULL otherwise.
+/// @param range_offset is where in the upload the client sends a range of it from, -1 if it sends the whole file. The
+///        ranges of an upload are put in place together by command_finish.
+void command_put(t_session *session, char *remote_file_path, char *window_arg, char *upload_id, off_t range_offset)
+{
+  int client_sock = session->sock;
+
+  printf("COMMAND: PUT started\n");
+
+  if (upload_id != NULL && !upload_isValidId(upload_id))
+  {
+    printf("PUT ERROR: Invalid upload id %s\n", upload_id);
+    server_sendMessageToClient(client_sock, "E:406 Invalid upload id");
+
+    printf("COMMAND: PUT complete\n\n");
+    return;
+  }
+
+  if (range_offset >= 0 && upload_id == NULL)
+  {
+    printf("PUT ERROR: Range of no upload\n");
+    server_sendMessageToClient(client_sock, "E:406 A range needs an upload id");
+
+    printf("COMMAND: PUT complete\n\n");
+    return;
+  }
+
+  // a deduplicated file is cut into chunks as it arrives, which can't be picked up halfway, so its upload starts
+  // over. The ranges of an upload are kept whole until FINISH, which cuts the file into chunks
+  bool isRange = range_offset >= 0;
+  bool isResumable = upload_id != NULL && (isRange || SERVER_STORAGE_MODE != STORAGE_DEDUP);
+
+  // keep the path from being used by other commands while this one runs. The ranges of an upload leave the
+  // destination alone and are written side by side, they only keep it from being changed under them
+  t_pathLockSet path_locks_held;
+  if (path_lock(remote_file_path, isRange ? LOCK_MODE_SHARED : LOCK_MODE_EXCLUSIVE, &path_locks_held) != 0)
+  {
+    printf("PUT ERROR: Couldn't lock path %s\n", remote_file_path);
+    server_sendMessageToClient(client_sock, "E:406 Given path is not supported");
+
+    printf("COMMAND: PUT complete\n\n");
+    return;
+  }
+
+  // acquire every replica this command writes, and the path on each of them
+  t_writeSet write_set;
+  directory_acquireWriteDirectories("PUT", remote_file_path, isRange, &write_set);
+
+  // the file is written beside the destination and only renamed over it once it is whole and on disk, so a crash or
+  // an abort never leaves half a file behind
+  // an upload the client may resume has partial files of its own, which outlive a PUT that gets cut off
+  int remote_fds[SERVER_MAX_REPLICAS];
+  char temp_paths[SERVER_MAX_REPLICAS][2 * SERVER_PATH_SIZE + UPLOAD_ID_SIZE + sizeof(SERVER_PUT_TEMP_SUFFIX) + 1];
+  t_commit commit;
+  bool isOpenFailed = false;
+  bool isCommitted = false;
+  bool isKept = isRange; // the partial files of a range hold the other ranges of the upload as well
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    remote_fds[i] = -1;
+
+    if (!write_set.isUp[i])
+      continue;
+
+    if (isResumable)
+      snprintf(temp_paths[i], sizeof(temp_paths[i]), "%s.%s%s", write_set.actual_paths[i], upload_id,
+               SERVER_PUT_TEMP_SUFFIX);
+    else
+      snprintf(temp_paths[i], sizeof(temp_paths[i]), "%s%s", write_set.actual_paths[i], SERVER_PUT_TEMP_SUFFIX);
+    commit.temp_paths[i] = temp_paths[i];
+    commit.actual_paths[i] = write_set.actual_paths[i];
+
+    remote_fds[i] = open(temp_paths[i], isResumable ? O_RDWR | O_CREAT : O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (remote_fds[i] < 0)
+      isOpenFailed = true;
+  }
+
+  // Start communicating with client
+  char response_message[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
+  memset(response_message, 0, sizeof(response_message));
+  char client_message[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
+  memset(client_message, 0, sizeof(client_message));
+
+  if (isOpenFailed)
+  {
+    printf("PUT ERROR: File could not be opened. Please check whether the location exists.\n");
+
+    strcat(response_message, "E:404 ");
+    strcat(response_message, "File could not be opened. Please check whether the location exists.");
+
+    server_sendMessageToClient(client_sock, response_message);
+  }
+  else
+  {
+    // settle on a window: the client's proposal, capped at what the server is willing to buffer
+    int window = window_arg != NULL ? atoi(window_arg) : 0;
+    if (window <= 0 || window > SERVER_MAX_TRANSFER_WINDOW)
+    {
+      window = SERVER_MAX_TRANSFER_WINDOW;
+    }
+
+    t_frameHeader header;
+    int blocks_since_ack = 0;
+
+    t_mirror mirror;
+    bool isMirrorOpen = mirror_open(&mirror, remote_fds, session->chunk_size, session->isChecksummed,
+                                    session->isCompressed, SERVER_STORAGE_MODE == STORAGE_DEDUP && !isRange) == 0;
+    off_t resumed_size = 0;
+    if (isMirrorOpen && isRange)
+      resumed_size = mirror_resumeRange(&mirror, range_offset);
+    else if (isMirrorOpen && isResumable)
+      resumed_size = mirror_resume(&mirror);
+    off_t checkpoint_size = mirror.size;
+
+    if (isMirrorOpen)
+    {
+      atomic_fetch_add(&foreground_transfers, 1);
+
+      if (resumed_size > 0)
+        printf("PUT: Resuming upload %s after %lld bytes\n", upload_id, (long long)resumed_size);
+
+      // Tell client that server is ready to recieve the file, and where in it to start
+      if (isRange)
+        sprintf(response_message, "S:100 %d %lld Ready to write range on server", window, (long long)resumed_size);
+      else if (upload_id != NULL)
+        sprintf(response_message, "S:100 %d %lld Ready to write file on server", window, (long long)resumed_size);
+      else
+        sprintf(response_message, "S:100 %d Ready to write file on server", window);
+
+      server_sendMessageToClient(client_sock, response_message);
+    }
+    else
+    {
+      server_sendMessageToClient(client_sock, "E:500 File could not be written on server");
+    }
+
+    while (isMirrorOpen)
+    {
+      // get next block from client
+      if (frame_recvHeader(client_sock, &header) != 0)
+      {
+        printf(server_isClientTimedOut() ? "PUT ERROR: Client stalled while sending the file\n"
+                                         : "PUT ERROR: Client stopped sending the file\n");
+        session->isClosed = true;
+
+        break;
+      }
+
+      if (header.opcode == FRAME_OP_DATA)
+      {
+        // Client sent more data, mirror it into every replica
+        uint16_t agreed_flags = (session->isChecksummed ? FRAME_FLAG_CHECKSUM : 0) |
+                                (session->isCompressed ? FRAME_FLAG_COMPRESSED : 0);
+        if (header.flags & ~agreed_flags)
+        {
+          printf("PUT ERROR: Block uses a feature that wasn't agreed on\n");
+          session->isClosed = true;
+
+          break;
+        }
+
+        if (header.length > session->chunk_size + ((header.flags & FRAME_FLAG_CHECKSUM) ? CHECKSUM_SIZE : 0))
+        {
+          printf("PUT ERROR: Block is larger than the agreed chunk size\n");
+          session->isClosed = true;
+
+          break;
+        }
+
+        if (mirror_writeFromClient(&mirror, client_sock, &header) != 0)
+        {
+          session->isClosed = true;
+
+          break;
+        }
+
+        if (isResumable && mirror.size - checkpoint_size >= SERVER_UPLOAD_CHECKPOINT_BYTES)
+        {
+          mirror_checkpoint(&mirror);
+          checkpoint_size = mirror.size;
+        }
+
+        // acknowledge every half window, so the client can keep the other half in flight
+        if (++blocks_since_ack == (window + 1) / 2)
+        {
+          memset(response_message, 0, sizeof(response_message));
+          sprintf(response_message, "S:100 %d Success Continue", blocks_since_ack);
+
+          server_sendMessageToClient(client_sock, response_message);
+          blocks_since_ack = 0;
+        }
+      }
+      else if (server_recievePayloadFromClient(client_sock, &header, client_message, sizeof(client_message)) != 0)
+      {
+        printf(server_isClientTimedOut() ? "PUT ERROR: Client stalled while sending the file\n"
+                                         : "PUT ERROR: Client stopped sending the file\n");
+        session->isClosed = true;
+
+        break;
+      }
+      else if (strncmp(client_message, "E:500", CODE_SIZE) == 0)
+      {
+        // Client gave an error, and gave up on the upload if it named one
+        printf("PUT ERROR: File could not be recieved\n");
+
+        break;
+      }
+      else if (strncmp(client_message, "S:200", CODE_SIZE) == 0)
+      {
+        // Client is done sending data, commit acknowledgement for the whole file
+        memset(response_message, 0, sizeof(response_message));
+
+        for (int i = 0; i < replica_count; i++)
+        {
+          commit.fds[i] = mirror.fds[i];
+        }
+
+        // the client's CRC32C of the whole file, if it sent one, must match what arrived
+        uint32_t client_crc;
+        bool isCorrupted = mirror.isChecksumFailed || (checksum_parse(client_message, &client_crc) &&
+                                                       mirror.isChecksummed && client_crc != mirror.crc);
+
+        // a deduplicated file is committed as its manifest, once the chunks it names are on disk
+        if (mirror.dedup != NULL && !mirror.isWriteFailed && !isCorrupted &&
+            dedup_finish(mirror.dedup, mirror.fds) != 0)
+        {
+          mirror.isWriteFailed = true;
+        }
+
+        // stored with the files before they are committed, so it is made durable with them. The record of an upload
+        // has no place on the finished file
+        if (!mirror.isWriteFailed && !isCorrupted && !isRange)
+        {
+          mirror_storeChecksum(&mirror);
+
+          for (int i = 0; isResumable && i < replica_count; i++)
+          {
+            if (mirror.fds[i] >= 0)
+              upload_clearProgress(mirror.fds[i]);
+          }
+        }
+
+        if (mirror.isWriteFailed)
+        {
+          printf("PUT ERROR: File could not be written on server\n");
+
+          strcat(response_message, "E:500 ");
+          strcat(response_message, "File could not be written on server");
+        }
+        else if (isCorrupted)
+        {
+          printf("PUT ERROR: File was corrupted on its way to the server\n");
+
+          strcat(response_message, "E:500 ");
+          strcat(response_message, "File was corrupted on its way to the server");
+        }
+        else if (isRange && mirror_checkpoint(&mirror) != 0)
+        {
+          // a range that isn't recorded would leave FINISH short of it however often it is sent
+          printf("PUT ERROR: Range of upload %s could not be recorded on server\n", upload_id);
+
+          strcat(response_message, "E:500 ");
+          strcat(response_message, "Range could not be recorded on server");
+        }
+        else if (isRange)
+        {
+          // a range is only made durable and recorded, FINISH puts the upload in place once every range is here
+          printf("PUT: Range of upload %s received successfully\n", upload_id);
+
+          strcat(response_message, "S:200 ");
+          strcat(response_message, "Range received successfully");
+        }
+        else if (commit_files(&commit) != 0)
+        {
+          printf("PUT ERROR: File could not be saved on server\n");
+
+          strcat(response_message, "E:500 ");
+          strcat(response_message, "File could not be saved on server");
+        }
+        else
+        {
+          isCommitted = true;
+
+          printf("PUT: File received successfully\n");
+
+          strcat(response_message, "S:200 ");
+          strcat(response_message, "File received successfully");
+        }
+
+        server_sendMessageToClient(client_sock, response_message);
+
+        break;
+      }
+    }
+
+    // an upload cut off on its way keeps what arrived, for the client to resume
+    if (isMirrorOpen && isResumable && session->isClosed)
+    {
+      // after a bad block, only as much as was recorded before it is resumed
+      mirror_checkpoint(&mirror);
+      isKept = isKept || !mirror.isWriteFailed;
+
+      if (isKept)
+        printf("PUT: Kept upload %s to be resumed\n", upload_id);
+    }
+
+    if (isMirrorOpen)
+      atomic_fetch_sub(&foreground_transfers, 1);
+
+    // closes the replica files as well
+    mirror_close(&mirror);
+    for (int i = 0; i < replica_count; i++)
+    {
+      remote_fds[i] = -1;
+    }
+  }
+
+  // release the directories that were acquired for this command, the destination is left as it was unless the
+  // whole file was committed
+  for (int i = 0; i < replica_count; i++)
+  {
+    if (remote_fds[i] >= 0)
+    {
+      close(remote_fds[i]);
+    }
+    if (write_set.isUp[i] && !isCommitted && !isKept)
+    {
+      unlink(temp_paths[i]);
+    }
+  }
+  directory_releaseWriteDirectories("PUT", remote_file_path, &write_set);
+
+  path_unlock(&path_locks_held);
+
+  printf("COMMAND: PUT complete\n\n");
+}
+
+/// @brief Puts an upload in place once the client sent every range of it with PUTs of their own. The upload is read
+///        back and checked against the CRC32C the client has for the whole file, then committed like a PUT.
+/// @param session represents the connection of the client that is requesting the command.
+/// @param remote_file_path is the path in server where the file needs to be saved.
+/// @param upload_id names the upload.
+/// @param size is the size of the file.
+/// @param checksum_arg is the CRC32C of the whole file, eg. "crc32c=e3069283", NULL if the client sent none.
+void command_finish(t_session *session, char *remote_file_path, char *upload_id, off_t size, char *checksum_arg)
+{
+  int client_sock = session->sock;
+
+  printf("COMMAND: FINISH started\n");
+
+  uint32_t client_crc = 0;
+  bool isChecked = checksum_arg != NULL && checksum_parse(checksum_arg, &client_crc);
+
+  if (!upload_isValidId(upload_id) || (checksum_arg != NULL && !isChecked))
+  {
+    printf("FINISH ERROR: Invalid upload id or checksum\n");
+    server_sendMessageToClient(client_sock, "E:406 Invalid upload id or checksum");
+
+    printf("COMMAND: FINISH complete\n\n");
+    return;
+  }
+
+  // waits for the PUTs of ranges still writing the upload, and keeps the path from being used until it is in place
+  t_pathLockSet path_locks_held;
+  if (path_lock(remote_file_path, LOCK_MODE_EXCLUSIVE, &path_locks_held) != 0)
+  {
+    printf("FINISH ERROR: Couldn't lock path %s\n", remote_file_path);
+    server_sendMessageToClient(client_sock, "E:406 Given path is not supported");
+
+    printf("COMMAND: FINISH complete\n\n");
+    return;
+  }
+
+  // secondaries left to the replicator get the file from the primary
+  t_writeSet write_set;
+  directory_acquireWriteDirectories("FINISH", remote_file_path, false, &write_set);
+
+  // a deduplicated upload is cut into chunks now, and its manifests are committed from files of their own
+  int partial_fds[SERVER_MAX_REPLICAS];
+  int fds[SERVER_MAX_REPLICAS];
+  char partial_paths[SERVER_MAX_REPLICAS][2 * SERVER_PATH_SIZE + UPLOAD_ID_SIZE + sizeof(SERVER_PUT_TEMP_SUFFIX) + 1];
+  char temp_paths[SERVER_MAX_REPLICAS][2 * SERVER_PATH_SIZE + sizeof(SERVER_PUT_TEMP_SUFFIX)];
+  t_commit commit;
+  int first = -1;
+  bool isMissing = false;
+  bool isIncomplete = false;
+  bool isCorrupted = false;
+  bool isCommitted = false;
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    partial_fds[i] = fds[i] = -1;
+
+    if (!write_set.isUp[i])
+      continue;
+
+    snprintf(partial_paths[i], sizeof(partial_paths[i]), "%s.%s%s", write_set.actual_paths[i], upload_id,
+             SERVER_PUT_TEMP_SUFFIX);
+    snprintf(temp_paths[i], sizeof(temp_paths[i]), "%s%s", write_set.actual_paths[i], SERVER_PUT_TEMP_SUFFIX);
+    commit.actual_paths[i] = write_set.actual_paths[i];
+
+    partial_fds[i] = open(partial_paths[i], O_RDWR);
+    if (partial_fds[i] < 0)
+    {
+      isMissing = true;
+      continue;
+    }
+
+    if (first < 0)
+      first = i;
+
+    // every byte of the file has to be on disk, whatever a range ran past its end is cut off
+    if (upload_coveredLength(partial_fds[i], 0) < size || ftruncate(partial_fds[i], size) != 0)
+      isIncomplete = true;
+  }
+
+  char response_message[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
+  memset(response_message, 0, sizeof(response_message));
+
+  if (isMissing)
+  {
+    printf("FINISH ERROR: Upload %s not found on server\n", upload_id);
+
+    strcat(response_message, "E:404 ");
+    strcat(response_message, "Upload not found on server");
+  }
+  else if (isIncomplete)
+  {
+    printf("FINISH ERROR: Upload %s is incomplete on server\n", upload_id);
+
+    strcat(response_message, "E:500 ");
+    strcat(response_message, "Upload is incomplete on server");
+  }
+  else
+  {
+    atomic_fetch_add(&foreground_transfers, 1);
+
+    t_dedup *dedup = NULL;
+    bool isWriteFailed = false;
+
+    for (int i = 0; i < replica_count; i++)
+    {
+      if (partial_fds[i] < 0)
+        continue;
+
+      if (SERVER_STORAGE_MODE == STORAGE_DEDUP)
+      {
+        fds[i] = open(temp_paths[i], O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        commit.temp_paths[i] = temp_paths[i];
+        isWriteFailed = isWriteFailed || fds[i] < 0;
+      }
+      else
+      {
+        fds[i] = partial_fds[i];
+        commit.temp_paths[i] = partial_paths[i];
+      }
+    }
+
+    if (SERVER_STORAGE_MODE == STORAGE_DEDUP && !isWriteFailed)
+    {
+      dedup = dedup_open(fds);
+      isWriteFailed = dedup == NULL;
+    }
+
+    uint32_t crcs[SERVER_MAX_REPLICAS];
+    isWriteFailed = isWriteFailed || mirror_readBack(partial_fds, size, dedup, crcs) != 0;
+
+    // without a CRC32C from the client, the replicas still have to agree
+    uint32_t expected_crc = isChecked ? client_crc : crcs[first];
+
+    for (int i = 0; i < replica_count && !isWriteFailed; i++)
+    {
+      if (partial_fds[i] >= 0 && (dedup == NULL || i == first) && crcs[i] != expected_crc)
+        isCorrupted = true;
+    }
+
+    if (!isWriteFailed && !isCorrupted && dedup != NULL && dedup_finish(dedup, fds) != 0)
+      isWriteFailed = true;
+
+    // stored with the files before they are committed, like a PUT does. The records of the upload have no place on
+    // the finished file
+    for (int i = 0; i < replica_count && !isWriteFailed && !isCorrupted; i++)
+    {
+      commit.fds[i] = fds[i];
+
+      if (fds[i] < 0)
+        continue;
+
+      upload_clearProgress(fds[i]);
+
+      if (isChecked && checksum_store(fds[i], client_crc) != 0)
+        printf("FINISH ERROR: Couldn't store the checksum of replica %d\n", replicas[i].id);
+    }
+
+    if (isWriteFailed)
+    {
+      printf("FINISH ERROR: File could not be written on server\n");
+
+      strcat(response_message, "E:500 ");
+      strcat(response_message, "File could not be written on server");
+    }
+    else if (isCorrupted)
+    {
+      printf("FINISH ERROR: Upload %s was corrupted on its way to the server\n", upload_id);
+
+      strcat(response_message, "E:500 ");
+      strcat(response_message, "File was corrupted on its way to the server");
+    }
+    else if (commit_files(&commit) != 0)
+    {
+      printf("FINISH ERROR: File could not be saved on server\n");
+
+      strcat(response_message, "E:500 ");
+      strcat(response_message, "File could not be saved on server");
+    }
+    else
+    {
+      isCommitted = true;
+
+      printf("FINISH: Upload %s received successfully\n", upload_id);
+
+      strcat(response_message, "S:200 ");
+      strcat(response_message, "File received successfully");
+    }
+
+    dedup_close(dedup);
+    atomic_fetch_sub(&foreground_transfers, 1);
+  }
+
+  server_sendMessageToClient(client_sock, response_message);
+
+  // an upload that was put in place or can't be trusted is gone, otherwise it is kept for the client to try again
+  bool isDropped = isCommitted || isCorrupted;
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    if (fds[i] >= 0 && fds[i] != partial_fds[i])
+    {
+      close(fds[i]);
+      if (!isCommitted)
+        unlink(temp_paths[i]);
+    }
+    if (partial_fds[i] >= 0)
+    {
+      close(partial_fds[i]);
+      if (isDropped && (!isCommitted || SERVER_STORAGE_MODE == STORAGE_DEDUP))
+        unlink(partial_paths[i]);
+    }
+  }
+  directory_releaseWriteDirectories("FINISH", remote_file_path, &write_set);
+
+  // the ranges sent to secondaries left to the replicator are of no use either, they are acquired one at a time
+  // once the others are released, like cloning does
+  for (int i = 0; i < replica_count && isDropped && write_set.isDeferred; i++)
+  {
+    if (write_set.isUp[i] || !directory_isDirectoryInit(&replicas[i]))
+      continue;
+
+    directory_acquireDirectory(&replicas[i]);
+
+    char stale_path[2 * SERVER_PATH_SIZE + UPLOAD_ID_SIZE + sizeof(SERVER_PUT_TEMP_SUFFIX) + 1];
+    snprintf(stale_path, sizeof(stale_path), "%s%s.%s%s", replicas[i].root, remote_file_path, upload_id,
+             SERVER_PUT_TEMP_SUFFIX);
+    unlink(stale_path);
+
+    directory_releaseDirectory(&replicas[i]);
+  }
+
+  path_unlock(&path_locks_held);
+
+  printf("COMMAND: FINISH complete\n\n");
+}
+
+/// @brief Removes the indicated file/directory.
+/// @param session represents the connection of the client that is requesting the command
+/// @param path represents the path of the file/directory to be removed.
+void command_remove(t_session *session, char *path)
+{
+  int client_sock = session->sock;
+
+  printf("COMMAND: RM started\n");
+
+  // keep the path from being used by other commands while this one runs
+  t_pathLockSet path_locks_held;
+  if (path_lock(path, LOCK_MODE_EXCLUSIVE, &path_locks_held) != 0)
+  {
+    printf("RM ERROR: Couldn't lock path %s\n", path);
+    server_sendMessageToClient(client_sock, "E:406 Given path is not supported");
+
+    printf("COMMAND: RM complete\n\n");
+    return;
+  }
+
+  // acquire every replica this command writes, and the path on each of them
+  t_writeSet write_set;
+  directory_acquireWriteDirectories("RM", path, false, &write_set);
+
+  // start communications with client
+  char response_message[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
+  memset(response_message, 0, sizeof(response_message));
+
+  // Check whether such a path exists in all directories, and what it is on each of them
+  bool isMissing = false;
+  bool isFile = true;
+  bool isFolder = true;
+
+  for (int i = 0; i < replica_count; i++)
+  {
+    struct stat sb;
+
+    if (!write_set.isUp[i])
+      continue;
+
+    if (stat(write_set.actual_paths[i], &sb) == -1)
+    {
+      isMissing = true;
+      break;
+    }
+
+    isFile = isFile && S_ISREG(sb.st_mode);
+    isFolder = isFolder && S_ISDIR(sb.st_mode);
+  }
+
+  if (isMissing)
+  {
+    // Fails RM command if even one root directory doesn't have this path to remove
+    printf("RM ERROR: Directory/File Not Found\n");
+    perror("stat");
+
+    strcat(response_message, "E:404 ");
+    strcat(response_message, "Directory/File Not Found");
+
+    server_sendMessageToClient(client_sock, response_message);
+  }
+  // Check whether path is a file
+  else if (isFile)
+  {
+    // Path is a regular file
+    bool isFailed = false;
+    for (int i = 0; i < replica_count; i++)
+    {
+      if (write_set.isUp[i] && remove(write_set.actual_paths[i]) != 0)
+        isFailed = true;
+    }
+
+    if (isFailed)
+    {
+      // removal of file failed
+      printf("RM ERROR: File Removal failed\n");
+      perror("remove");
+      strcat(response_message, "E:406 ");
+      strcat(response_message, "File Removal failed");
+
+      server_sendMessageToClient(client_sock, response_message);
+    }
+    else
+    {
+      // removal of file successful
+      printf("RM: File Removal successful\n");
+
+      strcat(response_message, "S:200 ");
+      strcat(response_message, "File Removal successful");
+
+      server_sendMessageToClient(client_sock, response_message);
+    }
+  }
+  // Check whether path is a folder
+  else if (isFolder)
+  {
+    // Path is a directory
+    bool isFailed = false;
+    for (int i = 0; i < replica_count; i++)
+    {
+      if (write_set.isUp[i] && directory_removeDirectoryRecursively(write_set.actual_paths[i]) != 0)
+        isFailed = true;
+    }
+
+    if (isFailed)
+    {
+      // removal of directory failed
+      printf("RM ERROR: Directory Removal failed\n");
+      perror("remove");
+      strcat(response_message, "E:406 ");
+      strcat(response_message, "Directory Removal failed");
+
+      server_sendMessageToClient(client_sock, response_message);
+    }
+    else
+    {
+      // removal of directory successful
+      printf("RM: Directory Removal successful\n");
+
+      strcat(response_message, "S:200 ");
+      strcat(response_message, "Directory Removal successful");
+
+      server_sendMessageToClient(client_sock, response_message);
+    }
+  }
+  // Unsupported path
+  else
+  {
+    printf("RM ERROR: Given path is not supported\n");
+    strcat(response_message, "E:406 ");
+    strcat(response_message, "Given path is not supported");
+
+    server_sendMessageToClient(client_sock, response_message);
+  }
+
+  // release the directories that were acquired for this command
+  directory_releaseWriteDirectories("RM", path, &write_set);
+
+  path_unlock(&path_locks_held);
+
+  printf("COMMAND: RM complete\n\n");
+}
+
+/// @brief Agrees on the chunk size for the connection: the largest data frame either side will send, and on the
+///        optional features the client offers, eg. CHECKSUM_FEATURE. The reply lists the features agreed on.
+/// @param session represents the connection of the client that is requesting the command.
+/// @param chunk_size_arg is the chunk size the client asked for.
+/// @param features are the features the client offered.
+/// @param feature_count is the no. of features offered.
+void command_hello(t_session *session, char *chunk_size_arg, char *features[], int feature_count)
+{
+  printf("COMMAND: HELLO started\n");
+
+  // the client's proposal, capped at what the server is willing to move per frame
+  int chunk_size = atoi(chunk_size_arg);
+  if (chunk_size <= 0)
+  {
+    chunk_size = SERVER_MESSAGE_SIZE;
+  }
+  if (chunk_size > SERVER_MAX_CHUNK_SIZE)
+  {
+    chunk_size = SERVER_MAX_CHUNK_SIZE;
+  }
+
+  session->chunk_size = chunk_size;
+
+  for (int i = 0; i < feature_count; i++)
+  {
+    if (strcmp(features[i], CHECKSUM_FEATURE) == 0)
+      session->isChecksummed = true;
+    if (strcmp(features[i], COMPRESSION_FEATURE) == 0)
+      session->isCompressed = SERVER_COMPRESSION;
+  }
+
+  char response_message[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
+  memset(response_message, 0, sizeof(response_message));
+  sprintf(response_message, "S:200 %d%s%s Chunk size agreed", chunk_size,
+          session->isChecksummed ? " " CHECKSUM_FEATURE : "", session->isCompressed ? " " COMPRESSION_FEATURE : "");
+
+  server_sendMessageToClient(session->sock, response_message);
+
+  printf("HELLO: chunk size for client socket %d is %d bytes%s%s\n", session->sock, chunk_size,
+         session->isChecksummed ? ", transfers are checksummed" : "",
+         session->isCompressed ? ", data frames are compressed" : "");
+  printf("COMMAND: HELLO complete\n\n");
+}
+
+/// @brief Ends the session, the connection is closed once the goodbye is acknowledged.
+/// @param session represents the connection of the client that is requesting the command.
+void command_bye(t_session *session)
+{
+  printf("COMMAND: BYE started\n");
+
+  session->isClosed = true;
+
+  server_sendMessageToClient(session->sock, "S:200 Goodbye");
+
+  printf("COMMAND: BYE complete\n\n");
+}
+
+#pragma endregion Commands
+
+/// @brief Listens and server for incoming client connections.
+/// @return 0 if slient connection to server is successful, -1 otherwise.
+int server_listenForClients()
+{
+  printf("\nListening for incoming connections.....\n");
+
+  socklen_t client_size;
+  struct sockaddr_in client_addr;
+
+  // Accept an incoming connection:
+  client_size = sizeof(client_addr);
+  int client_sock = accept(socket_desc, (struct sockaddr *)&client_addr, &client_size);
+
+  if (client_sock < 0)
+  {
+    printf("ERROR: Can't accept\n");
+    server_closeServerSocket();
+    return -1;
+  }
+  printf("CLIENT CONNECTION: Client connected at IP: %s and port: %i\n", inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+  printf("CLIENT CONNECTION: Client socket: %d\n", client_sock);
+  return client_sock;
+}
+
+/// @brief Parses an optional byte offset or length given with a command.
+/// @param text is the argument, NULL if it wasn't given.
+/// @param value is set to the parsed no., 0 if the argument wasn't given.
+/// @return 0 if the argument is missing or a non-negative no., -1 otherwise.
+int server_parseOffset(const char *text, off_t *value)
+{
+  *value = 0;
+  if (text == NULL)
+    return 0;
+
+  char *end;
+  errno = 0;
+  long long parsed = strtoll(text, &end, 10);
+  if (errno != 0 || end == text || *end != '\0' || parsed < 0)
+    return -1;
+
+  *value = parsed;
+  return 0;
+}
+
+/// @brief Splits a command into its code and arguments.
+/// @param client_command is the received command, the parsed arguments point into it.
+/// @param args is filled with the command code followed by its arguments, unused entries are set to NULL.
+/// @return no. of entries in args, including the command code. 0 if the command is unknown.
+int server_parseCommand(char *client_command, char *args[SERVER_MAX_COMMAND_ARGS])
+{
+  for (int i = 0; i < SERVER_MAX_COMMAND_ARGS; i++)
+  {
+    args[i] = NULL;
+  }
+
+  printf("LISTEN: Message from client: %s\n", client_command);
+
+  // Interpret entered command
+  char *pch;
+  pch = strtok(client_command, " \n");
+
+  args[0] = pch;
+  pch = strtok(NULL, " \n");
+
+  if (args[0] == NULL)
+  {
+    printf("LISTEN ERROR: Invalid command provided\n");
+    return 0;
+  }
+
+  // Set arguement Limits based on first argument
+  int argcLimit;
+  int argc = 1;
+
+  if (strcmp(args[0], "C:001") == 0)
+  {
+    argcLimit = 5;
+  }
+  else if (strcmp(args[0], "C:002") == 0)
+  {
+    argcLimit = 2;
+  }
+  else if (strcmp(args[0], "C:003") == 0)
+  {
+    argcLimit = 6;
+  }
+  else if (strcmp(args[0], "C:004") == 0)
+  {
+    argcLimit = 2;
+  }
+  else if (strcmp(args[0], "C:005") == 0)
+  {
+    argcLimit = 2;
+  }
+  else if (strcmp(args[0], "C:006") == 0)
+  {
+    argcLimit = SERVER_MAX_COMMAND_ARGS;
+  }
+  else if (strcmp(args[0], "C:007") == 0)
+  {
+    argcLimit = 1;
+  }
+  else if (strcmp(args[0], "C:008") == 0)
+  {
+    argcLimit = 5;
+  }
+  else
+  {
+    printf("LISTEN ERROR: Invalid command provided\n");
+    return 0;
+  }
+
+  // Parse remaining arguements based on set command
+
+  while (pch != NULL)
+  {
+    if (argc >= argcLimit)
+    {
+      printf("LISTEN ERROR: Invalid number of arguements provided\n");
+      break;
+    }
+
+    args[argc++] = pch;
+    pch = strtok(NULL, " \n");
+  }
+
+  return argc;
+}
+
+/// @brief Receives a command from the client and splits it into its code and arguments.
+/// @param client_sock is the socket of the client the command is received from.
+/// @param client_command is the buffer the command is received into, the parsed arguments point into it.
+/// @param capacity is the size of client_command.
+/// @param args is filled with the command code followed by its arguments, unused entries are set to NULL.
+/// @return no. of entries in args, including the command code. 0 if the command is unknown, -1 if nothing could
+///         be received.
+int server_recieveCommand(int client_sock, char *client_command, int capacity, char *args[SERVER_MAX_COMMAND_ARGS])
+{
+  t_frameHeader header;
+
+  memset(client_command, 0, capacity);
+
+  if (server_recieveFrameFromClient(client_sock, &header, client_command, capacity) != 0 ||
+      header.opcode != FRAME_OP_COMMAND)
+  {
+    printf("LISTEN ERROR: Couldn't listen for command\n");
+    return -1;
+  }
+
+  return server_parseCommand(client_command, args);
+}
+
+/// @brief Delegates a parsed command to the function implementing it.
+/// @param session represents the connection of the client that sent the command.
+/// @param args is the command code followed by its arguments.
+/// @param argc is the no. of entries in args, 0 if the command was not recognized.
+void server_runCommand(t_session *session, char *args[SERVER_MAX_COMMAND_ARGS], int argc)
+{
+  int client_sock = session->sock;
+
+  // a client that stalls halfway through a command gives up the worker and the locks of the command
+  server_setClientTimeouts(client_sock);
+
+  // Redirect to correct command
+  if (argc == 0)
+  {
+    server_sendMessageToClient(client_sock, "E:404 Invalid command");
+  }
+  else if (strcmp(args[0], "C:007") == 0)
+  {
+    command_bye(session);
+  }
+  else if (argc < 2 || (strcmp(args[0], "C:003") == 0 && argc < 3) || (strcmp(args[0], "C:008") == 0 && argc < 4))
+  {
+    printf("LISTEN ERROR: Invalid number of arguements provided\n");
+    server_sendMessageToClient(client_sock, "E:406 Invalid number of arguements");
+  }
+  else if (dedup_isStorePath(strcmp(args[0], "C:003") == 0 ? args[2] : args[1]))
+  {
+    // the chunk store belongs to the server, whether or not files are deduplicated right now
+    printf("LISTEN ERROR: Path is in the chunk store\n");
+    server_sendMessageToClient(client_sock, "E:406 Given path is not supported");
+  }
+  else if (strcmp(args[0], "C:001") == 0)
+  {
+    // an optional offset and length ask for a range of the file, a length of 0 runs to its end
+    off_t offset, length;
+    if (server_parseOffset(args[3], &offset) != 0 || server_parseOffset(args[4], &length) != 0)
+    {
+      printf("LISTEN ERROR: Invalid range provided\n");
+      server_sendMessageToClient(client_sock, "E:406 Invalid range");
+    }
+    else
+    {
+      command_get(session, args[1], offset, length);
+    }
+  }
+  else if (strcmp(args[0], "C:002") == 0)
+  {
+    command_info(session, args[1]);
+  }
+  else if (strcmp(args[0], "C:003") == 0)
+  {
+    // an offset after the upload id puts a range of the upload
+    off_t offset = -1;
+    if (args[5] != NULL && server_parseOffset(args[5], &offset) != 0)
+    {
+      printf("LISTEN ERROR: Invalid range provided\n");
+      server_sendMessageToClient(client_sock, "E:406 Invalid range");
+    }
+    else
+    {
+      command_put(session, args[2], args[3], args[4], offset);
+    }
+  }
+  else if (strcmp(args[0], "C:004") == 0)
+  {
+    command_makeDirectory(session, args[1]);
+  }
+  else if (strcmp(args[0], "C:005") == 0)
+  {
+    command_remove(session, args[1]);
+  }
+  else if (strcmp(args[0], "C:006") == 0)
+  {
+    command_hello(session, args[1], &args[2], argc - 2);
+  }
+  else if (strcmp(args[0], "C:008") == 0)
+  {
+    off_t size;
+    if (server_parseOffset(args[3], &size) != 0)
+    {
+      printf("LISTEN ERROR: Invalid size provided\n");
+      server_sendMessageToClient(client_sock, "E:406 Invalid size");
+    }
+    else
+    {
+      command_finish(session, args[1], args[2], size, args[4]);
+    }
+  }
+  else
+  {
+    printf("LISTEN ERROR: Invalid command provided\n");
+    server_sendMessageToClient(client_sock, "E:404 Invalid command");
+  }
+}
+
+/// @brief Listens for any incoming commands from the client, parses them and delegates the control to appropriate functions.
+///          The server functions are not directly exposed to the client and all control passes through this method.
+///          A connection carries any no. of commands, one after the other, until the client says goodbye or stays
+///          idle for longer than SERVER_IDLE_TIMEOUT_SECONDS.
+/// @param client_sock_arg represnts the socket of the incoming client for connection.
+void server_listenForCommand(void *client_sock_arg)
+{
+  t_session session;
+  session.sock = *((int *)client_sock_arg);
+  session.chunk_size = SERVER_MESSAGE_SIZE;
+  session.isChecksummed = false;
+  session.isCompressed = false;
+  session.isClosed = false;
+  free(client_sock_arg);
 
-        server_sendMessageToClient(client_sock, client_message);
+  int client_sock = session.sock;
 
-        printf("PUT: File received successfully\n");
+  char client_command[CLIENT_COMMAND_SIZE];
+  char *args[SERVER_MAX_COMMAND_ARGS];
 
-        break;
-      }
-    }
+  while (!session.isClosed)
+  {
+    printf("LISTEN: listening for command from client socket: %d\n", client_sock);
 
-    // release the directories that were acquired for this command
-    if (isRootDirectory1Init)
+    // wait for the next command, giving up on clients that went quiet
+    struct pollfd pfd;
+    pfd.fd = client_sock;
+    pfd.events = POLLIN;
+
+    int ready = poll(&pfd, 1, SERVER_IDLE_TIMEOUT_SECONDS * 1000);
+    if (ready < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (ready == 0)
     {
-      fclose(remote_file1);
-      directory_releaseDirectory1();
+      printf("LISTEN: client socket %d was idle for too long\n", client_sock);
+      break;
     }
-    if (isRootDirectory2Init)
+
+    int argc = server_recieveCommand(client_sock, client_command, sizeof(client_command), args);
+    if (argc < 0)
     {
-      fclose(remote_file2);
-      directory_releaseDirectory2();
+      break;
     }
+
+    server_runCommand(&session, args, argc);
   }
 
-  printf("COMMAND: PUT complete\n\n");
+  printf("LISTEN: Closing connection for client socket %d\n", client_sock);
+  server_closeClientSocket(client_sock);
 }
 
-/// @brief Removes the indicated file/directory.
-/// @param client_sock represents the socket of the client that is requesting the command
-/// @param path represents the path of the file/directory to be removed.
-void command_remove(int client_sock, char *path)
-{
-  printf("COMMAND: RM started\n");
+#ifdef __linux__
+#pragma region Event Loop
 
-  // setup available directories and respective target file paths
-  char actual_path1[200];
-  char actual_path2[200];
+/// @brief Sets up the epoll instance watching the server socket and the handler threads' wakeup eventfd.
+/// @return 0 if successful, -1 otherwise.
+int eventloop_init()
+{
+  epoll_desc = epoll_create1(0);
+  eventloop_wakeup_desc = eventfd(0, EFD_NONBLOCK);
 
-  // acquire all directories available for this command
-  if (directory_isDirectory1Init())
+  if (epoll_desc < 0 || eventloop_wakeup_desc < 0 || pthread_mutex_init(&returned_connections_mutex, NULL) != 0)
   {
-    directory_acquireDirectory1();
-
-    printf("RM: Directory 1 is acquired\n");
+    printf("EVENT LOOP ERROR: Couldn't create the event loop\n");
+    return -1;
+  }
 
-    strcpy(actual_path1, ROOT_DIRECTORY_1);
-    strncat(actual_path1, path, strlen(path));
+  // accept never blocks, the loop drains the accept queue each time the socket is readable
+  fcntl(socket_desc, F_SETFL, fcntl(socket_desc, F_GETFL, 0) | O_NONBLOCK);
 
-    printf("RM: actual path: %s\n", actual_path1);
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.ptr = NULL;
+  if (epoll_ctl(epoll_desc, EPOLL_CTL_ADD, socket_desc, &event) != 0)
+  {
+    printf("EVENT LOOP ERROR: Couldn't watch the server socket\n");
+    return -1;
   }
 
-  if (directory_isDirectory2Init())
+  event.events = EPOLLIN;
+  event.data.ptr = &eventloop_wakeup_desc;
+  if (epoll_ctl(epoll_desc, EPOLL_CTL_ADD, eventloop_wakeup_desc, &event) != 0)
   {
-    directory_acquireDirectory2();
+    printf("EVENT LOOP ERROR: Couldn't watch the wakeup descriptor\n");
+    return -1;
+  }
+
+  open_connections = NULL;
+  open_connection_count = 0;
+  returned_connections = NULL;
 
-    printf("RM: Directory 2 is acquired\n");
+  printf("EVENT LOOP: ready\n");
+  return 0;
+}
 
-    strcpy(actual_path2, ROOT_DIRECTORY_2);
-    strncat(actual_path2, path, strlen(path));
+/// @brief Adds a connection to the epoll instance or takes it out. It is out while a handler thread owns it: epoll
+///        reports errors and hangups even with no events asked for, so a client resetting mid-command would otherwise
+///        wake the loop over and over, for a connection it can't touch.
+/// @param connection represents the connection.
+/// @param isWatched is true to get told when the client sends something.
+/// @return 0 if successful, -1 otherwise.
+int eventloop_watchConnection(t_connection *connection, bool isWatched)
+{
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.ptr = connection;
 
-    printf("RM: actual path: %s\n", actual_path2);
-  }
+  return epoll_ctl(epoll_desc, isWatched ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, connection->session.sock, &event);
+}
 
-  // both directories are not available, quit program
-  if (!isRootDirectory1Init && !isRootDirectory2Init)
+/// @brief Starts tracking a freshly accepted client.
+/// @param client_sock is the socket of the client.
+void eventloop_addConnection(int client_sock)
+{
+  t_connection *connection = calloc(1, sizeof(t_connection));
+  if (connection == NULL)
   {
-    printf("RM ERROR: No Directory is available\n");
-    server_closeServerSocket();
-    exit(1);
+    printf("EVENT LOOP ERROR: Couldn't allocate memory for connection\n");
+    server_closeClientSocket(client_sock);
+    return;
   }
 
-  // start communications with client
-  char response_message[CODE_SIZE + CODE_PADDING + SERVER_MESSAGE_SIZE];
-  memset(response_message, 0, sizeof(response_message));
-
-  struct stat sb1;
-  struct stat sb2;
+  connection->session.sock = client_sock;
+  connection->session.chunk_size = SERVER_MESSAGE_SIZE;
+  connection->session.isChecksummed = false;
+  connection->session.isCompressed = false;
+  connection->session.isClosed = false;
+  connection->state = CONNECTION_READING_HEADER;
+  connection->last_active = time(NULL);
 
-  // Check whether such a path exists in all directories
-  if ((isRootDirectory1Init && stat(actual_path1, &sb1) == -1) ||
-      (isRootDirectory2Init && stat(actual_path2, &sb2) == -1))
+  if (eventloop_watchConnection(connection, true) != 0)
   {
-    // Fails RM command if even one root directory doesn't have this path to remove
-    printf("RM ERROR: Directory/File Not Found\n");
-    perror("stat");
+    printf("EVENT LOOP ERROR: Couldn't watch client socket %d\n", client_sock);
+    server_closeClientSocket(client_sock);
+    free(connection);
+    return;
+  }
 
-    strcat(response_message, "E:404 ");
-    strcat(response_message, "Directory/File Not Found");
+  connection->next = open_connections;
+  if (open_connections != NULL)
+    open_connections->prev = connection;
+  open_connections = connection;
+  open_connection_count++;
+}
 
-    server_sendMessageToClient(client_sock, response_message);
-  }
+/// @brief Closes a connection the event loop owns and forgets about it.
+/// @param connection represents the connection.
+void eventloop_closeConnection(t_connection *connection)
+{
+  printf("LISTEN: Closing connection for client socket %d\n", connection->session.sock);
+
+  if (connection->prev != NULL)
+    connection->prev->next = connection->next;
   else
+    open_connections = connection->next;
+  if (connection->next != NULL)
+    connection->next->prev = connection->prev;
+  open_connection_count--;
+
+  // closing the socket also removes it from the epoll instance, if it is still in there
+  server_closeClientSocket(connection->session.sock);
+  free(connection);
+}
+
+/// @brief Accepts every client waiting in the accept queue.
+void eventloop_acceptClients()
+{
+  while (true)
   {
-    // Check whether path is a file
-    if (S_ISREG(sb1.st_mode) && S_ISREG(sb2.st_mode))
+    struct sockaddr_in client_addr;
+    socklen_t client_size = sizeof(client_addr);
+
+    int client_sock = accept(socket_desc, (struct sockaddr *)&client_addr, &client_size);
+    if (client_sock < 0)
     {
-      // Path is a regular file
-      int res1 = remove(actual_path1);
-      int res2 = remove(actual_path2);
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        printf("CLIENT CONNECTION ERROR: Can't accept: %s\n", strerror(errno));
+      return;
+    }
 
-      if (res1 != 0 || res2 != 0)
-      {
-        // removal of file failed
-        printf("RM ERROR: File Removal failed\n");
-        perror("remove");
-        strcat(response_message, "E:406 ");
-        strcat(response_message, "File Removal failed");
+    printf("CLIENT CONNECTION: Client connected at IP: %s and port: %i\n", inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+    printf("CLIENT CONNECTION: Client socket: %d, open connections: %d\n", client_sock, open_connection_count + 1);
 
-        server_sendMessageToClient(client_sock, response_message);
-      }
-      else
-      {
-        // removal of file successful
-        printf("RM: File Removal successful\n");
+    eventloop_addConnection(client_sock);
+  }
+}
 
-        strcat(response_message, "S:200 ");
-        strcat(response_message, "File Removal successful");
+/// @brief Hands a connection back to the event loop once its command is done. Called from the handler thread.
+/// @param connection represents the connection.
+void eventloop_returnConnection(t_connection *connection)
+{
+  pthread_mutex_lock(&returned_connections_mutex);
 
-        server_sendMessageToClient(client_sock, response_message);
-      }
-    }
-    // Check whether path is a folder
-    else if (S_ISDIR(sb1.st_mode) && S_ISDIR(sb2.st_mode))
-    {
-      // Path is a directory
-      int res1 = directory_removeDirectoryRecursively(actual_path1);
-      int res2 = directory_removeDirectoryRecursively(actual_path2);
+  connection->next_returned = returned_connections;
+  returned_connections = connection;
 
-      if (res1 != 0 || res2 != 0)
-      {
-        // removal of directory failed
-        printf("RM ERROR: Directory Removal failed\n");
-        perror("remove");
-        strcat(response_message, "E:406 ");
-        strcat(response_message, "Directory Removal failed");
+  pthread_mutex_unlock(&returned_connections_mutex);
 
-        server_sendMessageToClient(client_sock, response_message);
-      }
-      else
-      {
-        // removal of directory successful
-        printf("RM: Directory Removal successful\n");
+  uint64_t wakeup = 1;
+  if (write(eventloop_wakeup_desc, &wakeup, sizeof(wakeup)) < 0)
+  {
+    printf("EVENT LOOP ERROR: Couldn't wake up the event loop\n");
+  }
+}
 
-        strcat(response_message, "S:200 ");
-        strcat(response_message, "Directory Removal successful");
+/// @brief Runs the command a connection is holding. Called on a worker thread.
+/// @param connection_arg represents the connection.
+void eventloop_runConnection(void *connection_arg)
+{
+  t_connection *connection = connection_arg;
 
-        server_sendMessageToClient(client_sock, response_message);
-      }
-    }
-    // Unsupported path
-    else
-    {
-      printf("RM ERROR: Given path is not supported\n");
-      strcat(response_message, "E:406 ");
-      strcat(response_message, "Given path is not supported");
+  server_runCommand(&connection->session, connection->args, connection->argc);
 
-      server_sendMessageToClient(client_sock, response_message);
-    }
-  }
+  eventloop_returnConnection(connection);
+}
 
-  // release the directories that were acquired for this command
-  if (isRootDirectory1Init)
-  {
-    directory_releaseDirectory1();
-  }
-  if (isRootDirectory2Init)
+/// @brief Queues a connection with a complete command for the worker pool. The commands read files and wait
+///        for replicas, so they must not run on the event loop.
+/// @param connection represents the connection.
+void eventloop_dispatchConnection(t_connection *connection)
+{
+  connection->state = CONNECTION_RUNNING;
+  eventloop_watchConnection(connection, false);
+
+  if (workerpool_submit(eventloop_runConnection, connection) != 0)
   {
-    directory_releaseDirectory2();
+    // every command waits for the server's first reply, so the session stays usable after turning this one away
+    if (server_sendMessageToClient(connection->session.sock, "E:503 Server busy, try again later") != 0)
+    {
+      connection->session.isClosed = true;
+    }
+    eventloop_returnConnection(connection);
   }
-
-  printf("COMMAND: RM complete\n\n");
 }
 
-#pragma endregion Commands
-
-/// @brief Listens and server for incoming client connections.
-/// @return 0 if slient connection to server is successful, -1 otherwise.
-int server_listenForClients()
+/// @brief Takes back every connection the handler threads are done with. Finished sessions are closed, the rest
+///        wait for their next command.
+void eventloop_collectConnections()
 {
-  if (listen(socket_desc, 1) < 0)
+  uint64_t wakeups;
+  if (read(eventloop_wakeup_desc, &wakeups, sizeof(wakeups)) < 0 && errno != EAGAIN)
   {
-    printf("ERROR: Error while listening\n");
-    server_closeServerSocket();
-    return -1;
+    printf("EVENT LOOP ERROR: Couldn't read the wakeup descriptor\n");
   }
-  printf("\nListening for incoming connections.....\n");
 
-  socklen_t client_size;
-  struct sockaddr_in client_addr;
+  pthread_mutex_lock(&returned_connections_mutex);
 
-  // Accept an incoming connection:
-  client_size = sizeof(client_addr);
-  int client_sock = accept(socket_desc, (struct sockaddr *)&client_addr, &client_size);
+  t_connection *connection = returned_connections;
+  returned_connections = NULL;
 
-  if (client_sock < 0)
+  pthread_mutex_unlock(&returned_connections_mutex);
+
+  while (connection != NULL)
   {
-    printf("ERROR: Can't accept\n");
-    server_closeServerSocket();
-    return -1;
+    t_connection *next = connection->next_returned;
+
+    if (connection->session.isClosed)
+    {
+      eventloop_closeConnection(connection);
+    }
+    else if (eventloop_watchConnection(connection, true) != 0)
+    {
+      printf("EVENT LOOP ERROR: Couldn't watch client socket %d again\n", connection->session.sock);
+      eventloop_closeConnection(connection);
+    }
+    else
+    {
+      connection->state = CONNECTION_READING_HEADER;
+      connection->header_received = 0;
+      connection->last_active = time(NULL);
+    }
+
+    connection = next;
   }
-  printf("CLIENT CONNECTION: Client connected at IP: %s and port: %i\n", inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
-  printf("CLIENT CONNECTION: Client socket: %d\n", client_sock);
-  return client_sock;
 }
 
-/// @brief Listens for any incoming commands from the client, parses them and delegates the control to appropriate functions.
-///          The server functions are not directly exposed to the client and all control passes through this method.
-/// @param client_sock_arg represnts the socket of the incoming client for connection.
-/// @return NULL when the server terminates.
-void *server_listenForCommand(void *client_sock_arg)
+/// @brief Reads whatever part of the next command the client has sent, without blocking. Once the whole command
+///        frame is in, it is parsed and dispatched.
+/// @param connection represents the connection.
+void eventloop_readCommand(t_connection *connection)
 {
-  int client_sock = *((int *)client_sock_arg);
-  free(client_sock_arg);
+  int client_sock = connection->session.sock;
+  connection->last_active = time(NULL);
 
-  char client_command[CLIENT_COMMAND_SIZE];
-  memset(client_command, 0, sizeof(client_command));
-
-  printf("LISTEN: listening for command from client socket: %d\n", client_sock);
-
-  if (recv(client_sock, client_command, sizeof(client_command), 0) < 0)
+  while (connection->state != CONNECTION_RUNNING)
   {
-    printf("LISTEN ERROR: Couldn't listen for command\n");
-    server_closeClientSocket(client_sock);
+    ssize_t received;
 
-    return NULL;
-  }
+    if (connection->state == CONNECTION_READING_HEADER)
+    {
+      received = recv(client_sock, (char *)&connection->header + connection->header_received,
+                      FRAME_HEADER_SIZE - connection->header_received, MSG_DONTWAIT);
+    }
+    else
+    {
+      received = recv(client_sock, connection->command + connection->command_received,
+                      connection->header.length - connection->command_received, MSG_DONTWAIT);
+    }
 
-  printf("LISTEN: Message from client: %s\n", client_command);
+    if (received < 0 && errno == EINTR)
+      continue;
+    if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      return;
+    if (received <= 0)
+    {
+      // client went away or the socket broke
+      eventloop_closeConnection(connection);
+      return;
+    }
 
-  // Interpret entered command
-  char *pch;
-  pch = strtok(client_command, " \n");
+    if (connection->state == CONNECTION_READING_HEADER)
+    {
+      connection->header_received += received;
+      if (connection->header_received < FRAME_HEADER_SIZE)
+        continue;
 
-  char *args[3];
+      frame_decodeHeader(&connection->header);
 
-  args[0] = pch;
-  pch = strtok(NULL, " \n");
+      if (connection->header.opcode != FRAME_OP_COMMAND || connection->header.length >= CLIENT_COMMAND_SIZE)
+      {
+        printf("LISTEN ERROR: Couldn't listen for command\n");
+        eventloop_closeConnection(connection);
+        return;
+      }
 
-  // Set arguement Limits based on first argument
-  int argcLimit;
-  int argc = 1;
+      connection->state = CONNECTION_READING_COMMAND;
+      connection->command_received = 0;
+    }
+    else
+    {
+      connection->command_received += received;
+    }
 
-  if (strcmp(args[0], "C:001") == 0)
-  {
-    argcLimit = 3;
-  }
-  else if (strcmp(args[0], "C:002") == 0)
-  {
-    argcLimit = 2;
-  }
-  else if (strcmp(args[0], "C:003") == 0)
-  {
-    argcLimit = 3;
-  }
-  else if (strcmp(args[0], "C:004") == 0)
-  {
-    argcLimit = 2;
-  }
-  else if (strcmp(args[0], "C:005") == 0)
-  {
-    argcLimit = 2;
-  }
-  else
-  {
-    printf("LISTEN ERROR: Invalid command provided\n");
-    server_sendMessageToClient(client_sock, "E:404 Invalid command");
+    if (connection->state == CONNECTION_READING_COMMAND && connection->command_received == connection->header.length)
+    {
+      connection->command[connection->command_received] = '\0';
+      connection->argc = server_parseCommand(connection->command, connection->args);
+
+      eventloop_dispatchConnection(connection);
+    }
   }
+}
 
-  // Parse remaining arguements based on set command
+/// @brief Closes connections that have not sent a command for SERVER_IDLE_TIMEOUT_SECONDS.
+void eventloop_closeIdleConnections()
+{
+  time_t now = time(NULL);
+  t_connection *connection = open_connections;
 
-  while (pch != NULL)
+  while (connection != NULL)
   {
-    if (argc >= argcLimit)
+    t_connection *next = connection->next;
+
+    if (connection->state != CONNECTION_RUNNING && now - connection->last_active >= SERVER_IDLE_TIMEOUT_SECONDS)
     {
-      printf("LISTEN ERROR: Invalid number of arguements provided\n");
+      printf("LISTEN: client socket %d was idle for too long\n", connection->session.sock);
+      eventloop_closeConnection(connection);
     }
 
-    args[argc++] = pch;
-    pch = strtok(NULL, " \n");
+    connection = next;
   }
+}
 
-  // Redirect to correct command
-  if (strcmp(args[0], "C:001") == 0)
-  {
-    command_get(client_sock, args[1]);
-  }
-  else if (strcmp(args[0], "C:002") == 0)
-  {
-    command_info(client_sock, args[1]);
-  }
-  else if (strcmp(args[0], "C:003") == 0)
-  {
-    command_put(client_sock, args[2]);
-  }
-  else if (strcmp(args[0], "C:004") == 0)
-  {
-    command_makeDirectory(client_sock, args[1]);
-  }
-  else if (strcmp(args[0], "C:005") == 0)
-  {
-    command_remove(client_sock, args[1]);
-  }
-  else
+/// @brief Serves every client from one thread: accepts connections, reads their commands as bytes arrive and hands
+///        complete commands to handler threads. Idle connections cost a small struct instead of a thread.
+void eventloop_run()
+{
+  struct epoll_event events[SERVER_EVENTS_PER_WAIT];
+  time_t last_idle_check = time(NULL);
+
+  printf("\nListening for incoming connections.....\n");
+
+  while (true)
   {
-    printf("LISTEN ERROR: Invalid command provided\n");
-  }
+    int count = epoll_wait(epoll_desc, events, SERVER_EVENTS_PER_WAIT, 1000);
+    if (count < 0 && errno != EINTR)
+    {
+      printf("EVENT LOOP ERROR: epoll_wait failed: %s\n", strerror(errno));
+      server_closeServerSocket();
+    }
 
-  printf("LISTEN: Closing connection for client socket %d\n", client_sock);
-  server_closeClientSocket(client_sock);
+    for (int i = 0; i < count; i++)
+    {
+      if (events[i].data.ptr == NULL)
+      {
+        eventloop_acceptClients();
+      }
+      else if (events[i].data.ptr == &eventloop_wakeup_desc)
+      {
+        eventloop_collectConnections();
+      }
+      else
+      {
+        eventloop_readCommand(events[i].data.ptr);
+      }
+    }
 
-  return NULL;
+    if (time(NULL) != last_idle_check)
+    {
+      last_idle_check = time(NULL);
+      eventloop_closeIdleConnections();
+    }
+  }
 }
 
+#pragma endregion Event Loop
+#endif
+
 /// @brief Initialises the server and makes connections to the incoming clients.
 /// @param  represents the paramaters passes when the program is run. Here in our case, its none/void.
 /// @return 0 when the server terminates.
@@ -1430,6 +7011,16 @@ int main(void)
   if (status != 0)
     return 0;
 
+  if (workerpool_init() != 0)
+    return 0;
+
+#ifdef __linux__
+  // one event loop holds every connection, commands run on handler threads
+  if (eventloop_init() != 0)
+    return 0;
+
+  eventloop_run();
+#else
   while (true)
   {
     // Listen for clients:
@@ -1440,14 +7031,6 @@ int main(void)
       continue;
     }
 
-    // Create a new detached thread to serve client's message:
-    pthread_t thread_for_client_request;
-    pthread_attr_t attr;
-
-    // detach thread so that it can end without having to join it here again
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-
     int *arg = malloc(sizeof(*arg));
     if (arg == NULL)
     {
@@ -1457,9 +7040,15 @@ int main(void)
 
     *arg = client_sock;
 
-    // start listening for command from client
-    pthread_create(&thread_for_client_request, NULL, server_listenForCommand, arg);
+    // without an event loop a worker serves the whole session
+    if (workerpool_submit(server_listenForCommand, arg) != 0)
+    {
+      server_sendMessageToClient(client_sock, "E:503 Server busy, try again later");
+      server_closeClientSocket(client_sock);
+      free(arg);
+    }
   }
+#endif
 
   // Closing server socket:
   server_closeServerSocket();